@@ -1306,6 +1306,7 @@ uint8_t gma_ota_calc_crc(void)
     uint16_t len = 0;
 	img_hdr_t ImgHdr;
 
+    flash_wq_flush();
     read_addr = SEC_IMAGE_BACKUP_OAD_HEADER_FADDR;
     data_len = gma_ota_data.bin_len;
     savecrc = gma_ota_data.bin_crc;
@@ -1381,8 +1382,17 @@ void gma_ota_write_flash(void)
     if(gma_ota_is_ongoing() && (gma_ota_data.frame_len))
     {
     	//GMA_PRINTF("frame_len=%d",gma_ota_data.frame_len);
+    	// More data than announced at start: the update is dropped and its CRC check fails
+    	if((gma_ota_data.data_addr + gma_ota_data.frame_len) > SEC_IMAGE_BACKUP_ALLOC_END_FADDR)
+    	{
+    	    gma_ota_data.frame_len = 0;
+    	    gma_ota_clear_ongoingFlag();
+    	    return;
+    	}
+    	// Keep the frame and retry from the main loop while the queue is full
+    	if(flash_wq_push(gma_ota_data.data_addr, gma_ota_data.frame, gma_ota_data.frame_len) != CO_ERROR_NO_ERROR)
+    	    return;
         calccrc1 = genCrc16CCITT(calccrc1, gma_ota_data.frame, gma_ota_data.frame_len);
-    	flash_write(FLASH_MAIN_BASE_ADDR, gma_ota_data.data_addr, gma_ota_data.frame_len,gma_ota_data.frame,NULL);
     	gma_ota_data.data_addr += gma_ota_data.frame_len;
     	gma_ota_data.frame_len = 0;
 	}
@@ -1595,7 +1605,9 @@ uint8_t gma_recv_ota_start(gma_recv_data_s *gma_recv_data)
     GMA_PRINTF("fw_type:%x, ver_new:%x, ver_old:%x, rom_ver=0x%x,ver=0x%x,total_len:%x, total_crc:%x, ota_flag:%x\r\n",fw_type,ver_new,ver_old,img_hdr_new.rom_ver,img_hdr_new.ver,gma_ota_data.bin_len,gma_ota_data.bin_crc,ota_flag);
 
 	
-    if((ver_new != ver_old) && (!ota_flag))
+    // The image is received in the backup area, a larger one is refused
+    if((ver_new != ver_old) && (!ota_flag)
+        && (gma_ota_data.bin_len <= (SEC_IMAGE_BACKUP_ALLOC_END_FADDR - SEC_IMAGE_BACKUP_OAD_HEADER_FADDR)))
     {
         gma_ota_data.start_flag = 1;
 		
@@ -1624,6 +1636,7 @@ void gma_reply_ota_end_check(uint8_t msg_id)
     while(gma_ota_data.frame_len)
     {
     	GMA_PRINTF("-*-in gma_reply");
+        flash_wq_process();
         gma_ota_write_flash();         //ensure last data write to flash
     }
 
@@ -1716,6 +1729,13 @@ uint8_t gma_recv_ota_pdu(gma_recv_data_s *gma_recv_data)
         gma_ota_data.data_addr = SEC_IMAGE_BACKUP_OAD_HEADER_FADDR;
     }
 
+    // The previous frame is still waiting for room in the write queue
+    while(gma_ota_data.frame_len)
+    {
+        flash_wq_process();
+        gma_ota_write_flash();
+    }
+
     gma_ota_data.data_len += gma_recv_data->gma_frame_head.f_len;
     gma_ota_save_data(gma_recv_data->data, gma_recv_data->gma_frame_head.f_len);
     gma_ota_write_flash();
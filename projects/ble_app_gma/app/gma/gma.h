@@ -207,8 +207,8 @@ typedef struct
 
 #define SEC_IMAGE_BACKUP_OAD_HEADER_FADDR   (0x52000)
 #define SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR    (0x52010)
-#define SEC_IMAGE_BACKUP_ALLOC_START_FADDR  (0x52000) //(328KB)
-#define SEC_IMAGE_BACKUP_ALLOC_END_FADDR    (0x7E000) //(504KB)
+#define SEC_IMAGE_BACKUP_ALLOC_START_FADDR  (FLASH_BACKUP_START_ADDR) //(328KB)
+#define SEC_IMAGE_BACKUP_ALLOC_END_FADDR    (FLASH_BACKUP_END_ADDR) //(504KB, 492KB with the storage sectors)
 
 void gma_init(void);
 void gma_flag_clear(void);
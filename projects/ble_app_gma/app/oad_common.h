@@ -38,11 +38,12 @@
 #define FLASH_HALF_BLOCK_SIZE                (0X8000) // 32KB
 #define FLASH_ONE_BLOCK_SIZE                 (0X10000) // 64KB
 
-#define SEC_MAX_FSIZE_4K                         (180) //KB 
-#define SEC_MAX_FSIZE_APP_BLOCK              (0x2C00) // 176 * 1024 / 16
+#define SEC_MAX_FSIZE_4K                         (SEC_MAX_FSIZE_BYTE / 1024) //KB 
+#define SEC_MAX_FSIZE_APP_BLOCK              (SEC_MAX_FSIZE_BYTE / 16)
 #define SEC_MAX_FSIZE_STACK_APP_BLOCK            (0x4F00) // 316 * 1024 / 16 (stack + app)
 
-#define SEC_MAX_FSIZE_BYTE                   (0X2C000) //176 * 1024
+/// Whole backup area: 176KB, 164KB when the storage sectors are reserved (flash_map.h)
+#define SEC_MAX_FSIZE_BYTE                   (SEC_IMAGE_BACKUP_ALLOC_END_FADDR - SEC_IMAGE_BACKUP_ALLOC_START_FADDR)
 
 
 #define SEC_IMAGE_STACK_RUN_CADDR            (0x2F00)
@@ -63,8 +64,12 @@
 
 #define SEC_IMAGE_BACKUP_OAD_HEADER_FADDR            (0x52000) //328kb * 1024
 #define SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR             (0x52010) //328kb * 1024 + 0X10
-#define SEC_IMAGE_BACKUP_ALLOC_START_FADDR       (0x52000) //(328KB)
-#define SEC_IMAGE_BACKUP_ALLOC_END_FADDR             (0x7E000) //(504KB)
+#define SEC_IMAGE_BACKUP_ALLOC_START_FADDR       (FLASH_BACKUP_START_ADDR) //(328KB)
+#define SEC_IMAGE_BACKUP_ALLOC_END_FADDR             (FLASH_BACKUP_END_ADDR) //(504KB, 492KB with the storage sectors)
+
+/// Storage sectors above the backup area, empty unless a feature uses them (flash_map.h)
+#define SEC_STORAGE_ALLOC_START_FADDR            (FLASH_STORAGE_START_ADDR)
+#define SEC_STORAGE_ALLOC_END_FADDR              (FLASH_STORAGE_END_ADDR) //(504KB)
 
 
 #define IMAGE_TOTAL_LEN_64K                 0x4000
@@ -141,6 +146,19 @@ typedef struct
 
 #define  BLOCK_SIZE         0X10
 
+// Backup image CRC verification modes used by calc_backup_sec_crc()
+#define OAD_CRC_VERIFY_DOUBLE_READ      0   // read every block twice and compare
+#define OAD_CRC_VERIFY_STREAM           1   // single streaming pass, re-run only on mismatch
+
+#ifndef OAD_CRC_VERIFY_MODE
+#define OAD_CRC_VERIFY_MODE             OAD_CRC_VERIFY_STREAM
+#endif
+
+// Flash read window of the streaming CRC pass (stack buffer, multiple of BLOCK_SIZE)
+#ifndef OAD_CRC_READ_SIZE
+#define OAD_CRC_READ_SIZE               (0x80)
+#endif
+
 #define CRC_UNCHECK         0xFF
 #define CRC_CHECK_OK        0xAA
 #define CRC_CHECK_FAIL      0x55
@@ -121,6 +121,8 @@ enum app_loc_nvds_tag
 
     NVDS_TAG_MESH_LED_INFO,
 
+    // Tags from 0xAD (NVDS_TAG_MESH_SDK_FIRST, m_tb_store.h) are used by the mesh SDK
+
     /// size of local identity resolving key
     NVDS_LEN_LOC_IRK                    = KEY_LEN,
     /// size of Peer device identity resolving key (+identity address)
@@ -6,6 +6,7 @@
 
 #include "mm_gens_int.h"
 #include "mm_lights_int.h"
+#include "m_tb_mio.h"          // m_tb_mio_get_nb_elements
 
 #include "app_light_ali_server.h"
 #include "app.h"
@@ -57,7 +58,7 @@ ali_light_report_t  ali_light_report;
 
 
 //light lightness states
-
+extern uint16_t light_lightness;
 
 //CTL model states
 extern uint16_t ctl_lightness;
@@ -65,12 +66,44 @@ extern uint16_t ctl_temperature;
 extern uint16_t ctl_delta_uv;
 //HSL model states
 extern uint16_t hsl_lightness;
+extern uint16_t hsl_hue;
+extern uint16_t hsl_saturation;
 uint16_t light_hsl_16[3];
 
 
-static uint16_t scene_num[5];
+/// Light states kept in a scene, index in m_fnd_scene_state_t
+enum light_scene_state
+{
+    LIGHT_SCENE_MODE,
+    LIGHT_SCENE_LIGHTNESS,
+    LIGHT_SCENE_TEMPERATURE,
+    LIGHT_SCENE_DELTA_UV,
+    LIGHT_SCENE_HUE,
+    LIGHT_SCENE_SATURATION,
+    LIGHT_SCENE_HSL_LIGHTNESS,
+};
+
 static uint16_t cur_scene_num;
 
+/// Set a state of a light server model the way a local state set does, bound states follow.
+/// The model is looked up from the element of the Scene Server on: the CTL Temperature,
+/// HSL Hue and HSL Saturation servers are registered on the elements after it
+static void light_scene_model_set(uint8_t elmt_idx, uint32_t mdl_id, uint16_t state_id, uint32_t state)
+{
+    uint8_t nb_elmt = m_tb_mio_get_nb_elements();
+    m_lid_t mdl_lid = MESH_INVALID_LID;
+
+    for (; (mdl_lid == MESH_INVALID_LID) && (elmt_idx < nb_elmt); elmt_idx++)
+    {
+        mdl_lid = mm_tb_state_get_lid(elmt_idx, mdl_id);
+    }
+
+    if (mdl_lid != MESH_INVALID_LID)
+    {
+        mm_api_srv_set(mdl_lid, state_id, state);
+    }
+}
+
 int32_t light_scene_server_data(const m_fnd_model_env_p pmodel_info, uint32_t type,
                                 void *pargs)
 {
@@ -86,6 +119,47 @@ int32_t light_scene_server_data(const m_fnd_model_env_p pmodel_info, uint32_t ty
         case M_FND_SCENE_SERVER_RECALL:
         {
             m_fnd_scene_server_set_t *pdata = pargs;
+            if (pdata->p_state != NULL)
+            {
+                // Set every state first, the light then moves to the whole scene at once
+                const uint16_t *p_val = pdata->p_state->val;
+                uint8_t elmt_idx = pmodel_info->env.elmt_idx;
+
+                light_lightness = p_val[LIGHT_SCENE_LIGHTNESS];
+                ctl_temperature = p_val[LIGHT_SCENE_TEMPERATURE];
+                ctl_delta_uv = p_val[LIGHT_SCENE_DELTA_UV];
+                hsl_hue = p_val[LIGHT_SCENE_HUE];
+                hsl_saturation = p_val[LIGHT_SCENE_SATURATION];
+                hsl_lightness = p_val[LIGHT_SCENE_HSL_LIGHTNESS];
+                light_mode_set(p_val[LIGHT_SCENE_MODE]);
+                light_state_set(light_lightness != 0);
+
+                if (light_mode_get() == LIGHT_MODE_CTL)
+                {
+                    ctl_lightness = light_lightness;
+                    light_set_ctl(light_lightness, ctl_temperature, ctl_delta_uv);
+                }
+                else
+                {
+                    light_set_hsl(light_lightness, hsl_hue, hsl_saturation, hsl_lightness);
+                }
+
+                // The models answer Get and publish the recalled states, not the former ones.
+                // Light Lightness is bound to the CTL and HSL lightness: only the server of the
+                // scene mode is set, so that one lightness does not overwrite the other
+                if (light_mode_get() == LIGHT_MODE_CTL)
+                {
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_CTL, MM_STATE_LIGHT_CTL_LN, light_lightness);
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_CTL, MM_STATE_LIGHT_CTL_TEMP, ctl_temperature);
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_CTL, MM_STATE_LIGHT_CTL_DELTA_UV, ctl_delta_uv);
+                }
+                else
+                {
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_HSL, MM_STATE_LIGHT_HSL_LN, hsl_lightness);
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_HSLH, MM_STATE_LIGHT_HSL_HUE, hsl_hue);
+                    light_scene_model_set(elmt_idx, MM_ID_LIGHTS_HSLSAT, MM_STATE_LIGHT_HSL_SAT, hsl_saturation);
+                }
+            }
             if (0 == pdata->remaining_time.num_steps)
             {
                 cur_scene_num = pdata->scene_number;
@@ -94,49 +168,29 @@ int32_t light_scene_server_data(const m_fnd_model_env_p pmodel_info, uint32_t ty
 
         case M_FND_SCENE_SERVER_STORE:
         {
-            m_fnd_scenes_store_t *pdata = pargs;
+            m_fnd_scene_server_store_t *pdata = pargs;
+            uint16_t *p_val = pdata->state.val;
 
             cur_scene_num = pdata->scene_number;
-            {
-                for (int i =0; i < M_FND_SCENES_STORE_MAX; i++)
-                {
-                    if ((scene_num[i] == 0 ) || (scene_num[i] == pdata->scene_number))
-                    {
-                        scene_num[i]    = pdata->scene_number;
-                        break;
-                    }
-                }
-            }
-
+            p_val[LIGHT_SCENE_MODE] = light_mode_get();
+            p_val[LIGHT_SCENE_LIGHTNESS] = light_lightness;
+            p_val[LIGHT_SCENE_TEMPERATURE] = ctl_temperature;
+            p_val[LIGHT_SCENE_DELTA_UV] = ctl_delta_uv;
+            p_val[LIGHT_SCENE_HUE] = hsl_hue;
+            p_val[LIGHT_SCENE_SATURATION] = hsl_saturation;
+            p_val[LIGHT_SCENE_HSL_LIGHTNESS] = hsl_lightness;
         } break;
 
         case M_FND_SCENE_SERVER_DELETE:
         {
             MESH_APP_PRINT_INFO("M_FND_SCENE_SERVER_DELETE\r\n");
             m_fnd_scenes_delete_t *pdata = pargs;
-            for (int i =0; i < M_FND_SCENES_STORE_MAX; i++)
+            if (cur_scene_num == pdata->scene_number)
             {
-                if (scene_num[i] == pdata->scene_number)
-                {
-                    scene_num[i] = 0;
-                    break;
-                }
+                cur_scene_num = 0;
             }
         } break;
 
-        case M_FND_SCENE_SERVER_GET_REGISTER:
-        {
-            MESH_APP_PRINT_INFO("M_FND_SCENE_SERVER_GET_REGISTER\r\n");
-            m_fnd_scene_server_get_register_t *pdata = pargs;
-            uint8_t j = 0;
-            for (int i =0; i < M_FND_SCENES_STORE_MAX; i++)
-            {
-                if (scene_num[i] != 0)
-                {
-                    pdata->scenes[j++] =  scene_num[i];
-                }
-            }
-        } break;
         default:break;
     }
 
@@ -240,12 +240,23 @@ uint8_t encrypt_key_array[16] =
  */
 
 
+void platform_reset_prepare(void)
+{
+    // No application data waits for the flash
+}
+
 void platform_reset(uint32_t error)
 {
     //void (*pReset)(void);
 
     MESH_APP_PRINT_INFO("error = %x\r\n", error);
 
+    // The flash is left alone after an error
+    if (error == RESET_NO_ERROR)
+    {
+        platform_reset_prepare();
+    }
+
     // Disable interrupts
     GLOBAL_INT_STOP();
 
@@ -405,6 +416,9 @@ void rw_app_enter(void)
         //schedule all pending events
         rwip_schedule();
 
+        // Program deferred OTA writes between scheduler passes
+        flash_wq_process();
+
         // Checks for sleep have to be done with interrupt disabled
         GLOBAL_INT_DISABLE();
 
@@ -504,6 +518,7 @@ int main(void)
     */
     // Initialize RW SW stack
     rwip_init(0);
+    flash_mode_tput_measure();
     if (system_mode == RW_DUT_MODE)
     {
         switch_clk(MCU_CLK_16M);
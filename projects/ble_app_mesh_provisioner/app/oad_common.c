@@ -13,6 +13,16 @@
 #include "icu.h"
 #include "wdt.h"
 #include "mesh_log.h"
+#include "nvds_log.h"
+#include "oad_crc.h"
+
+// The backup area is erased whole by oads_erase_backup_sec, the log must stay above it
+#if (NVDS_LOG_STRUCTURED)
+#if ((NVDS_LOG_BASE_ADDR < SEC_STORAGE_ALLOC_START_FADDR) \
+    || ((NVDS_LOG_BASE_ADDR + NVDS_LOG_SECT_NB * NVDS_LOG_SECT_SIZE) > SEC_STORAGE_ALLOC_END_FADDR))
+#error "NVDS log area outside of the storage sectors"
+#endif
+#endif // (NVDS_LOG_STRUCTURED)
 
 uint32_t crc32_table[256];
 img_hdr_t hdr_back;
@@ -104,40 +114,18 @@ uint32_t oad_get_psec_backup_header(void)
 uint32_t calc_backup_sec_crc(void)
 {
     MESH_APP_PRINT_INFO("%s\r\n", __func__);
-    uint8_t data[BLOCK_SIZE];
-    uint8_t tmp_data[BLOCK_SIZE];
     uint16_t block_total;
-    uint32_t read_addr;
-    uint32_t calcuCrc = 0xffffffff;
+    uint32_t calcuCrc;
+    // Queued OTA writes must reach flash before the image is read back
+    flash_wq_flush();
     oad_get_psec_backup_header();
     make_crc32_table(0xEDB88320);
     block_total = hdr_back.len / 4 - 1;
-    read_addr = SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR;
-    MESH_APP_PRINT_INFO("read start addr = 0x%x\r\n", read_addr);
+    MESH_APP_PRINT_INFO("read start addr = 0x%x\r\n", SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR);
     MESH_APP_PRINT_INFO("block_total= 0x%x\r\n", block_total);
 
-    for (uint32_t i = 0; i < block_total; i++)
-    {
-        flash_read(0, read_addr, BLOCK_SIZE, data, NULL);
-        flash_read(0, read_addr, BLOCK_SIZE, tmp_data, NULL);
-        //for (int a=0; a<BLOCK_SIZE; a++)
-        //{
-        //    MESH_APP_PRINT_INFO("%02x ", tmp_data[a]);
-        //}
-        //MESH_APP_PRINT_INFO("\r\n");
-        calcuCrc = make_crc32(calcuCrc, data, BLOCK_SIZE);
-        read_addr+= BLOCK_SIZE;
-
-        if (memcmp(data, tmp_data, BLOCK_SIZE) != 0)
-        {
-            MESH_APP_PRINT_INFO("read_addr error = 0x08%x\r\n", read_addr);
-            for (int a=0; a<BLOCK_SIZE; a++)
-            {
-                MESH_APP_PRINT_INFO("tmp_data = %02x,data = %02x \r\n", tmp_data[a], data[a]);
-            }
-        }
-    }
-    MESH_APP_PRINT_INFO("read end addr = 0x%x,calcuCrc = 0x%08x\r\n", read_addr, calcuCrc);
+    calcuCrc = oad_crc_backup_image((uint32_t)block_total * BLOCK_SIZE, hdr_back.crc);
+    MESH_APP_PRINT_INFO("read end addr = 0x%x,calcuCrc = 0x%08x\r\n", SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR + block_total * BLOCK_SIZE, calcuCrc);
 
     MESH_APP_PRINT_INFO("return crc = 0x%x\r\n", calcuCrc);
     if (hdr_back.crc == calcuCrc)
@@ -121,6 +121,11 @@ enum app_loc_nvds_tag
 
     NVDS_TAG_MESH_LED_INFO,
 
+    /// Light CTL and HSL states, the lightness is kept in NVDS_TAG_LIGHT_STATE
+    NVDS_TAG_LIGHT_CTL,
+    NVDS_TAG_LIGHT_HSL,
+    // Tags from 0xAD (NVDS_TAG_MESH_SDK_FIRST, m_tb_store.h) are used by the mesh SDK
+
     /// size of local identity resolving key
     NVDS_LEN_LOC_IRK                    = KEY_LEN,
     /// size of Peer device identity resolving key (+identity address)
@@ -90,6 +90,8 @@
 #include "user_config.h"
 #include "ali_config.h"
 #include "app_mesh.h"
+#include "m_config.h"
+#include "m_tb_store.h"
 #include "led.h"
 #include "app_light_ali_server.h"
 #include "lld_adv_test.h"
@@ -210,12 +212,24 @@ uint8_t encrypt_key_array[16] =
  */
 
 
+void platform_reset_prepare(void)
+{
+    // Light state change still waiting for its settle time
+    light_state_nv_flush();
+}
+
 void platform_reset(uint32_t error)
 {
     //void (*pReset)(void);
 
     MESH_APP_PRINT_INFO("error = %x\r\n", error);
 
+    // The flash is left alone after an error
+    if (error == RESET_NO_ERROR)
+    {
+        platform_reset_prepare();
+    }
+
     // Disable interrupts
     GLOBAL_INT_STOP();
 
@@ -282,6 +296,11 @@ void rw_app_enter(void)
         //schedule all pending events
         rwip_schedule();
 
+        // Program deferred OTA writes between scheduler passes
+        flash_wq_process();
+        // Store pending mesh tags between radio events, scanner stays enabled
+        m_tb_store_process();
+
         // Checks for sleep have to be done with interrupt disabled
         GLOBAL_INT_DISABLE();
 
@@ -467,6 +486,7 @@ int main(void)
     */
     // Initialize RW SW stack
     rwip_init(0);
+    flash_mode_tput_measure();
     if (system_mode == RW_DUT_MODE)
     {
         switch_clk(MCU_CLK_16M);
@@ -17,7 +17,6 @@
 #include <stddef.h>    // standard definitions
 #include <stdint.h>    // standard integer definition
 #include "mesh_tb_timer.h"
-#include <math.h>
 #include "gpio.h"
 #include "rwip.h"
 #include "mesh_log.h"
@@ -40,8 +39,10 @@
 #include "m_tb_state.h"
 
 #include "led.h"
+#include "light_trans.h"
 #include "pwm.h"
 #include "nvds.h"
+#include <string.h>
 #include "app.h"
 #include "uart.h"
 
@@ -79,8 +80,6 @@ uint16_t light_cwrgb[5] = {0, 0xffff, 0, 0, 0}; //!< c,w,r,g,b // save to flash
 //uint16_t light_ctl[3]; //!< temperature, delta_uv, lightness
 //uint32_t light_upload_period = 15; //!< unit: second
 
-static uint16_t pwm_duty_scale[5] = {0, 0, 0, 0, 0};
-
 uint8_t gen_onoff ;
 
 /* light factory restore */
@@ -90,7 +89,6 @@ mesh_tb_timer_t light_gra_timer;
 //light_property_t now_light_prop;
 //light_property_t gra_light_prop;
 uint8_t light_status = 1;
-uint8_t led_timer_status = LIGHT_FREE;
 
 static uint8_t prov_comp_light_cnt = 0;
 static uint8_t uprov_light_cnt = 0;
@@ -106,15 +104,6 @@ static uint8_t uprov_light_cnt = 0;
 
 #define  pwm_low_line       250
 
-void light_periodic_ctrl(void);
-
-
-void pwm6_irq_done(void)
-{
-    pwm_isr();
-    light_periodic_ctrl();
-}
-
 void light_cwrgb_init(void)
 {
     rwip_prevent_sleep_set(BK_DRIVER_TIMER_ACTIVE);
@@ -238,44 +227,55 @@ static const uint32_t temperature_map[] =
     0xadc1ff
 };
 
-float hue_2_rgb(float v1, float v2, float h)
+/// Full scale of a 16-bit colour component, the value 1.0 of the colour maths
+#define LIGHT_COLOR_ONE     65535UL
+
+/**
+ * One RGB component of an HSL colour, fixed-point.
+ * v1, v2 and the result are scaled by LIGHT_COLOR_ONE, h is the hue of the
+ * component scaled the same way and may be one turn out of range.
+ */
+static uint16_t hue_2_rgb(uint32_t v1, uint32_t v2, int32_t h)
 {
+    uint32_t rgb;
+
     if (h < 0)
     {
-        h += 1;
+        h += LIGHT_COLOR_ONE;
     }
-    else if (h > 1)
+    else if (h > (int32_t)LIGHT_COLOR_ONE)
     {
-        h -= 1;
+        h -= LIGHT_COLOR_ONE;
     }
-    if (6 * h < 1)
+    // (v2 - v1) and the hue term are 16-bit, their product fits in 32 bits
+    if (6 * h < (int32_t)LIGHT_COLOR_ONE)
     {
-        return v1 + (v2 - v1) * 6 * h;
+        rgb = v1 + ((v2 - v1) * (6 * h) + LIGHT_COLOR_ONE - 1) / LIGHT_COLOR_ONE;
     }
-    else if (2 * h < 1)
+    else if (2 * h < (int32_t)LIGHT_COLOR_ONE)
     {
-        return v2;
+        rgb = v2;
     }
-    else if (3 * h < 2)
+    else if (3 * h < 2 * (int32_t)LIGHT_COLOR_ONE)
     {
-        return v1 + (v2 - v1) * (4 - 6 * h);
+        rgb = v1 + ((v2 - v1) * (4 * LIGHT_COLOR_ONE - 6 * h) + LIGHT_COLOR_ONE - 1) / LIGHT_COLOR_ONE;
     }
     else
     {
-        return v1;
+        rgb = v1;
     }
+
+    return (rgb > LIGHT_COLOR_ONE) ? LIGHT_COLOR_ONE : rgb;
 }
 
 /**
  * Converts an HSL color value to RGB. Conversion formula
  * adapted from http://en.wikipedia.org/wiki/HSL_color_space.
- * Assumes h, s, and l are contained in the set [0, 1] and
- * returns r, g, and b in the set [0, 255].
+ * h, s, l and r, g, b are all in [0, 65535]. The maths is done in 32-bit
+ * integers, the result is within 2 of the former float version.
  *
- * @param   Number  h       The hue
- * @param   Number  s       The saturation
- * @param   Number  l       The lightness
- * @return  Array           The RGB representation
+ * @param   rgb     The RGB representation
+ * @param   hsl     The hue, saturation and lightness
  */
 
 void hsl_2_rgb(uint16_t rgb[3], uint16_t hsl[3])
@@ -286,22 +286,22 @@ void hsl_2_rgb(uint16_t rgb[3], uint16_t hsl[3])
     }
     else
     {
-        float h, s, l, v1, v2;
-        h = (float)hsl[0] / 65535.0;
-        s = (float)hsl[1] / 65535.0;
-        l = (float)hsl[2] / 65535.0;
-        if (l < 0.5f)
+        uint32_t s, l, v1, v2;
+        s = hsl[1];
+        l = hsl[2];
+        if (l <= LIGHT_COLOR_ONE / 2)
         {
-            v2 = l * (1.0 + s);
+            v2 = l + (l * s + LIGHT_COLOR_ONE - 1) / LIGHT_COLOR_ONE;
         }
         else
         {
-            v2 = (l + s) - (s * l);
+            v2 = (l + s) - (s * l) / LIGHT_COLOR_ONE;
         }
-        v1 = 2.0 * l - v2;
-        rgb[0] = ceil(65535 * hue_2_rgb(v1, v2, h + 1.0 / 3));
-        rgb[1] = ceil(65535 * hue_2_rgb(v1, v2, h));
-        rgb[2] = ceil(65535 * hue_2_rgb(v1, v2, h - 1.0 / 3));
+        v1 = 2 * l - v2;
+        // 1/3 turn is exactly LIGHT_COLOR_ONE / 3
+        rgb[0] = hue_2_rgb(v1, v2, (int32_t)hsl[0] + LIGHT_COLOR_ONE / 3);
+        rgb[1] = hue_2_rgb(v1, v2, (int32_t)hsl[0]);
+        rgb[2] = hue_2_rgb(v1, v2, (int32_t)hsl[0] - (int32_t)(LIGHT_COLOR_ONE / 3));
     }
 }
 
@@ -357,69 +357,168 @@ void rgb_2_hsl(uint16_t hsl[3], uint16_t rgb[3])
     }
     else if (hsl[2] <= 32767)
     {
-        hsl[1] = ceil(65535 * (double)(max - min) / (max + min));
+        hsl[1] = ((max - min) * 65535UL + (max + min) - 1) / (max + min);
     }
     else
     {
-        hsl[1] = ceil(65535 * (double)(max - min) / (2 * 65535 - max - min));
+        hsl[1] = ((max - min) * 65535UL + (2 * 65535 - max - min) - 1) / (2 * 65535 - max - min);
     }
 }
 
-static uint8_t color_16to8(uint16_t color)
+/// Colour temperature of the first entry of temperature_map, in K
+#define LIGHT_TEMPERATURE_MIN       800
+/// Colour temperature step between two entries of temperature_map, in K
+#define LIGHT_TEMPERATURE_STEP      100
+#define LIGHT_TEMPERATURE_NB        (sizeof(temperature_map) / sizeof(temperature_map[0]))
+#define LIGHT_TEMPERATURE_MAX       (LIGHT_TEMPERATURE_MIN + (LIGHT_TEMPERATURE_NB - 1) * LIGHT_TEMPERATURE_STEP)
+/// Entries of temperature_map with no blue, below 2000K
+#define LIGHT_TEMPERATURE_NO_BLUE   12
+/// Green gain of delta_uv: green is scaled by 1 + 2 * gain * delta_uv / 65536,
+/// a Duv of 0.05 (delta_uv 1638) adds 20 % of green
+#define LIGHT_DUV_GAIN              4
+
+/// Component of a temperature_map entry: shift 16 for red, 8 for green, 0 for blue
+#define TEMPERATURE_MAP_COLOR(idx, shift)   ((temperature_map[idx] >> (shift)) & 0xFF)
+
+/// Ratio of a component to red of a temperature_map entry, Q12
+static uint32_t temperature_map_ratio(uint16_t idx, uint8_t shift)
 {
-    return color / 65535.0 * 255;
+    return (TEMPERATURE_MAP_COLOR(idx, shift) << 12) / TEMPERATURE_MAP_COLOR(idx, 16);
 }
 
+/// One 16-bit component at pos K above LIGHT_TEMPERATURE_MIN, linear between table entries
+static uint16_t temperature_map_color(uint32_t pos, uint8_t shift)
+{
+    uint16_t idx = pos / LIGHT_TEMPERATURE_STEP;
+    uint32_t frac = pos % LIGHT_TEMPERATURE_STEP;
+
+    if (idx >= LIGHT_TEMPERATURE_NB - 1)
+    {
+        return TEMPERATURE_MAP_COLOR(LIGHT_TEMPERATURE_NB - 1, shift) * 257;
+    }
+
+    // 257 maps 0xFF to 0xFFFF
+    return ((TEMPERATURE_MAP_COLOR(idx, shift) * (LIGHT_TEMPERATURE_STEP - frac)
+             + TEMPERATURE_MAP_COLOR(idx + 1, shift) * frac) * 257) / LIGHT_TEMPERATURE_STEP;
+}
 
 /**
- * @note do not support delta uv right now
+ * Converts RGB back to a colour temperature.
+ * Blue to red, and green to red below 2000K where there is no blue, grow with the
+ * temperature in temperature_map and do not depend on the lightness: they are
+ * looked up with a binary search then interpolated. The 8-bit table flattens the
+ * ratio above 10000K, the temperature found may be up to 600K off there
+ * (under 2 mired). delta_uv is taken from the green left over, the luminance that
+ * scaled the colour (light_luminance of the lightness) from red.
+ * Below 2000K green gives the temperature and delta_uv is reported as 0.
  */
 void rgb_2_ctl(uint16_t ctl[3], uint16_t cwrgb[5])
 {
-    ctl[1] = 0;
-    ctl[2] = cwrgb[0];
-
-    uint32_t min_delta = 0xffffffff;
-    uint32_t delta = 0;
-    uint16_t min_index = 0;
-    uint32_t rgb = color_16to8(cwrgb[2]);
-    rgb <<= 8;
-    rgb |= color_16to8(cwrgb[3]);
-    rgb <<= 8;
-    rgb = color_16to8(cwrgb[4]);
-    rgb <<= 8;
-    for (uint16_t i = 0; i < sizeof(temperature_map) / sizeof(temperature_map[0]); ++i)
-    {
-        delta = (temperature_map[i] > rgb) ? (temperature_map[i] - rgb) : (rgb - temperature_map[i]);
-        if (delta < min_delta)
+    uint32_t r = cwrgb[2];
+    uint8_t shift = 0;
+    uint16_t lo = LIGHT_TEMPERATURE_NO_BLUE - 1;
+    uint16_t hi = LIGHT_TEMPERATURE_NB - 1;
+    uint16_t mid;
+    uint32_t ratio;
+    uint32_t pos;
+    int32_t tint;
+
+    if (r == 0)
+    {
+        // No colour left to tell the temperature
+        ctl[0] = ctl_temperature;
+        ctl[1] = ctl_delta_uv;
+        ctl[2] = 0;
+        return;
+    }
+
+    if (cwrgb[4] == 0)
+    {
+        shift = 8;
+        lo = 0;
+        hi = LIGHT_TEMPERATURE_NO_BLUE - 1;
+    }
+
+    ratio = ((uint32_t)cwrgb[shift ? 3 : 4] << 12) / r;
+
+    // First entry with a ratio not below the one of the colour
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (temperature_map_ratio(mid, shift) < ratio)
         {
-            min_delta = delta;
-            min_index = i;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
         }
     }
-    ctl[0] = 800 + min_index * 100;
+
+    pos = lo * LIGHT_TEMPERATURE_STEP;
+    if ((lo > 0) && (temperature_map_ratio(lo, shift) > ratio))
+    {
+        uint32_t ratio_lo = temperature_map_ratio(lo - 1, shift);
+
+        if (ratio > ratio_lo)
+        {
+            pos -= LIGHT_TEMPERATURE_STEP
+                   - (ratio - ratio_lo) * LIGHT_TEMPERATURE_STEP / (temperature_map_ratio(lo, shift) - ratio_lo);
+        }
+        else
+        {
+            pos -= LIGHT_TEMPERATURE_STEP;
+        }
+    }
+    ctl[0] = LIGHT_TEMPERATURE_MIN + pos;
+
+    ctl[1] = 0;
+    if (shift == 0)
+    {
+        // Green to red against the one of the table, Q12
+        uint32_t ratio_g = ((uint32_t)cwrgb[3] << 12) / r;
+        uint32_t ratio_exp = ((uint32_t)temperature_map_color(pos, 8) << 12) / temperature_map_color(pos, 16);
+
+        ratio_g = MIN(ratio_g, 0xFFFF);
+        tint = ((int32_t)ratio_g - (int32_t)ratio_exp) * 4096 / (int32_t)ratio_exp;
+        tint = tint * 8 / LIGHT_DUV_GAIN;
+        ctl[1] = (uint16_t)MAX(MIN(tint, 32767), -32768);
+    }
+
+    ctl[2] = MIN(r * 65535 / temperature_map_color(pos, 16), 65535);
 }
 
-uint32_t temperature_to_rgb(uint16_t temperature, int16_t delta_uv)
+/**
+ * Converts a colour temperature to RGB, each component 16-bit, interpolated
+ * between the entries of temperature_map. delta_uv tints green, positive values
+ * above the Planckian locus are greener, negative ones more magenta.
+ */
+void temperature_to_rgb(uint16_t temperature, int16_t delta_uv, uint16_t rgb[3])
 {
-    // UNUSED(delta_uv);
-    uint16_t index = round((temperature - 800) / 100.0);
-    return temperature_map[index];
-}
+    uint32_t pos;
+    int32_t green;
 
+    temperature = MAX(temperature, LIGHT_TEMPERATURE_MIN);
+    temperature = MIN(temperature, LIGHT_TEMPERATURE_MAX);
+    pos = temperature - LIGHT_TEMPERATURE_MIN;
 
+    rgb[0] = temperature_map_color(pos, 16);
+    rgb[2] = temperature_map_color(pos, 0);
 
-static  uint16_t color_8to16(uint8_t color)
-{
-    return color / 255.0 * 65535;
+    green = temperature_map_color(pos, 8);
+    // Q12 gain keeps the product in 32 bits
+    green += (green * ((2 * LIGHT_DUV_GAIN * delta_uv) / 16)) / 4096;
+    rgb[1] = MAX(MIN(green, 65535), 0);
 }
+
+
 void light_set_cwrgb(uint16_t cwrgb[5])
 {
     bool save_flash = false;
     uint8_t channel;
 
 
-    MESH_APP_PRINT_INFO("-light_set_cwrgb  STS = %d\r\n", led_timer_status);
+    MESH_APP_PRINT_INFO("-light_set_cwrgb  STS = %d\r\n", light_trans_status_get());
     MESH_APP_PRINT_INFO("light_state :%s\r\n", light_state_get() == 1? "light_on" : "light_off");
     MESH_APP_PRINT_INFO("light_mode :%s\r\n", light_mode_get() == 1? "LIGHT_MODE_RGB" : "LIGHT_MODE_CTL");
     MESH_APP_PRINT_INFO("light_cwrgb[0] = %x\r\n", cwrgb[0]);
@@ -427,19 +526,16 @@ void light_set_cwrgb(uint16_t cwrgb[5])
     MESH_APP_PRINT_INFO("light_cwrgb[2] = %d\r\n", cwrgb[2]);
     MESH_APP_PRINT_INFO("light_cwrgb[3] = %d\r\n", cwrgb[3]);
     MESH_APP_PRINT_INFO("light_cwrgb[4] = %d\r\n", cwrgb[4]);
-    if (led_timer_status == LIGHT_FREE)
+    if (light_trans_status_get() != LIGHT_FREE)
     {
-        for (channel = 0; channel < 5; channel++)
-        {
-            light_cwrgb[channel] = cwrgb[channel];
-        }
-        led_timer_status = LIGHT_START;
-
+        MESH_APP_PRINT_INFO("light_set_cwrgb retarget %d\n", light_trans_status_get());
     }
-    else
+
+    for (channel = 0; channel < 5; channel++)
     {
-        MESH_APP_PRINT_INFO("light_set_cwrgb BUSY %d\n", led_timer_status);
+        light_cwrgb[channel] = cwrgb[channel];
     }
+    light_trans_start(cwrgb);
 }
 
 
@@ -474,6 +570,7 @@ void light_set_hsl(uint16_t ln_lightness, uint16_t hue, uint16_t saturation, uin
     uint16_t cwrgb[5];
     uint16_t hsl[3];
     uint16_t rgb[3];
+    uint32_t luminance = light_luminance(ln_lightness);
 
     hsl[0] = hue;
     hsl[1] = saturation;
@@ -484,9 +581,9 @@ void light_set_hsl(uint16_t ln_lightness, uint16_t hue, uint16_t saturation, uin
 
     cwrgb[0] = 0;
     cwrgb[1] = 0;
-    cwrgb[2] = rgb[0] * ln_lightness / 65535;
-    cwrgb[3] = rgb[1] * ln_lightness / 65535;
-    cwrgb[4] = rgb[2] * ln_lightness / 65535;
+    cwrgb[2] = (uint32_t)rgb[0] * luminance / 65535;
+    cwrgb[3] = (uint32_t)rgb[1] * luminance / 65535;
+    cwrgb[4] = (uint32_t)rgb[2] * luminance / 65535;
     light_set_cwrgb(cwrgb);
 }
 
@@ -508,12 +605,15 @@ void light_set_ctl(uint16_t lightness, uint16_t temperature, int16_t delta_uv)
     MESH_APP_PRINT_INFO("temperature = %d\n", temperature);
     MESH_APP_PRINT_INFO("delta_uv = %d\n", delta_uv);
 
-    uint32_t rgb = temperature_to_rgb(temperature, delta_uv);
+    uint16_t rgb[3];
+    uint32_t luminance = light_luminance(lightness);
+
+    temperature_to_rgb(temperature, delta_uv, rgb);
     cwrgb[0] = 0;
     cwrgb[1] = 0;
-    cwrgb[2] = color_8to16(rgb >> 16) * lightness / 65535;
-    cwrgb[3] = color_8to16(rgb >> 8) * lightness / 65535;
-    cwrgb[4] = color_8to16(rgb) * lightness / 65535;
+    cwrgb[2] = (uint32_t)rgb[0] * luminance / 65535;
+    cwrgb[3] = (uint32_t)rgb[1] * luminance / 65535;
+    cwrgb[4] = (uint32_t)rgb[2] * luminance / 65535;
     light_set_cwrgb(cwrgb);
 }
 
@@ -681,195 +781,233 @@ void light_hsl_lightness_set(uint16_t lightness)
 
 }
 
-void light_lighten(light_channel_t channel, uint16_t state)
+
+
+void light_status_init(void)
 {
-    if (channel > LED_B)
+    light_cwrgb_init();
+    LED_default_ctrl_param_set(DEFAULT_PWM_MOVE_STEP, MIN_MOVE_STEP_NUM);
+}
+
+void light_factory_reset(void)
+{
+    light_mode_set(LIGHT_MODE_CTL);
+    light_lightness_set(0x8000);
+
+}
+void light_state_recover(void)
+{
+    light_state_set(0);
+    light_lightness_set(light_lightness);
+
+}
+
+
+uint16_t quick_onoff_count = 0;
+
+/// Light state image last written to or read from flash
+static flash_light_state_t light_state_committed;
+/// Light state image seen when the settle timer was last armed
+static flash_light_state_t light_state_pending;
+/// Light state differs from flash and waits for the settle timer
+static uint8_t light_state_dirty;
+/// Number of settle periods elapsed with the light state still changing
+static uint8_t light_state_settle_cnt;
+static mesh_tb_timer_t light_state_settle_timer;
+/// Number of light state commits to flash
+uint32_t light_state_nv_put_cnt;
+
+/// Light state groups, each one is stored in its own NVDS tag
+enum light_state_grp
+{
+    /// Lightness and light mode (NVDS_TAG_LIGHT_STATE)
+    LIGHT_STATE_GRP_LIGHTNESS   = 0x01,
+    /// CTL temperature and delta UV (NVDS_TAG_LIGHT_CTL)
+    LIGHT_STATE_GRP_CTL         = 0x02,
+    /// HSL hue, saturation and lightness (NVDS_TAG_LIGHT_HSL)
+    LIGHT_STATE_GRP_HSL         = 0x04,
+};
+/// Groups present in flash in their own tag
+static uint8_t light_state_stored;
+
+static void light_state_image_get(flash_light_state_t *state)
+{
+    memset(state, 0, sizeof(flash_light_state_t));
+
+    state->light_lightness = light_lightness;
+    state->ctl_temperature = ctl_temperature;
+    state->ctl_delta_uv = ctl_delta_uv;
+
+    state->hsl_hue = hsl_hue;
+    state->hsl_saturation = hsl_saturation;
+    state->hsl_lightness = hsl_lightness;
+
+    state->light_mode = light_mode_get();
+}
+
+static uint32_t light_state_commit(flash_light_state_t *state)
+{
+    flash_light_state_t *old = &light_state_committed;
+    uint16_t val[3];
+    uint32_t ret = 0;
+    uint8_t grp = 0;
+
+    light_state_dirty = 0;
+    light_state_settle_cnt = 0;
+
+    // Only changed groups are written, as one transaction of the log NVDS. Lightness goes
+    // last: until it is written in its own format, a single record left by an earlier
+    // version is still used at restore
+    nvds_txn_begin();
+
+    if (!(light_state_stored & LIGHT_STATE_GRP_HSL)
+            || (state->hsl_hue != old->hsl_hue)
+            || (state->hsl_saturation != old->hsl_saturation)
+            || (state->hsl_lightness != old->hsl_lightness))
     {
-        return;
+        val[0] = state->hsl_hue;
+        val[1] = state->hsl_saturation;
+        val[2] = state->hsl_lightness;
+        ret |= nvds_txn_put(NVDS_TAG_LIGHT_HSL, sizeof(uint16_t) * 3, (uint8_t*)val);
+        grp |= LIGHT_STATE_GRP_HSL;
     }
-    uint32_t high_count;
-    if (state == 0xffff)
+
+    if (!(light_state_stored & LIGHT_STATE_GRP_CTL)
+            || (state->ctl_temperature != old->ctl_temperature)
+            || (state->ctl_delta_uv != old->ctl_delta_uv))
     {
-        high_count = LED_PWM_COUNT;
+        val[0] = state->ctl_temperature;
+        val[1] = state->ctl_delta_uv;
+        ret |= nvds_txn_put(NVDS_TAG_LIGHT_CTL, sizeof(uint16_t) * 2, (uint8_t*)val);
+        grp |= LIGHT_STATE_GRP_CTL;
     }
-    else
+
+    if (!(light_state_stored & LIGHT_STATE_GRP_LIGHTNESS)
+            || (state->light_lightness != old->light_lightness)
+            || (state->light_mode != old->light_mode))
     {
-        high_count = (LED_PWM_COUNT / 65535.0) * state;
+        val[0] = state->light_lightness;
+        val[1] = state->light_mode;
+        ret |= nvds_txn_put(NVDS_TAG_LIGHT_STATE, sizeof(uint16_t) * 2, (uint8_t*)val);
+        grp |= LIGHT_STATE_GRP_LIGHTNESS;
     }
 
-    switch (channel)
+    if (ret == 0)
     {
-        case LED_C:
-        {
-            pwm2.duty_cycle = high_count;//PWM_DUTY_INIT;
-            pwm_duty_cycle(&pwm2);
-
-        } break;
-        case LED_W:
-        {
-            pwm1.duty_cycle = high_count;//PWM_DUTY_INIT;
-            pwm_duty_cycle(&pwm1);
+        ret = nvds_txn_commit();
+    }
+    else
+    {
+        nvds_txn_abort();
+    }
 
-        } break;
-        case LED_R:
-        {
-            pwm4.duty_cycle = high_count;//PWM_DUTY_INIT;
-            pwm_duty_cycle(&pwm4);
+    light_state_nv_put_cnt++;
 
-        } break;
-        case LED_G:
-        {
-            pwm5.duty_cycle = high_count;//PWM_DUTY_INIT;
-            pwm_duty_cycle(&pwm5);
-        } break;
-        case LED_B:
-        {
-            pwm3.duty_cycle = high_count;//PWM_DUTY_INIT;
-            pwm_duty_cycle(&pwm3);
-        } break;
-
-        default:
-            break;
+    // Groups which could not be written are written again at next commit
+    if (ret == 0)
+    {
+        light_state_stored |= grp;
+    }
+    else
+    {
+        light_state_stored &= ~grp;
     }
-}
 
-uint32_t pwm_move_step;
-uint32_t min_move_step_num;
-//uint32_t led_trans_time = 1000; //1000ms  MAY BE VARIABLE IN THE FUTURE
+    light_state_committed = *state;
 
-void LED_default_ctrl_param_set(uint32_t pwm_move_step_param, uint32_t min_move_step_num_param)
-{
-    pwm_move_step = pwm_move_step_param;
-    min_move_step_num = min_move_step_num_param;
+    return ret;
 }
 
-void light_periodic_ctrl(void)
+static uint32_t light_state_nv_read(flash_light_state_t *state)
 {
-    static uint16_t LED_pwm_current[5] = {0, 0, 0, 0, 0};
-    static uint16_t LED_pwm_move_step[5] = {0, 0, 0, 0, 0};
-    //  uint8_t ledId;
+    flash_light_state_t rec;
+    uint16_t val[3];
+    nvds_tag_len_t len = sizeof(rec);
 
-    light_channel_t ledId;
+    memset(state, 0, sizeof(flash_light_state_t));
+    light_state_stored = 0;
 
-    switch (led_timer_status)
+    if (nvds_get(NVDS_TAG_LIGHT_STATE, &len, (uint8_t*)&rec) != NVDS_OK)
     {
-        case LIGHT_FREE:
+        return 1;
+    }
+
+    if (len == sizeof(flash_light_state_t))
+    {
+        // Single record of an earlier version, all groups are written at next change
+        *state = rec;
+        state->write_mark = 0;
+    }
+    else
+    {
+        memcpy(val, &rec, sizeof(uint16_t) * 2);
+        state->light_lightness = val[0];
+        state->light_mode = val[1];
+        state->ctl_temperature = 800;
+        light_state_stored = LIGHT_STATE_GRP_LIGHTNESS;
+
+        len = sizeof(uint16_t) * 2;
+        if (nvds_get(NVDS_TAG_LIGHT_CTL, &len, (uint8_t*)val) == NVDS_OK)
         {
-            return;
+            state->ctl_temperature = val[0];
+            state->ctl_delta_uv = val[1];
+            light_state_stored |= LIGHT_STATE_GRP_CTL;
         }
-        case LIGHT_START: //calc move step
-        {
-            uint32_t stepNum;
 
-            for (ledId = LED_C; ledId<LED_NUM; ledId++)
-            {
-                if (LED_pwm_current[ledId] == light_cwrgb[ledId])
-                {
-                    LED_pwm_move_step[ledId] = 0;
-                    continue;
-                }
-                else if (LED_pwm_current[ledId] > light_cwrgb[ledId])
-                {
-                    stepNum = (LED_pwm_current[ledId] - light_cwrgb[ledId])/pwm_move_step;
-                    if (stepNum >= min_move_step_num)
-                    {
-                        LED_pwm_move_step[ledId] = pwm_move_step;
-                    }
-                    else
-                    {
-                        LED_pwm_move_step[ledId] = (LED_pwm_current[ledId] - light_cwrgb[ledId])/min_move_step_num;
-                    }
-                }
-                else
-                {
-                    stepNum = (light_cwrgb[ledId] -LED_pwm_current[ledId])/pwm_move_step;
-                    if (stepNum >= min_move_step_num)
-                    {
-                        LED_pwm_move_step[ledId] = pwm_move_step;
-                    }
-                    else
-                    {
-                        LED_pwm_move_step[ledId] = (light_cwrgb[ledId] - LED_pwm_current[ledId])/min_move_step_num;
-                    }
-                }
-            }
-            led_timer_status = LIGHT_BUSY;
-        }
-        case LIGHT_BUSY:  //change LED
+        len = sizeof(uint16_t) * 3;
+        if (nvds_get(NVDS_TAG_LIGHT_HSL, &len, (uint8_t*)val) == NVDS_OK)
         {
-            static uint32_t testCount = 0;
-            uint8_t equalCount = 0;
-            testCount++;
-            for (ledId = LED_C; ledId<LED_NUM; ledId++)
-            {
-                if (LED_pwm_current[ledId] == light_cwrgb[ledId])
-                {
-                    equalCount++;
-                    continue;
-                }
-                else if (LED_pwm_current[ledId] > light_cwrgb[ledId])
-                {
-                    if (((LED_pwm_current[ledId] - light_cwrgb[ledId]) < LED_pwm_move_step[ledId]) ||
-                            (LED_pwm_move_step[ledId] == 0))
-                    {
-                        LED_pwm_current[ledId] = light_cwrgb[ledId];
-                    }
-                    else
-                    {
-                        LED_pwm_current[ledId] -= LED_pwm_move_step[ledId];
-                    }
-                    light_lighten(ledId, LED_pwm_current[ledId]);
-                }
-                else
-                {
-                    if (((light_cwrgb[ledId] - LED_pwm_current[ledId]) < LED_pwm_move_step[ledId]) ||
-                            (LED_pwm_move_step[ledId] == 0))
-                    {
-                        LED_pwm_current[ledId] = light_cwrgb[ledId];
-                    }
-                    else
-                    {
-                        LED_pwm_current[ledId] += LED_pwm_move_step[ledId];
-                    }
-                    light_lighten(ledId, LED_pwm_current[ledId]);
-                }
-            }
-
-            if (equalCount == 5)
-            {
-                led_timer_status = LIGHT_FREE;
-            }
-            break;
+            state->hsl_hue = val[0];
+            state->hsl_saturation = val[1];
+            state->hsl_lightness = val[2];
+            light_state_stored |= LIGHT_STATE_GRP_HSL;
         }
+    }
 
+    // Reference for change detection
+    light_state_committed = *state;
 
-        default:
-            MESH_APP_PRINT_INFO("light status error**%d*\r\n", led_timer_status);
-            break;
-    }
+    return 0;
 }
 
-void light_status_init(void)
+static void light_state_settle_timer_cb(void *timer)
 {
-    light_cwrgb_init();
-    LED_default_ctrl_param_set(DEFAULT_PWM_MOVE_STEP, MIN_MOVE_STEP_NUM);
-}
+    flash_light_state_t state;
 
-void light_factory_reset(void)
-{
-    light_mode_set(LIGHT_MODE_CTL);
-    light_lightness_set(0x8000);
+    light_state_image_get(&state);
 
-}
-void light_state_recover(void)
-{
-    light_state_set(0);
-    light_lightness_set(light_lightness);
+    // Still changing (dimmer drag, transition): wait for it to settle, within a limit
+    if ((memcmp(&state, &light_state_pending, sizeof(flash_light_state_t)) != 0)
+            && (++light_state_settle_cnt < LIGHT_STATE_SETTLE_MAX))
+    {
+        light_state_pending = state;
+        mesh_tb_timer_set(&light_state_settle_timer, LIGHT_STATE_SETTLE_TIME);
+        return;
+    }
 
+    if (memcmp(&state, &light_state_committed, sizeof(flash_light_state_t)) != 0)
+    {
+        light_state_commit(&state);
+    }
+    else
+    {
+        // Back to the stored value
+        light_state_dirty = 0;
+        light_state_settle_cnt = 0;
+    }
 }
 
+void light_state_nv_flush(void)
+{
+    flash_light_state_t state;
 
-uint16_t quick_onoff_count = 0;
+    if (light_state_dirty)
+    {
+        mesh_tb_timer_clear(&light_state_settle_timer);
+        light_state_image_get(&state);
+        light_state_commit(&state);
+    }
+}
 uint32_t light_app_nv_restore(flash_light_param_type_t type)
 {
     uint32_t ret;
@@ -890,8 +1028,7 @@ uint32_t light_app_nv_restore(flash_light_param_type_t type)
         {
             flash_light_state_t flash_light_state;
 
-            len = sizeof(flash_light_state);
-            ret = nvds_get(NVDS_TAG_LIGHT_STATE, &len, (uint8_t*)&flash_light_state);
+            ret = light_state_nv_read(&flash_light_state);
 
             if (ret == 0)
             {
@@ -955,20 +1092,20 @@ uint32_t light_state_nv_store(flash_light_param_type_t type)
         case FLASH_LIGHT_PARAM_TYPE_LIGHT_STATE:
         {
             flash_light_state_t flash_light_state;
-            len = sizeof(flash_light_state_t);
 
-            flash_light_state.light_lightness = light_lightness;
-            flash_light_state.ctl_temperature = ctl_temperature;
-            flash_light_state.ctl_delta_uv =ctl_delta_uv;
+            // Only changes are written, once the light state has settled
+            light_state_image_get(&flash_light_state);
+            ret = 0;
 
-            flash_light_state.hsl_hue = hsl_hue;
-            flash_light_state.hsl_saturation = hsl_saturation;
-            flash_light_state.hsl_lightness = hsl_lightness;
-
-            flash_light_state.light_mode = light_mode_get();
-
-
-            ret = nvds_put(NVDS_TAG_LIGHT_STATE, len, (uint8_t*)&flash_light_state);
+            if (!light_state_dirty
+                    && (memcmp(&flash_light_state, &light_state_committed, sizeof(flash_light_state_t)) != 0))
+            {
+                light_state_dirty = 1;
+                light_state_settle_cnt = 0;
+                light_state_pending = flash_light_state;
+                light_state_settle_timer.cb = light_state_settle_timer_cb;
+                mesh_tb_timer_set(&light_state_settle_timer, LIGHT_STATE_SETTLE_TIME);
+            }
 
         }
         break;
@@ -45,6 +45,8 @@
 #include "m_bcn.h"
 #include "m_prov_int.h"     // Mesh Provisioning Internal Defines
 #include "led.h"
+#include "light_trans.h"
+#include "app_light_upd.h"
 #include "wdt.h"
 #include "app_light_server.h"
 #include "m_tb_state.h"
@@ -61,8 +63,6 @@ extern uint16_t hsl_lightness;
 extern uint16_t hsl_hue;
 extern uint16_t hsl_saturation;
 
-void app_light_param_set_handle(uint32_t state, uint32_t trans_time_ms, uint16_t state_id, uint8_t elmt_idx);
-
 int app_models_msg_pro_handler(ke_msg_id_t const msgid,
                                void const *param,
                                ke_task_id_t const dest_id,
@@ -81,7 +81,7 @@ int app_models_msg_pro_handler(ke_msg_id_t const msgid,
                 //MESH_APP_PRINT_INFO("ind_code:0x%04x = MM_API_SRV_STATE_UPD_IND,state = %d,trans_time_ms = %d,state_id = %d,elmt_idx = 0x%x\r\n",
                 //                    ind->ind_code,ind->state,ind->trans_time_ms,ind->state_id,ind->elmt_idx);
 
-                app_light_param_set_handle(ind->state, ind->trans_time_ms, ind->state_id, ind->elmt_idx);
+                app_light_upd_push(ind);
             }
             if (ind->ind_code == MM_API_SRV_ARRAY_STATE_UPD_IND)
             {
@@ -133,6 +133,9 @@ int app_models_msg_pro_handler(ke_msg_id_t const msgid,
 
 void app_light_param_set_handle(uint32_t state, uint32_t trans_time_ms, uint16_t state_id, uint8_t elmt_idx)
 {
+    // The light moves over the model transition time
+    light_transition_set(trans_time_ms, LIGHT_CURVE_LINEAR);
+
     if (trans_time_ms)
     {
         switch (state_id)
@@ -231,5 +234,7 @@ void app_light_param_set_handle(uint32_t state, uint32_t trans_time_ms, uint16_t
         }
     }
 
+    // A set that did not start a transition must not hand its time to the next one
+    light_transition_set(0, LIGHT_CURVE_LINEAR);
 }
 
@@ -88,6 +88,8 @@ extern PWM_DRV_DESC pwm6;   //for 2ms timer
 #define LIGHT_POWER_ON_COUNT                            5 //!< close the light LIGHT_POWER_ON_COUNT times to reset
 #define LIGHT_POWER_ON_TIME                             20000 //!< millisecond
 #define LIGHT_PROV_FLASH_INTERVAL                   500 //!< millisecond
+#define LIGHT_STATE_SETTLE_TIME                         2000 //!< millisecond without change before the light state is written
+#define LIGHT_STATE_SETTLE_MAX                          5 //!< settle periods after which a still changing light state is written
 
 
 #define LIGHT_GRA_TIME                                  200//!< millisecond
@@ -285,6 +287,7 @@ void LED_default_ctrl_param_set(uint32_t pwm_move_step_param, uint32_t min_move_
 
 uint32_t light_state_nv_store(flash_light_param_type_t type);
 uint32_t light_app_nv_restore(flash_light_param_type_t type);
+void light_state_nv_flush(void);
 void light_factory_reset(void);
 
 void light_state_recover(void);
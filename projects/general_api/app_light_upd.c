@@ -0,0 +1,108 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_light_upd.c
+ *
+ * @brief Light state updates of the light projects, applied together
+ *
+ * Copyright (C) Beken 2009-2020
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include "app_light_upd.h"
+#include "mesh_tb_timer.h"
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// State update received from a light server model, waiting to be applied
+typedef struct
+{
+    uint32_t state;
+    /// Transition time of this state, the states of one update keep their own
+    uint32_t trans_time_ms;
+    uint16_t state_id;
+    uint8_t  elmt_idx;
+} app_light_upd_t;
+
+/*
+ * LOCAL VARIABLES
+ ****************************************************************************************
+ */
+static app_light_upd_t app_light_upd[APP_LIGHT_UPD_NB];
+static uint8_t app_light_upd_nb;
+static mesh_tb_timer_t app_light_upd_timer;
+
+/*
+ * FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+static void app_light_upd_flush(void *p_env)
+{
+    uint8_t nb = app_light_upd_nb;
+    uint8_t i;
+
+    app_light_upd_nb = 0;
+    mesh_tb_timer_clear(&app_light_upd_timer);
+
+    // In the order received: the states sharing a transition time move on one
+    // transition, a state with another time retargets the light over that time
+    for (i = 0; i < nb; i++)
+    {
+        app_light_param_set_handle(app_light_upd[i].state, app_light_upd[i].trans_time_ms,
+                                   app_light_upd[i].state_id, app_light_upd[i].elmt_idx);
+    }
+}
+
+void app_light_upd_push(mm_api_srv_state_upd_ind_t const *ind)
+{
+    uint8_t i;
+
+    // A later update of the same state replaces the pending one
+    for (i = 0; i < app_light_upd_nb; i++)
+    {
+        if ((app_light_upd[i].state_id == ind->state_id) && (app_light_upd[i].elmt_idx == ind->elmt_idx))
+        {
+            break;
+        }
+    }
+
+    if (i == APP_LIGHT_UPD_NB)
+    {
+        app_light_upd_flush(NULL);
+        i = 0;
+    }
+
+    app_light_upd[i].state = ind->state;
+    app_light_upd[i].trans_time_ms = ind->trans_time_ms;
+    app_light_upd[i].state_id = ind->state_id;
+    app_light_upd[i].elmt_idx = ind->elmt_idx;
+
+    if (i == app_light_upd_nb)
+    {
+        app_light_upd_nb++;
+    }
+
+    // Applied once the indications already queued have been received
+    if (app_light_upd_nb == 1)
+    {
+        app_light_upd_timer.cb = app_light_upd_flush;
+        mesh_tb_timer_set(&app_light_upd_timer, 0);
+    }
+}
+
+/// @} APP
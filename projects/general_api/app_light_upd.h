@@ -0,0 +1,60 @@
+/**
+ ****************************************************************************************
+ *
+ * @file app_light_upd.h
+ *
+ * @brief Light state updates of the light projects, applied together
+ *
+ * Copyright (C) Beken 2009-2020
+ *
+ *
+ ****************************************************************************************
+ */
+
+#ifndef APP_LIGHT_UPD_H_
+#define APP_LIGHT_UPD_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup BEKEN
+ *
+ * @brief Light state updates
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <stdint.h>          // Standard Integer Definition
+#include "mesh_api_msg.h"    // mm_api_srv_state_upd_ind_t
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Maximum number of state updates applied together
+#define APP_LIGHT_UPD_NB    8
+
+/*
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+/**
+ * Queue a state update of a light server model. The bound model groups of an element
+ * (Lightness, CTL, HSL) report one set separately; the updates received together are
+ * applied at once from the next timer callback, each over its own transition time.
+ */
+void app_light_upd_push(mm_api_srv_state_upd_ind_t const *ind);
+
+/**
+ * Apply one state update to the light, defined by each light project (app_mm_msg.c).
+ */
+void app_light_param_set_handle(uint32_t state, uint32_t trans_time_ms, uint16_t state_id, uint8_t elmt_idx);
+
+/// @} APP
+
+#endif // APP_LIGHT_UPD_H_
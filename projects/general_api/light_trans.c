@@ -0,0 +1,467 @@
+/**
+ ****************************************************************************************
+ *
+ * @file light_trans.c
+ *
+ * @brief Light transition engine and PWM output stage of the light projects
+ *
+ * Copyright (C) Beken 2009-2020
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <string.h>
+#include "light_trans.h"
+#include "pwm.h"
+#include "ll.h"                      // GLOBAL_INT_DISABLE
+#include "mesh_log.h"
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+/*
+ * LOCAL VARIABLES
+ ****************************************************************************************
+ */
+/// Calibration of each channel, 65535 for full scale, see light_channel_scale_set
+static uint16_t pwm_duty_scale[LED_NUM] = {65535, 65535, 65535, 65535, 65535};
+
+/// State of the transition, LIGHT_FREE, LIGHT_START or LIGHT_BUSY
+static uint8_t led_timer_status = LIGHT_FREE;
+
+/// Transition of the channels towards the values of light_trans_start, run from pwm6_irq_done
+typedef struct
+{
+    /// Channel values at the start, at the end, and last output
+    uint16_t start[LED_NUM];
+    uint16_t end[LED_NUM];
+    uint16_t cur[LED_NUM];
+    /// Start time and duration in ms
+    uint32_t start_ms;
+    uint32_t duration_ms;
+    /// Interval between two updates of the PWM, and time of the next one
+    uint32_t update_ms;
+    uint32_t next_ms;
+    /// Curve, LIGHT_CURVE_LINEAR or LIGHT_CURVE_EASE_IN_OUT
+    uint8_t curve;
+} light_trans_t;
+
+static light_trans_t light_trans;
+/// Time counted by the PWM timer interrupt, in ms
+static uint32_t light_time_ms;
+/// Duration and curve of the transition started by the next light_trans_start
+static uint32_t light_trans_ms_next;
+static uint8_t light_trans_curve_next = LIGHT_CURVE_LINEAR;
+
+static void light_periodic_ctrl(void);
+static void light_duty_latch(void);
+
+/*
+ * FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+void pwm6_irq_done(void)
+{
+    // Staged duties first, at a fixed point of the timer period
+    light_duty_latch();
+    pwm_isr();
+    light_periodic_ctrl();
+}
+
+#if (LIGHT_GAMMA_CIE)
+/// CIE 1931 lightness to luminance, L* = 100 * i / 256, generated offline:
+/// Y = ((L* + 16) / 116)^3 above L* = 8, Y = L* / 903.3 below, scaled to 65535
+static const uint16_t light_gamma_lut[LIGHT_GAMMA_LUT_NB + 1] =
+{
+    0x0000, 0x001c, 0x0039, 0x0055, 0x0071, 0x008e, 0x00aa, 0x00c6,
+    0x00e3, 0x00ff, 0x011b, 0x0138, 0x0154, 0x0170, 0x018d, 0x01a9,
+    0x01c5, 0x01e2, 0x01fe, 0x021a, 0x0237, 0x0253, 0x0271, 0x028f,
+    0x02ae, 0x02ce, 0x02ef, 0x0311, 0x0335, 0x0359, 0x037e, 0x03a5,
+    0x03cc, 0x03f4, 0x041e, 0x0449, 0x0475, 0x04a2, 0x04d0, 0x04ff,
+    0x0530, 0x0562, 0x0595, 0x05c9, 0x05ff, 0x0636, 0x066e, 0x06a7,
+    0x06e2, 0x071e, 0x075b, 0x079a, 0x07da, 0x081c, 0x085f, 0x08a3,
+    0x08e9, 0x0930, 0x0979, 0x09c4, 0x0a0f, 0x0a5d, 0x0aab, 0x0afc,
+    0x0b4e, 0x0ba1, 0x0bf6, 0x0c4d, 0x0ca5, 0x0cff, 0x0d5b, 0x0db8,
+    0x0e17, 0x0e78, 0x0eda, 0x0f3e, 0x0fa4, 0x100c, 0x1075, 0x10e0,
+    0x114d, 0x11bc, 0x122c, 0x129f, 0x1313, 0x1389, 0x1401, 0x147b,
+    0x14f7, 0x1575, 0x15f5, 0x1677, 0x16fa, 0x1780, 0x1808, 0x1891,
+    0x191d, 0x19ab, 0x1a3b, 0x1acd, 0x1b61, 0x1bf7, 0x1c90, 0x1d2a,
+    0x1dc7, 0x1e66, 0x1f07, 0x1faa, 0x2050, 0x20f7, 0x21a1, 0x224d,
+    0x22fc, 0x23ad, 0x2460, 0x2515, 0x25cd, 0x2687, 0x2744, 0x2803,
+    0x28c4, 0x2988, 0x2a4e, 0x2b16, 0x2be2, 0x2caf, 0x2d7f, 0x2e52,
+    0x2f27, 0x2ffe, 0x30d8, 0x31b5, 0x3294, 0x3376, 0x345b, 0x3542,
+    0x362c, 0x3718, 0x3807, 0x38f9, 0x39ee, 0x3ae5, 0x3bdf, 0x3cdb,
+    0x3ddb, 0x3edd, 0x3fe2, 0x40ea, 0x41f5, 0x4302, 0x4412, 0x4526,
+    0x463c, 0x4755, 0x4871, 0x498f, 0x4ab1, 0x4bd6, 0x4cfe, 0x4e28,
+    0x4f56, 0x5087, 0x51ba, 0x52f1, 0x542b, 0x5568, 0x56a8, 0x57eb,
+    0x5931, 0x5a7b, 0x5bc7, 0x5d17, 0x5e6a, 0x5fc0, 0x6119, 0x6276,
+    0x63d6, 0x6539, 0x669f, 0x6808, 0x6975, 0x6ae6, 0x6c59, 0x6dd0,
+    0x6f4a, 0x70c8, 0x7249, 0x73cd, 0x7555, 0x76e0, 0x786f, 0x7a01,
+    0x7b97, 0x7d30, 0x7ecd, 0x806d, 0x8211, 0x83b8, 0x8563, 0x8712,
+    0x88c4, 0x8a7a, 0x8c33, 0x8df0, 0x8fb1, 0x9175, 0x933d, 0x9509,
+    0x96d8, 0x98ab, 0x9a82, 0x9c5d, 0x9e3b, 0xa01e, 0xa204, 0xa3ee,
+    0xa5dc, 0xa7cd, 0xa9c3, 0xabbc, 0xadb9, 0xafbb, 0xb1c0, 0xb3c9,
+    0xb5d6, 0xb7e7, 0xb9fc, 0xbc15, 0xbe32, 0xc053, 0xc279, 0xc4a2,
+    0xc6cf, 0xc901, 0xcb36, 0xcd70, 0xcfae, 0xd1f0, 0xd436, 0xd680,
+    0xd8cf, 0xdb21, 0xdd78, 0xdfd4, 0xe233, 0xe497, 0xe6ff, 0xe96b,
+    0xebdc, 0xee51, 0xf0ca, 0xf348, 0xf5ca, 0xf851, 0xfadc, 0xfd6b,
+    0xffff
+};
+#endif // (LIGHT_GAMMA_CIE)
+
+uint32_t light_luminance(uint16_t lightness)
+{
+#if (LIGHT_GAMMA_CIE)
+    if (lightness != 0xffff)
+    {
+        // 256 segments, linear within a segment
+        uint16_t idx = lightness >> 8;
+        uint32_t frac = lightness & 0xFF;
+
+        return light_gamma_lut[idx] + (((light_gamma_lut[idx + 1] - light_gamma_lut[idx]) * frac) >> 8);
+    }
+#endif // (LIGHT_GAMMA_CIE)
+
+    return lightness;
+}
+
+void light_channel_scale_set(light_channel_t channel, uint16_t scale)
+{
+    if (channel < LED_NUM)
+    {
+        pwm_duty_scale[channel] = scale;
+    }
+}
+
+/// PWM of each channel, in light_channel_t order
+static PWM_DRV_DESC *const light_pwm[LED_NUM] = {&pwm2, &pwm1, &pwm4, &pwm5, &pwm3};
+/// Duties staged by light_apply_cwrgb, written together by pwm6_irq_done
+static uint16_t light_duty_shadow[LED_NUM];
+static volatile uint8_t light_duty_pending;
+
+/// PWM high count of a channel value (linear luminance)
+static uint32_t light_duty_get(light_channel_t channel, uint16_t state)
+{
+    uint32_t level = state;
+
+    level = level * pwm_duty_scale[channel] / 65535;
+
+    return level * LED_PWM_COUNT / 65535;
+}
+
+void light_lighten(light_channel_t channel, uint16_t state)
+{
+    if (channel > LED_B)
+    {
+        return;
+    }
+
+    light_pwm[channel]->duty_cycle = light_duty_get(channel, state);
+    pwm_duty_cycle(light_pwm[channel]);
+}
+
+void light_apply_cwrgb(const uint16_t cwrgb[5])
+{
+    uint16_t duty[LED_NUM];
+    light_channel_t channel;
+
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        duty[channel] = light_duty_get(channel, cwrgb[channel]);
+    }
+
+    GLOBAL_INT_DISABLE();
+    memcpy(light_duty_shadow, duty, sizeof(light_duty_shadow));
+    light_duty_pending = 1;
+    GLOBAL_INT_RESTORE();
+}
+
+/// Write the staged duties back to back, they take effect in the same PWM period
+static void light_duty_latch(void)
+{
+    light_channel_t channel;
+
+    if (!light_duty_pending)
+    {
+        return;
+    }
+
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        light_pwm[channel]->duty_cycle = light_duty_shadow[channel];
+        pwm_duty_cycle(light_pwm[channel]);
+    }
+    light_duty_pending = 0;
+}
+
+#if (LIGHT_TRACE)
+static light_trace_stats_t light_trace_stats;
+/// Ring of the duty samples, light_trace_idx is the next written
+static light_trace_sample_t light_trace_buf[LIGHT_TRACE_NB];
+static uint8_t light_trace_idx;
+static uint8_t light_trace_nb;
+
+/// Start measuring a transition
+static void light_trace_start(uint32_t duration_ms)
+{
+    memset(&light_trace_stats, 0, sizeof(light_trace_stats));
+    light_trace_stats.duration_ms = duration_ms;
+    light_trace_idx = 0;
+    light_trace_nb = 0;
+}
+
+/// Keep the duties just staged by light_apply_cwrgb
+static void light_trace_record(uint32_t elapsed)
+{
+    light_trace_sample_t *sample = &light_trace_buf[light_trace_idx];
+    light_channel_t channel;
+
+    sample->time_ms = elapsed;
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        sample->duty[channel] = light_duty_shadow[channel];
+    }
+
+    light_trace_idx = (light_trace_idx + 1) % LIGHT_TRACE_NB;
+    if (light_trace_nb < LIGHT_TRACE_NB)
+    {
+        light_trace_nb++;
+    }
+    light_trace_stats.updates++;
+}
+
+uint8_t light_trace_get(light_trace_stats_t *stats, light_trace_sample_t *samples)
+{
+    uint8_t nb, first, i;
+
+    GLOBAL_INT_DISABLE();
+    *stats = light_trace_stats;
+    nb = (samples != NULL) ? light_trace_nb : 0;
+    first = (light_trace_idx + LIGHT_TRACE_NB - light_trace_nb) % LIGHT_TRACE_NB;
+    for (i = 0; i < nb; i++)
+    {
+        samples[i] = light_trace_buf[(first + i) % LIGHT_TRACE_NB];
+    }
+    GLOBAL_INT_RESTORE();
+
+    return nb;
+}
+#endif // (LIGHT_TRACE)
+
+/// Default ramp of a transition with no duration, see LED_default_ctrl_param_set
+static uint32_t pwm_move_step;
+static uint32_t min_move_step_num;
+
+void LED_default_ctrl_param_set(uint32_t pwm_move_step_param, uint32_t min_move_step_num_param)
+{
+    pwm_move_step = pwm_move_step_param;
+    min_move_step_num = min_move_step_num_param;
+}
+
+void light_transition_set(uint32_t duration_ms, uint8_t curve)
+{
+    light_trans_ms_next = duration_ms;
+    light_trans_curve_next = curve;
+}
+
+void light_trans_start(const uint16_t cwrgb[LED_NUM])
+{
+    light_channel_t channel;
+
+    // The transition restarts from the current output towards the new values
+    GLOBAL_INT_DISABLE();
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        light_trans.end[channel] = cwrgb[channel];
+    }
+    light_trans.duration_ms = light_trans_ms_next;
+    light_trans.curve = light_trans_curve_next;
+    light_trans_ms_next = 0;
+    light_trans_curve_next = LIGHT_CURVE_LINEAR;
+    led_timer_status = LIGHT_START;
+    GLOBAL_INT_RESTORE();
+}
+
+uint8_t light_trans_status_get(void)
+{
+    return led_timer_status;
+}
+
+/// Progress of the transition at elapsed ms, Q16, along its curve
+static uint32_t light_transition_progress(uint32_t elapsed)
+{
+    uint32_t duration = light_trans.duration_ms;
+    uint32_t p;
+    uint32_t p2;
+
+    if (elapsed >= duration)
+    {
+        return 0x10000;
+    }
+
+    // Keep elapsed << 16 in 32 bits
+    while (duration >= 0x10000)
+    {
+        duration >>= 1;
+        elapsed >>= 1;
+    }
+    p = (elapsed << 16) / duration;
+
+    if (light_trans.curve == LIGHT_CURVE_EASE_IN_OUT)
+    {
+        // 3p^2 - 2p^3
+        p2 = (p * p) >> 16;
+        p = 3 * p2 - ((p2 * p) >> 15);
+    }
+
+    return p;
+}
+
+static void light_periodic_ctrl(void)
+{
+    light_channel_t ledId;
+    uint32_t progress;
+    uint16_t value;
+    uint8_t changed;
+
+    light_time_ms += LIGHT_TICK_MS;
+
+    switch (led_timer_status)
+    {
+        case LIGHT_FREE:
+        {
+            return;
+        }
+        case LIGHT_START: // all the channels start from their current value together
+        {
+            uint32_t delta_max = 0;
+            uint32_t delta;
+
+            for (ledId = LED_C; ledId < LED_NUM; ledId++)
+            {
+                light_trans.start[ledId] = light_trans.cur[ledId];
+                delta = (light_trans.end[ledId] > light_trans.start[ledId]) ?
+                        (light_trans.end[ledId] - light_trans.start[ledId]) :
+                        (light_trans.start[ledId] - light_trans.end[ledId]);
+                delta_max = MAX(delta_max, delta);
+            }
+
+            if (light_trans.duration_ms == 0)
+            {
+                // No transition time: the default speed, pwm_move_step per tick, at least min_move_step_num ticks.
+                // Only a move longer than the minimum needs the division
+                uint32_t ticks = min_move_step_num;
+
+                if (delta_max > pwm_move_step * min_move_step_num)
+                {
+                    ticks = delta_max / pwm_move_step;
+                }
+                light_trans.duration_ms = ticks * LIGHT_TICK_MS;
+            }
+
+            light_trans.update_ms = LIGHT_TICK_MS;
+#if (LIGHT_TICK_ADAPT)
+            // Update once per LIGHT_UPDATE_STEP of the channel moving most, the ease curve moving up to 1.5 times faster
+            if (delta_max > LIGHT_UPDATE_STEP)
+            {
+                light_trans.update_ms = light_trans.duration_ms / (delta_max / LIGHT_UPDATE_STEP);
+                if (light_trans.curve == LIGHT_CURVE_EASE_IN_OUT)
+                {
+                    light_trans.update_ms = light_trans.update_ms * 2 / 3;
+                }
+                light_trans.update_ms = MAX(MIN(light_trans.update_ms, LIGHT_UPDATE_MAX_MS), LIGHT_TICK_MS);
+            }
+#endif // (LIGHT_TICK_ADAPT)
+
+            light_trans.start_ms = light_time_ms;
+            light_trans.next_ms = light_time_ms;
+            led_timer_status = LIGHT_BUSY;
+#if (LIGHT_TRACE)
+            light_trace_start(light_trans.duration_ms);
+#endif // (LIGHT_TRACE)
+        }
+        case LIGHT_BUSY:  // move every channel to the same point of the transition
+        {
+            uint32_t elapsed = light_time_ms - light_trans.start_ms;
+
+            if ((elapsed < light_trans.duration_ms) && ((int32_t)(light_time_ms - light_trans.next_ms) < 0))
+            {
+                break;
+            }
+            light_trans.next_ms += light_trans.update_ms;
+
+            progress = light_transition_progress(elapsed);
+            changed = 0;
+
+            for (ledId = LED_C; ledId < LED_NUM; ledId++)
+            {
+                if (light_trans.end[ledId] >= light_trans.start[ledId])
+                {
+                    value = light_trans.start[ledId]
+                            + (((uint32_t)(light_trans.end[ledId] - light_trans.start[ledId]) * progress) >> 16);
+                }
+                else
+                {
+                    value = light_trans.start[ledId]
+                            - (((uint32_t)(light_trans.start[ledId] - light_trans.end[ledId]) * progress) >> 16);
+                }
+
+                if (value != light_trans.cur[ledId])
+                {
+#if (LIGHT_TRACE)
+                    uint16_t step = (value > light_trans.cur[ledId]) ?
+                                    (value - light_trans.cur[ledId]) : (light_trans.cur[ledId] - value);
+
+                    light_trace_stats.max_step[ledId] = MAX(light_trace_stats.max_step[ledId], step);
+#endif // (LIGHT_TRACE)
+                    light_trans.cur[ledId] = value;
+                    changed = 1;
+                }
+            }
+
+            // The five outputs change together at the next tick
+            if (changed)
+            {
+                light_apply_cwrgb(light_trans.cur);
+#if (LIGHT_TRACE)
+                light_trace_record(elapsed);
+#endif // (LIGHT_TRACE)
+            }
+
+            // The ease curve rounds to the target a little early, the transition still lasts its duration
+            if (elapsed >= light_trans.duration_ms)
+            {
+                led_timer_status = LIGHT_FREE;
+#if (LIGHT_TRACE)
+                light_trace_stats.to_target_ms = elapsed;
+#endif // (LIGHT_TRACE)
+            }
+            break;
+        }
+
+
+        default:
+            MESH_APP_PRINT_INFO("light status error**%d*\r\n", led_timer_status);
+            break;
+    }
+}
+
+/// @} APP
@@ -0,0 +1,140 @@
+/**
+ ****************************************************************************************
+ *
+ * @file light_trans.h
+ *
+ * @brief Light transition engine and PWM output stage of the light projects
+ *
+ * The channels and their PWM are those of the project led.h, the engine runs from
+ * pwm6_irq_done every LIGHT_TICK_MS.
+ *
+ * Copyright (C) Beken 2009-2020
+ *
+ *
+ ****************************************************************************************
+ */
+
+#ifndef LIGHT_TRANS_H_
+#define LIGHT_TRANS_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @ingroup BEKEN
+ *
+ * @brief Light transition engine
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <stdint.h>    // standard integer definition
+#include "led.h"       // light_channel_t
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+#define LIGHT_TICK_MS           2 // period of pwm6_irq_done, TIMER_INTERVAL_VALUE
+// Lower the PWM update rate of slow transitions, updating once per LIGHT_UPDATE_STEP of change
+#ifndef LIGHT_TICK_ADAPT
+#define LIGHT_TICK_ADAPT        1
+#endif
+#define LIGHT_UPDATE_STEP       64
+#define LIGHT_UPDATE_MAX_MS     20 // 50Hz, still smooth to the eye
+
+/// Drive the lightness with CIE 1931: the lightness of light_set_ctl and light_set_hsl is
+/// perceived brightness, it is converted to luminance then scales the linear colour
+#ifndef LIGHT_GAMMA_CIE
+#define LIGHT_GAMMA_CIE                                 1
+#endif
+#define LIGHT_GAMMA_LUT_NB                              256 //!< segments of the lightness to luminance table
+
+/// Record the PWM duties of the last transition and measure its ramp, read
+/// with light_trace_get. light_trans_chk.c runs it on a host against the ideal ramps
+#ifndef LIGHT_TRACE
+#define LIGHT_TRACE                                     0
+#endif
+#define LIGHT_TRACE_NB                                  32 //!< duty samples kept, the latest of a longer transition
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+enum light_curve
+{
+    LIGHT_CURVE_LINEAR = 0,
+    LIGHT_CURVE_EASE_IN_OUT,
+};
+
+#if (LIGHT_TRACE)
+/// PWM duties staged by one update of a transition
+typedef struct
+{
+    /// Time since the start of the transition in ms
+    uint32_t time_ms;
+    /// PWM high count of each channel
+    uint16_t duty[LED_NUM];
+} light_trace_sample_t;
+
+/// Ramp of the last transition
+typedef struct
+{
+    /// Duration asked for
+    uint32_t duration_ms;
+    /// Time taken to reach the target, 0 while still moving
+    uint32_t to_target_ms;
+    /// Number of PWM updates
+    uint32_t updates;
+    /// Largest change of each channel value between two updates
+    uint16_t max_step[LED_NUM];
+} light_trace_stats_t;
+#endif // (LIGHT_TRACE)
+
+/*
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+/**
+ * Set the transition of the next light_trans_start. All the channels reach their
+ * values together after duration_ms, 0 uses the default ramp speed.
+ */
+void light_transition_set(uint32_t duration_ms, uint8_t curve);
+/**
+ * Start moving the five channels from their current output towards cwrgb, along the
+ * transition of light_transition_set. A running transition is retargeted.
+ */
+void light_trans_start(const uint16_t cwrgb[LED_NUM]);
+/// @return LIGHT_FREE, LIGHT_START or LIGHT_BUSY
+uint8_t light_trans_status_get(void);
+/**
+ * Stage the five channel values, the PWM duties are written together from the next
+ * pwm6_irq_done so that the outputs change in the same PWM period.
+ */
+void light_apply_cwrgb(const uint16_t cwrgb[5]);
+/**
+ * Scale the output of a channel, to match the LEDs of a fixture.
+ * @param scale 65535 for full scale, applied after the lightness correction
+ */
+void light_channel_scale_set(light_channel_t channel, uint16_t scale);
+/**
+ * Luminance of a lightness, both 16-bit, along the CIE curve when LIGHT_GAMMA_CIE is set.
+ * Only the lightness goes through the curve, the colour it scales stays linear.
+ */
+uint32_t light_luminance(uint16_t lightness);
+#if (LIGHT_TRACE)
+/**
+ * Get the ramp of the last transition and its duty samples, oldest first.
+ * @param samples filled with up to LIGHT_TRACE_NB samples, may be NULL
+ * @return number of samples written
+ */
+uint8_t light_trace_get(light_trace_stats_t *stats, light_trace_sample_t *samples);
+#endif // (LIGHT_TRACE)
+
+/// @} APP
+
+#endif // LIGHT_TRANS_H_
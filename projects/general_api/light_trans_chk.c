@@ -0,0 +1,278 @@
+/**
+ ****************************************************************************************
+ *
+ * @file light_trans_chk.c
+ *
+ * @brief Host comparison of the light transition engine with the ideal ramps (debug)
+ *
+ * Builds light_trans.c with LIGHT_TRACE, the PWM driver and the interrupt masking stubbed,
+ * runs transitions tick by tick and compares every PWM write with the duty of the ideal
+ * linear or ease-in-out curve at the same time. The trace read back by light_trace_get
+ * must match the writes. Not part of the projects, run it on a host from this directory:
+ *
+ *     gcc -O2 -I../ble_app_mesh_sdk_light/app -I../../sdk/plactform/src/driver/pwm
+ *         -I../../sdk/plactform/src/arch -I../../sdk/plactform/src/arch/ll
+ *         -I../../sdk/mesh_inc/inc light_trans_chk.c -lm
+ *     ./a.out
+ *
+ * Copyright (C) Beken 2009-2020
+ *
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup APP
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <stdio.h>
+#include <math.h>
+
+// Target headers of light_trans.c left out on the host
+#define LL_H_
+#define GLOBAL_INT_DISABLE()
+#define GLOBAL_INT_RESTORE()
+#define _MESH_LOG_H_
+#define MESH_APP_PRINT_INFO(format, ...)    printf(format, ##__VA_ARGS__)
+
+#define LIGHT_TRACE                         1
+#include "light_trans.c"
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// PWM writes kept per transition, one per channel and tick at most
+#define LIGHT_CHK_WRITE_NB                  (LED_NUM * 40000)
+/// Largest distance to the ideal duty, in PWM counts: the value and the duty are both
+/// truncated, and the ease curve is computed in Q16
+#define LIGHT_CHK_DUTY_TOL                  2.0
+/// Default ramp of the transitions without duration, as set by the Ali projects
+#define LIGHT_CHK_MOVE_STEP                 262
+#define LIGHT_CHK_MOVE_MIN                  200
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Transition run by the check
+typedef struct
+{
+    uint16_t start[LED_NUM];
+    uint16_t end[LED_NUM];
+    uint32_t duration_ms;
+    uint8_t curve;
+} light_chk_case_t;
+
+/// PWM write seen by the stubbed driver
+typedef struct
+{
+    /// Time since the start of the transition at which the duty was staged
+    uint32_t time_ms;
+    uint8_t channel;
+    uint16_t duty;
+} light_chk_write_t;
+
+/*
+ * LOCAL VARIABLES
+ ****************************************************************************************
+ */
+PWM_DRV_DESC pwm1;
+PWM_DRV_DESC pwm2;
+PWM_DRV_DESC pwm3;
+PWM_DRV_DESC pwm4;
+PWM_DRV_DESC pwm5;
+
+static const light_chk_case_t light_chk_cases[] =
+{
+    // Full range up and down, a small move, a channel left alone
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},    100, LIGHT_CURVE_LINEAR},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},    100, LIGHT_CURVE_EASE_IN_OUT},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},   1000, LIGHT_CURVE_LINEAR},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},   1000, LIGHT_CURVE_EASE_IN_OUT},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},  10000, LIGHT_CURVE_LINEAR},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},  10000, LIGHT_CURVE_EASE_IN_OUT},
+    // Above 65535 ms, the progress is computed on a shifted duration
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},  70000, LIGHT_CURVE_LINEAR},
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},  70000, LIGHT_CURVE_EASE_IN_OUT},
+    // Shorter than a tick
+    {{0, 0, 0, 0, 0},              {40000, 40000, 40000, 0, 0},       1, LIGHT_CURVE_LINEAR},
+    // Default ramp
+    {{0, 65535, 1000, 30000, 500}, {65535, 0, 1100, 20000, 500},      0, LIGHT_CURVE_LINEAR},
+    {{12000, 0, 0, 0, 0},          {12100, 0, 0, 0, 0},               0, LIGHT_CURVE_LINEAR},
+};
+
+static light_chk_write_t light_chk_write[LIGHT_CHK_WRITE_NB];
+static uint32_t light_chk_write_nb;
+/// Time at which the duties latched by the next tick were staged
+static uint32_t light_chk_staged_ms;
+
+/*
+ * FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+void pwm_duty_cycle(PWM_DRV_DESC *pwm_drv_desc)
+{
+    uint8_t channel;
+
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        if ((light_pwm[channel] == pwm_drv_desc) && (light_chk_write_nb < LIGHT_CHK_WRITE_NB))
+        {
+            light_chk_write[light_chk_write_nb].time_ms = light_chk_staged_ms;
+            light_chk_write[light_chk_write_nb].channel = channel;
+            light_chk_write[light_chk_write_nb].duty = pwm_drv_desc->duty_cycle;
+            light_chk_write_nb++;
+        }
+    }
+}
+
+void pwm_isr(void)
+{
+}
+
+/// Duty of the ideal ramp at time_ms
+static double light_chk_ideal(const light_chk_case_t *chk, uint32_t duration_ms, uint8_t channel,
+                              uint32_t time_ms)
+{
+    double p = (time_ms >= duration_ms) ? 1.0 : ((double)time_ms / duration_ms);
+    double value;
+
+    if (chk->curve == LIGHT_CURVE_EASE_IN_OUT)
+    {
+        p = p * p * (3.0 - 2.0 * p);
+    }
+
+    value = chk->start[channel] + ((double)chk->end[channel] - chk->start[channel]) * p;
+
+    return value * LED_PWM_COUNT / 65535.0;
+}
+
+/// Run one transition and compare it, return the number of errors
+static uint32_t light_chk_run(const light_chk_case_t *chk)
+{
+    light_trace_stats_t stats;
+    static light_trace_sample_t samples[LIGHT_TRACE_NB];
+    uint16_t last[LED_NUM];
+    double err_max = 0;
+    uint32_t nb_err = 0;
+    uint32_t ticks;
+    uint32_t i;
+    uint8_t nb;
+    uint8_t channel;
+
+    // Settle on the start values
+    memcpy(light_trans.cur, chk->start, sizeof(light_trans.cur));
+    led_timer_status = LIGHT_FREE;
+    light_apply_cwrgb(chk->start);
+    pwm6_irq_done();
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        last[channel] = light_duty_get((light_channel_t)channel, chk->start[channel]);
+    }
+
+    light_transition_set(chk->duration_ms, chk->curve);
+    light_trans_start(chk->end);
+    light_chk_write_nb = 0;
+
+    for (ticks = 0; (ticks < 100000) && (light_trans_status_get() != LIGHT_FREE); ticks++)
+    {
+        pwm6_irq_done();
+        light_chk_staged_ms = light_time_ms - light_trans.start_ms;
+    }
+    // Latch the last update
+    pwm6_irq_done();
+
+    if (light_trans_status_get() != LIGHT_FREE)
+    {
+        printf("  transition did not end\n");
+        return 1;
+    }
+
+    light_trace_get(&stats, NULL);
+
+    // Every write against the ideal ramp, moving towards the target only
+    for (i = 0; i < light_chk_write_nb; i++)
+    {
+        light_chk_write_t *write = &light_chk_write[i];
+        double err = fabs(write->duty - light_chk_ideal(chk, stats.duration_ms, write->channel,
+                                                       write->time_ms));
+        uint16_t end = light_duty_get((light_channel_t)write->channel, chk->end[write->channel]);
+
+        err_max = (err > err_max) ? err : err_max;
+        if ((err > LIGHT_CHK_DUTY_TOL)
+                || ((end >= last[write->channel]) ? (write->duty < last[write->channel])
+                    : (write->duty > last[write->channel])))
+        {
+            nb_err++;
+        }
+        last[write->channel] = write->duty;
+    }
+
+    // The target is reached within a tick of the duration
+    for (channel = LED_C; channel < LED_NUM; channel++)
+    {
+        if (light_pwm[channel]->duty_cycle != light_duty_get((light_channel_t)channel, chk->end[channel]))
+        {
+            printf("  channel %d ends at %d\n", channel, light_pwm[channel]->duty_cycle);
+            nb_err++;
+        }
+    }
+    if ((stats.to_target_ms < stats.duration_ms) || (stats.to_target_ms >= (stats.duration_ms + LIGHT_TICK_MS)))
+    {
+        printf("  target reached at %lu ms\n", (unsigned long)stats.to_target_ms);
+        nb_err++;
+    }
+
+    // The trace holds the last staged duties, the same as the PWM writes
+    nb = light_trace_get(&stats, samples);
+    for (i = 0; i < light_chk_write_nb; i++)
+    {
+        light_chk_write_t *write = &light_chk_write[light_chk_write_nb - 1 - i];
+        light_trace_sample_t *sample = &samples[nb - 1 - (i / LED_NUM)];
+
+        if ((i / LED_NUM) >= nb)
+        {
+            break;
+        }
+        if ((sample->time_ms != write->time_ms) || (sample->duty[write->channel] != write->duty))
+        {
+            nb_err++;
+        }
+    }
+
+    printf("  %lu ms %s: %lu updates, reached at %lu ms, max error %.2f count(s), %lu error(s)\n",
+           (unsigned long)stats.duration_ms,
+           (chk->curve == LIGHT_CURVE_EASE_IN_OUT) ? "ease" : "linear",
+           (unsigned long)stats.updates, (unsigned long)stats.to_target_ms, err_max,
+           (unsigned long)nb_err);
+
+    return nb_err;
+}
+
+int main(void)
+{
+    uint32_t nb_err = 0;
+    uint32_t i;
+
+    LED_default_ctrl_param_set(LIGHT_CHK_MOVE_STEP, LIGHT_CHK_MOVE_MIN);
+
+    for (i = 0; i < (sizeof(light_chk_cases) / sizeof(light_chk_cases[0])); i++)
+    {
+        printf("case %lu\n", (unsigned long)i);
+        nb_err += light_chk_run(&light_chk_cases[i]);
+    }
+
+    printf("light_trans_chk: %lu error(s)\n", (unsigned long)nb_err);
+
+    return ((nb_err == 0) ? 0 : 1);
+}
+
+/// @} APP
@@ -0,0 +1,244 @@
+/**
+ ****************************************************************************************
+ *
+ * @file nvds_flash_chk.c
+ *
+ * @brief Checked flash access for the Non Volatile Data Storage (NVDS)
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup NVDS_FLASH_CHK
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#define NVDS_LOG_INTERNAL
+#include <string.h>          // for mem* functions
+#include "nvds.h"            // NVDS definitions
+
+#if (NVDS_FLASH_CHK)
+
+#include "nvds_flash_chk.h"  // Checked flash access definitions
+#include "lld_evt.h"         // BLE time, for the latency
+#include "co_lat.h"          // latency histograms
+#include "ll.h"              // GLOBAL_INT_STOP
+#include "wdt.h"             // wdt_enable
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Size of the stack buffer used to read back the bytes about to be programmed
+#define NVDS_FLASH_CHK_COPY_SIZE    32
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Environment of the checked flash access
+struct nvds_flash_chk_env_tag
+{
+    /// Flash functions being wrapped
+    struct nvds_env_tag flash;
+    /// Erase count of each flash sector
+    uint16_t erase_cnt[NVDS_FLASH_CHK_SECT_NB];
+    /// Program latency
+    struct co_lat_hist prog;
+    /// Erase latency
+    struct co_lat_hist erase;
+    /// Number of bytes programmed
+    uint32_t prog_bytes;
+    /// Bytes left to program before the power is cut
+    uint32_t cut_budget;
+    /// Number of programs that needed a bit to go from 0 to 1
+    uint32_t bad_prog;
+    /// Number of erases not aligned on sectors
+    uint32_t bad_erase;
+    /// Address of the last bad program or erase
+    uint32_t bad_addr;
+    /// The power has been cut, flash accesses are dropped until the reset
+    bool     cut;
+};
+
+/*
+ * GLOBAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+static struct nvds_flash_chk_env_tag nvds_flash_chk_env;
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+static void nvds_flash_chk_lat_get(struct co_lat_hist *hist, struct nvds_flash_chk_lat *lat)
+{
+    lat->nb = hist->nb;
+    lat->p50_us = co_lat_pct(hist, 50);
+    lat->p99_us = co_lat_pct(hist, 99);
+    lat->max_us = hist->max_us;
+}
+
+/// Count the bytes about to be programmed that would need an erase first
+static void nvds_flash_chk_prog_rule(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t *buffer)
+{
+    uint8_t old[NVDS_FLASH_CHK_COPY_SIZE];
+    uint32_t chunk;
+    uint32_t i;
+
+    while (len)
+    {
+        chunk = (len > NVDS_FLASH_CHK_COPY_SIZE) ? NVDS_FLASH_CHK_COPY_SIZE : len;
+        nvds_flash_chk_env.flash.flash_read(flash_space, address, chunk, old, NULL);
+
+        for (i = 0; i < chunk; i++)
+        {
+            if ((old[i] & buffer[i]) != buffer[i])
+            {
+                nvds_flash_chk_env.bad_prog++;
+                nvds_flash_chk_env.bad_addr = address + i;
+                return;
+            }
+        }
+
+        address += chunk;
+        buffer += chunk;
+        len -= chunk;
+    }
+}
+
+/// Power lost: nothing reaches the flash any more, restart as after a brown-out.
+/// platform_reset is not used, its orderly reset would first save the application data.
+static void nvds_flash_chk_power_cut(void)
+{
+    nvds_flash_chk_env.cut = true;
+
+    GLOBAL_INT_STOP();
+    wdt_enable(10);
+    while (1);
+}
+
+static uint8_t nvds_flash_chk_read(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t *buffer, void (*callback)(void))
+{
+    return nvds_flash_chk_env.flash.flash_read(flash_space, address, len, buffer, callback);
+}
+
+static uint8_t nvds_flash_chk_write(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t *buffer, void (*callback)(void))
+{
+    uint32_t slot, fine;
+    uint8_t status;
+
+    if (nvds_flash_chk_env.cut)
+    {
+        return 0;
+    }
+
+    nvds_flash_chk_prog_rule(flash_space, address, len, buffer);
+
+    if (len > nvds_flash_chk_env.cut_budget)
+    {
+        // Program the bytes before the cut only
+        nvds_flash_chk_env.flash.flash_write(flash_space, address, nvds_flash_chk_env.cut_budget, buffer, NULL);
+        nvds_flash_chk_power_cut();
+        return 0;
+    }
+
+    if (nvds_flash_chk_env.cut_budget != NVDS_FLASH_CHK_CUT_OFF)
+    {
+        nvds_flash_chk_env.cut_budget -= len;
+    }
+
+    lld_evt_time_get_us(&slot, &fine);
+    status = nvds_flash_chk_env.flash.flash_write(flash_space, address, len, buffer, callback);
+    co_lat_add(&nvds_flash_chk_env.prog, lld_evt_time_elapsed_us(slot, fine));
+    nvds_flash_chk_env.prog_bytes += len;
+
+    return status;
+}
+
+static uint8_t nvds_flash_chk_erase(uint8_t flash_type, uint32_t address, uint32_t len, void (*callback)(void))
+{
+    uint32_t slot, fine;
+    uint32_t sect;
+    uint8_t status;
+
+    if (nvds_flash_chk_env.cut)
+    {
+        return 0;
+    }
+
+    // A cut armed to fall on the next byte also catches the erase before it
+    if (nvds_flash_chk_env.cut_budget == 0)
+    {
+        nvds_flash_chk_power_cut();
+        return 0;
+    }
+
+    if ((address % NVDS_FLASH_CHK_SECT_SIZE) || (len % NVDS_FLASH_CHK_SECT_SIZE))
+    {
+        nvds_flash_chk_env.bad_erase++;
+        nvds_flash_chk_env.bad_addr = address;
+    }
+
+    for (sect = address / NVDS_FLASH_CHK_SECT_SIZE;
+            (sect < NVDS_FLASH_CHK_SECT_NB) && (sect * NVDS_FLASH_CHK_SECT_SIZE < address + len); sect++)
+    {
+        nvds_flash_chk_env.erase_cnt[sect]++;
+    }
+
+    lld_evt_time_get_us(&slot, &fine);
+    status = nvds_flash_chk_env.flash.flash_erase(flash_type, address, len, callback);
+    co_lat_add(&nvds_flash_chk_env.erase, lld_evt_time_elapsed_us(slot, fine));
+
+    return status;
+}
+
+/*
+ * EXPORTED FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+uint8_t nvds_flash_chk_init(struct nvds_env_tag env)
+{
+    // Re-initialized after nvds_deinit with a fresh environment, the figures are kept
+    nvds_flash_chk_env.flash = env;
+    nvds_flash_chk_env.cut_budget = NVDS_FLASH_CHK_CUT_OFF;
+
+    env.flash_read = nvds_flash_chk_read;
+    env.flash_write = nvds_flash_chk_write;
+    env.flash_erase = nvds_flash_chk_erase;
+
+#if (NVDS_LOG_STRUCTURED)
+    return nvds_log_init(env);
+#else
+    return nvds_init(env);
+#endif // NVDS_LOG_STRUCTURED
+}
+
+void nvds_flash_chk_cut_set(uint32_t nb)
+{
+    nvds_flash_chk_env.cut_budget = nb;
+}
+
+void nvds_flash_chk_stats_get(struct nvds_flash_chk_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->erase_cnt, nvds_flash_chk_env.erase_cnt, sizeof(stats->erase_cnt));
+
+    stats->prog_bytes = nvds_flash_chk_env.prog_bytes;
+    nvds_flash_chk_lat_get(&nvds_flash_chk_env.prog, &stats->prog);
+    nvds_flash_chk_lat_get(&nvds_flash_chk_env.erase, &stats->erase);
+    stats->bad_prog = nvds_flash_chk_env.bad_prog;
+    stats->bad_erase = nvds_flash_chk_env.bad_erase;
+    stats->bad_addr = nvds_flash_chk_env.bad_addr;
+}
+
+#endif // NVDS_FLASH_CHK
+
+/// @} NVDS_FLASH_CHK
@@ -0,0 +1,990 @@
+/**
+ ****************************************************************************************
+ *
+ * @file nvds_log.c
+ *
+ * @brief Log-structured, wear-levelled Non Volatile Data Storage (NVDS) backend
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup NVDS_LOG
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#define NVDS_LOG_INTERNAL
+#include <stddef.h>          // offsetof
+#include <string.h>          // for mem* functions
+#include "nvds.h"            // NVDS definitions
+
+#if (NVDS_LOG_STRUCTURED)
+
+#include "nvds_log.h"        // NVDS log backend definitions
+#include "lld_evt.h"         // BLE time, for the put latency
+#include "co_lat.h"          // put latency histogram
+#if (NVDS_LOG_COMPACT_BG)
+#include "mal.h"             // Mesh deferred jobs
+#endif // (NVDS_LOG_COMPACT_BG)
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Offset of a sector from NVDS_LOG_BASE_ADDR
+#define NVDS_LOG_SECT_OFF(sect)     ((uint32_t)(sect) * NVDS_LOG_SECT_SIZE)
+/// Offset of the first record in a sector
+#define NVDS_LOG_REC_START          (sizeof(struct nvds_log_sect_hdr))
+/// Size of the stack buffer used to copy and check record data
+#define NVDS_LOG_COPY_SIZE          64
+/// Budget of nvds_log_gc for a collection run to the end
+#define NVDS_LOG_GC_ALL             0xFFFF
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Environment of the log backend
+struct nvds_log_env_tag
+{
+    /// Flash access functions
+    struct nvds_env_tag flash;
+    /// Offset from NVDS_LOG_BASE_ADDR of the newest record of each tag, 0 if none
+    uint16_t idx[NVDS_LOG_TAG_NB];
+    /// One bit per locked tag
+    uint8_t  lock[(NVDS_LOG_TAG_NB + 7) / 8];
+    /// Erase count of each sector
+    uint32_t erase_cnt[NVDS_LOG_SECT_NB];
+    /// Sequence number of the active sector
+    uint32_t seq;
+    /// Number of sectors garbage-collected since init
+    uint32_t gc_cnt;
+    /// Id of the newest transaction written or found in the log
+    uint16_t txn_id;
+    /// Upper bound of the bytes the collection in progress still has to copy
+    uint16_t gc_need;
+    /// Next tag to copy out of gc_sect
+    uint16_t gc_tag;
+    /// Sector being collected, NVDS_LOG_SECT_NB if none
+    uint8_t  gc_sect;
+    /// Write offset in the active sector
+    uint16_t wr_off;
+    /// Sector records are appended to
+    uint8_t  active;
+    /// Log area scanned and usable
+    bool     ready;
+#if (NVDS_LOG_COMPACT_BG)
+    /// Background collection job
+    mal_djob_t djob;
+    /// Sequence number of the active sector once found not worth collecting early
+    uint32_t compact_skip_seq;
+    /// Number of background collection jobs run
+    uint32_t compact_job_cnt;
+    /// The background job is registered
+    bool     compact_reg;
+#endif // (NVDS_LOG_COMPACT_BG)
+    /// Put latency
+    struct co_lat_hist lat;
+};
+
+/// Transaction staged in RAM until its commit
+struct nvds_log_txn_tag
+{
+    /// Tag of each staged put
+    uint8_t  tag[NVDS_TXN_TAG_MAX];
+    /// Data length of each staged put
+    uint8_t  len[NVDS_TXN_TAG_MAX];
+    /// Data of the staged puts, one after the other
+    uint8_t  buf[NVDS_TXN_BUF_SIZE];
+    /// Bytes used in buf
+    uint16_t used;
+    /// Number of staged puts
+    uint8_t  nb;
+    /// A transaction has been started
+    bool     open;
+};
+
+/*
+ * GLOBAL VARIABLE DEFINITIONS
+ ****************************************************************************************
+ */
+static struct nvds_log_env_tag nvds_log_env;
+static struct nvds_log_txn_tag nvds_log_txn;
+
+/*
+ * LOCAL FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+static void nvds_log_read(uint32_t offset, uint32_t len, uint8_t *buf)
+{
+    nvds_log_env.flash.flash_read(0, NVDS_LOG_BASE_ADDR + offset, len, buf, NULL);
+}
+
+static void nvds_log_write(uint32_t offset, uint32_t len, uint8_t *buf)
+{
+    nvds_log_env.flash.flash_write(0, NVDS_LOG_BASE_ADDR + offset, len, buf, NULL);
+}
+
+/// CRC-16/CCITT
+static uint16_t nvds_log_crc(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    uint8_t i;
+
+    while (len--)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+/// CRC of a record header followed by len data bytes read from flash
+static uint16_t nvds_log_rec_crc(struct nvds_log_rec_hdr *hdr, uint32_t data_off)
+{
+    uint8_t buf[NVDS_LOG_COPY_SIZE];
+    uint32_t len = hdr->len;
+    uint32_t chunk;
+    uint16_t crc = nvds_log_crc(0xFFFF, &hdr->tag, 3);
+
+    while (len)
+    {
+        chunk = (len > NVDS_LOG_COPY_SIZE) ? NVDS_LOG_COPY_SIZE : len;
+        nvds_log_read(data_off, chunk, buf);
+        crc = nvds_log_crc(crc, buf, chunk);
+        data_off += chunk;
+        len -= chunk;
+    }
+
+    return crc;
+}
+
+static bool nvds_log_is_locked(uint8_t tag)
+{
+    return (nvds_log_env.lock[tag >> 3] & (1 << (tag & 0x7))) != 0;
+}
+
+/// Point the RAM index at a committed record
+static void nvds_log_index(struct nvds_log_rec_hdr *hdr, uint32_t offset)
+{
+    if (hdr->flags & NVDS_LOG_FLAG_DEL)
+    {
+        nvds_log_env.idx[hdr->tag] = 0;
+    }
+    else
+    {
+        nvds_log_env.idx[hdr->tag] = (uint16_t)offset;
+    }
+
+    if (hdr->flags & NVDS_LOG_FLAG_LOCK)
+    {
+        nvds_log_env.lock[hdr->tag >> 3] |= (1 << (hdr->tag & 0x7));
+    }
+    else
+    {
+        nvds_log_env.lock[hdr->tag >> 3] &= ~(1 << (hdr->tag & 0x7));
+    }
+}
+
+/// Erase a sector and write its header, leaving it free
+static void nvds_log_sect_format(uint8_t sect)
+{
+    struct nvds_log_sect_hdr hdr;
+
+    nvds_log_env.erase_cnt[sect]++;
+    nvds_log_env.flash.flash_erase(0, NVDS_LOG_BASE_ADDR + NVDS_LOG_SECT_OFF(sect), NVDS_LOG_SECT_SIZE, NULL);
+
+    hdr.magic = NVDS_LOG_SECT_MAGIC;
+    hdr.erase_cnt = nvds_log_env.erase_cnt[sect];
+    hdr.seq = NVDS_LOG_SEQ_FREE;
+    hdr.seq_chk = 0xFFFFFFFF;
+
+    // Magic last, a header cut by a reset is not taken for a formatted one
+    nvds_log_write(NVDS_LOG_SECT_OFF(sect) + sizeof(hdr.magic), sizeof(hdr) - sizeof(hdr.magic),
+                   (uint8_t *)&hdr + sizeof(hdr.magic));
+    nvds_log_write(NVDS_LOG_SECT_OFF(sect), sizeof(hdr.magic), (uint8_t *)&hdr.magic);
+}
+
+/// Give a free sector the next sequence number and append to it from now on
+static void nvds_log_sect_open(uint8_t sect)
+{
+    uint32_t seq = nvds_log_env.seq + 1;
+    uint32_t seq_chk = ~seq;
+
+    nvds_log_write(NVDS_LOG_SECT_OFF(sect) + offsetof(struct nvds_log_sect_hdr, seq), sizeof(seq), (uint8_t *)&seq);
+    nvds_log_write(NVDS_LOG_SECT_OFF(sect) + offsetof(struct nvds_log_sect_hdr, seq_chk), sizeof(seq_chk), (uint8_t *)&seq_chk);
+
+    nvds_log_env.seq = seq;
+    nvds_log_env.active = sect;
+    nvds_log_env.wr_off = NVDS_LOG_REC_START;
+}
+
+static bool nvds_log_sect_is_free(uint8_t sect)
+{
+    struct nvds_log_sect_hdr hdr;
+
+    nvds_log_read(NVDS_LOG_SECT_OFF(sect), sizeof(hdr), (uint8_t *)&hdr);
+
+    return (hdr.magic == NVDS_LOG_SECT_MAGIC) && (hdr.seq == NVDS_LOG_SEQ_FREE);
+}
+
+/// Replay the records of a sector into the RAM index, return the end of the written area
+static uint16_t nvds_log_sect_scan(uint8_t sect)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint32_t base = NVDS_LOG_SECT_OFF(sect);
+    uint32_t off = NVDS_LOG_REC_START;
+    uint32_t size;
+    uint8_t *p = (uint8_t *)&hdr;
+    uint8_t i;
+    // Records of the transaction being replayed, indexed when its seal is found
+    uint16_t txn_off[NVDS_TXN_TAG_MAX];
+    uint16_t txn_id = 0xFFFF;
+    uint8_t txn_nb = 0;
+
+    while (off + sizeof(hdr) <= NVDS_LOG_SECT_SIZE)
+    {
+        nvds_log_read(base + off, sizeof(hdr), p);
+
+        for (i = 0; (i < sizeof(hdr)) && (p[i] == 0xFF); i++);
+        if (i == sizeof(hdr))
+        {
+            // Erased, end of the log
+            break;
+        }
+
+        size = NVDS_LOG_REC_SIZE(hdr.len);
+        if (off + size > NVDS_LOG_SECT_SIZE)
+        {
+            // Header cut by a reset, nothing can follow it
+            off = NVDS_LOG_SECT_SIZE;
+            break;
+        }
+
+        // Records whose state byte was never programmed did not complete
+        if ((hdr.state != NVDS_LOG_REC_VALID) || (hdr.crc != nvds_log_rec_crc(&hdr, base + off + sizeof(hdr))))
+        {
+            // Nothing to index
+        }
+        else if (hdr.flags & NVDS_LOG_FLAG_SEAL)
+        {
+            if ((txn_nb != 0) && (hdr.rsvd == txn_id))
+            {
+                for (i = 0; i < txn_nb; i++)
+                {
+                    nvds_log_read(txn_off[i], sizeof(hdr), p);
+                    nvds_log_index(&hdr, txn_off[i]);
+                }
+            }
+
+            txn_nb = 0;
+            nvds_log_env.txn_id = hdr.rsvd;
+        }
+        else if (hdr.tag >= NVDS_LOG_TAG_NB)
+        {
+            // Not a tag of the log
+        }
+        else if (hdr.flags & NVDS_LOG_FLAG_TXN)
+        {
+            // Another id: the previous transaction was cut by a reset before its seal
+            if ((txn_nb == 0) || (hdr.rsvd != txn_id))
+            {
+                txn_nb = 0;
+                txn_id = hdr.rsvd;
+            }
+
+            if (txn_nb < NVDS_TXN_TAG_MAX)
+            {
+                txn_off[txn_nb++] = (uint16_t)(base + off);
+            }
+
+            nvds_log_env.txn_id = hdr.rsvd;
+        }
+        else
+        {
+            txn_nb = 0;
+            nvds_log_index(&hdr, base + off);
+        }
+
+        off += size;
+    }
+
+    return (uint16_t)off;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Append a record to the active sector.
+ *
+ * The header is written with the pending state, then the data, then the state byte is
+ * programmed to valid. When buf is NULL the data is copied from the record the index
+ * currently holds for the tag. Transaction records are only indexed by the commit.
+ ****************************************************************************************
+ */
+static uint8_t nvds_log_append(struct nvds_log_rec_hdr *hdr, uint8_t *buf)
+{
+    uint8_t tmp[NVDS_LOG_COPY_SIZE];
+    uint32_t off = NVDS_LOG_SECT_OFF(nvds_log_env.active) + nvds_log_env.wr_off;
+    uint32_t src = 0;
+    uint32_t dst = off + sizeof(*hdr);
+    uint32_t len = hdr->len;
+    uint32_t chunk;
+    uint8_t state = NVDS_LOG_REC_VALID;
+
+    if (nvds_log_env.wr_off + NVDS_LOG_REC_SIZE(hdr->len) > NVDS_LOG_SECT_SIZE)
+    {
+        return NVDS_NO_SPACE_AVAILABLE;
+    }
+
+    hdr->state = NVDS_LOG_REC_PENDING;
+    nvds_log_write(off, sizeof(*hdr), (uint8_t *)hdr);
+
+    if (buf != NULL)
+    {
+        nvds_log_write(dst, len, buf);
+    }
+    else
+    {
+        if (len)
+        {
+            src = nvds_log_env.idx[hdr->tag] + sizeof(*hdr);
+        }
+
+        while (len)
+        {
+            chunk = (len > NVDS_LOG_COPY_SIZE) ? NVDS_LOG_COPY_SIZE : len;
+            nvds_log_read(src, chunk, tmp);
+            nvds_log_write(dst, chunk, tmp);
+            src += chunk;
+            dst += chunk;
+            len -= chunk;
+        }
+    }
+
+    nvds_log_write(off + offsetof(struct nvds_log_rec_hdr, state), 1, &state);
+    hdr->state = state;
+
+    nvds_log_env.wr_off += NVDS_LOG_REC_SIZE(hdr->len);
+
+    if (!(hdr->flags & (NVDS_LOG_FLAG_TXN | NVDS_LOG_FLAG_SEAL)))
+    {
+        nvds_log_index(hdr, off);
+    }
+
+    return NVDS_OK;
+}
+
+/// Turn a sealed transaction record read back from flash into a plain record
+static void nvds_log_untxn(struct nvds_log_rec_hdr *hdr, uint32_t offset)
+{
+    if (hdr->flags & NVDS_LOG_FLAG_TXN)
+    {
+        hdr->flags &= ~NVDS_LOG_FLAG_TXN;
+        hdr->rsvd = 0xFFFF;
+        hdr->crc = nvds_log_rec_crc(hdr, offset + sizeof(*hdr));
+    }
+}
+
+/// Start the collection of a sector, nvds_log_gc does the work
+static void nvds_log_gc_start(uint8_t sect, uint16_t need)
+{
+    nvds_log_env.gc_sect = sect;
+    nvds_log_env.gc_tag = 0;
+    nvds_log_env.gc_need = need;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Copy the live records of the sector being collected to the active sector, then
+ * erase it.
+ *
+ * At most budget records are copied per call; when the budget runs out the erase is left
+ * to the next call. Records the index moved out of the sector meanwhile are skipped.
+ ****************************************************************************************
+ */
+static uint8_t nvds_log_gc(uint16_t budget)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint8_t sect = nvds_log_env.gc_sect;
+    uint16_t tag;
+    uint16_t size;
+    uint8_t status;
+
+    if (sect == NVDS_LOG_SECT_NB)
+    {
+        return NVDS_OK;
+    }
+
+    if (!nvds_log_sect_is_free(sect))
+    {
+        for (; nvds_log_env.gc_tag < NVDS_LOG_TAG_NB; nvds_log_env.gc_tag++)
+        {
+            tag = nvds_log_env.gc_tag;
+            if ((nvds_log_env.idx[tag] != 0) && ((nvds_log_env.idx[tag] / NVDS_LOG_SECT_SIZE) == sect))
+            {
+                if (budget == 0)
+                {
+                    return NVDS_OK;
+                }
+
+                nvds_log_read(nvds_log_env.idx[tag], sizeof(hdr), (uint8_t *)&hdr);
+                // The copy lands without its seal
+                nvds_log_untxn(&hdr, nvds_log_env.idx[tag]);
+                status = nvds_log_append(&hdr, NULL);
+                if (status != NVDS_OK)
+                {
+                    return status;
+                }
+
+                budget--;
+                size = NVDS_LOG_REC_SIZE(hdr.len);
+                nvds_log_env.gc_need = (nvds_log_env.gc_need > size) ? (nvds_log_env.gc_need - size) : 0;
+            }
+        }
+
+        if (budget == 0)
+        {
+            return NVDS_OK;
+        }
+
+        nvds_log_sect_format(sect);
+        nvds_log_env.gc_cnt++;
+    }
+
+    nvds_log_gc_start(NVDS_LOG_SECT_NB, 0);
+
+    return NVDS_OK;
+}
+
+/// Move to the next sector of the ring and reclaim the oldest one
+static uint8_t nvds_log_rollover(void)
+{
+    uint8_t next = (nvds_log_env.active + 1) % NVDS_LOG_SECT_NB;
+
+    // The sector after the active one is kept free, unless a previous collection ran out of room
+    if (!nvds_log_sect_is_free(next))
+    {
+        return NVDS_NO_SPACE_AVAILABLE;
+    }
+
+    nvds_log_sect_open(next);
+    nvds_log_gc_start((next + 1) % NVDS_LOG_SECT_NB, 0);
+
+    return nvds_log_gc(NVDS_LOG_GC_ALL);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Make room for size bytes in the active sector.
+ *
+ * The bytes a background collection still has to copy are kept free. When they are
+ * needed, the collection is finished first, then the log rolls over to the next sector.
+ ****************************************************************************************
+ */
+static uint8_t nvds_log_reserve(uint32_t size)
+{
+    uint8_t status;
+    uint8_t i;
+
+    for (i = 0; i <= NVDS_LOG_SECT_NB; i++)
+    {
+        if (nvds_log_env.wr_off + size + nvds_log_env.gc_need <= NVDS_LOG_SECT_SIZE)
+        {
+            return NVDS_OK;
+        }
+
+        if (nvds_log_env.gc_sect != NVDS_LOG_SECT_NB)
+        {
+            status = nvds_log_gc(NVDS_LOG_GC_ALL);
+        }
+        else
+        {
+            status = nvds_log_rollover();
+        }
+
+        if (status != NVDS_OK)
+        {
+            break;
+        }
+    }
+
+    return NVDS_NO_SPACE_AVAILABLE;
+}
+
+/// Bytes used by the live records of a sector, of the whole log for NVDS_LOG_SECT_NB
+static uint32_t nvds_log_live_bytes(uint8_t sect)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint32_t live = 0;
+    uint16_t tag;
+
+    for (tag = 0; tag < NVDS_LOG_TAG_NB; tag++)
+    {
+        if ((nvds_log_env.idx[tag] != 0)
+                && ((sect == NVDS_LOG_SECT_NB) || ((nvds_log_env.idx[tag] / NVDS_LOG_SECT_SIZE) == sect)))
+        {
+            nvds_log_read(nvds_log_env.idx[tag], sizeof(hdr), (uint8_t *)&hdr);
+            live += NVDS_LOG_REC_SIZE(hdr.len);
+        }
+    }
+
+    return live;
+}
+
+#if (NVDS_LOG_COMPACT_BG)
+/**
+ ****************************************************************************************
+ * @brief Background collection job.
+ *
+ * The first job opens the next sector early and starts collecting the oldest one, the
+ * sector after it, as a rollover does, unless its live records would leave less than the
+ * watermark free in the new sector. Each job then copies NVDS_LOG_COMPACT_SLICE records
+ * or erases the sector, and registers the next.
+ ****************************************************************************************
+ */
+static void nvds_log_compact_cb(void *p_env)
+{
+    uint8_t next = (nvds_log_env.active + 1) % NVDS_LOG_SECT_NB;
+    uint8_t oldest = (next + 1) % NVDS_LOG_SECT_NB;
+    uint32_t need;
+
+    nvds_log_env.compact_reg = false;
+
+    if (!nvds_log_env.ready)
+    {
+        return;
+    }
+
+    if (nvds_log_env.gc_sect == NVDS_LOG_SECT_NB)
+    {
+        need = nvds_log_live_bytes(oldest);
+
+        if (!nvds_log_sect_is_free(next)
+                || (NVDS_LOG_REC_START + need + NVDS_LOG_COMPACT_WATERMARK > NVDS_LOG_SECT_SIZE))
+        {
+            nvds_log_env.compact_skip_seq = nvds_log_env.seq;
+            return;
+        }
+
+        nvds_log_sect_open(next);
+        nvds_log_gc_start(oldest, (uint16_t)need);
+    }
+
+    nvds_log_env.compact_job_cnt++;
+
+    // On error the collection stays pending, the next put that lacks room finishes it
+    if ((nvds_log_gc(NVDS_LOG_COMPACT_SLICE) == NVDS_OK) && (nvds_log_env.gc_sect != NVDS_LOG_SECT_NB))
+    {
+        nvds_log_env.compact_reg = true;
+        mal_djob_reg(&nvds_log_env.djob);
+    }
+}
+#endif // (NVDS_LOG_COMPACT_BG)
+
+/// Register the background collection job when the active sector runs low on space
+static void nvds_log_compact_check(void)
+{
+#if (NVDS_LOG_COMPACT_BG)
+    if (!nvds_log_env.compact_reg && (nvds_log_env.gc_sect == NVDS_LOG_SECT_NB)
+            && (nvds_log_env.wr_off + NVDS_LOG_COMPACT_WATERMARK > NVDS_LOG_SECT_SIZE)
+            && (nvds_log_env.compact_skip_seq != nvds_log_env.seq))
+    {
+        nvds_log_env.compact_reg = true;
+        mal_djob_reg(&nvds_log_env.djob);
+    }
+#endif // (NVDS_LOG_COMPACT_BG)
+}
+
+/// Append a record, rolling over to the next sector when the active one is full
+static uint8_t nvds_log_write_rec(struct nvds_log_rec_hdr *hdr, uint8_t *buf)
+{
+    uint8_t status;
+
+    status = nvds_log_reserve(NVDS_LOG_REC_SIZE(hdr->len));
+
+    if (status == NVDS_OK)
+    {
+        status = nvds_log_append(hdr, buf);
+        nvds_log_compact_check();
+    }
+
+    return status;
+}
+
+/*
+ * EXPORTED FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+uint8_t nvds_log_init(struct nvds_env_tag env)
+{
+    struct nvds_log_sect_hdr hdr;
+    uint32_t seq[NVDS_LOG_SECT_NB];
+    uint32_t max_cnt = 0;
+    uint32_t last = 0;
+    uint8_t sect;
+    uint8_t i;
+#if (NVDS_LOG_COMPACT_BG)
+    // A job still queued by mal (init again after nvds_log_deinit) is linked through
+    // djob.hdr, the link must survive the reset of the environment
+    mal_djob_t djob = nvds_log_env.djob;
+    bool compact_reg = nvds_log_env.compact_reg;
+#endif // (NVDS_LOG_COMPACT_BG)
+
+    // The ROM stack and the precompiled libraries keep using the ROM NVDS
+    nvds_init(env);
+
+    memset(&nvds_log_env, 0, sizeof(nvds_log_env));
+    nvds_log_env.flash = env;
+    nvds_log_env.gc_sect = NVDS_LOG_SECT_NB;
+#if (NVDS_LOG_COMPACT_BG)
+    nvds_log_env.djob = djob;
+    nvds_log_env.compact_reg = compact_reg;
+    nvds_log_env.djob.cb = nvds_log_compact_cb;
+    nvds_log_env.djob.p_env = NULL;
+#endif // (NVDS_LOG_COMPACT_BG)
+
+    for (sect = 0; sect < NVDS_LOG_SECT_NB; sect++)
+    {
+        nvds_log_read(NVDS_LOG_SECT_OFF(sect), sizeof(hdr), (uint8_t *)&hdr);
+        if (hdr.magic == NVDS_LOG_SECT_MAGIC)
+        {
+            seq[sect] = hdr.seq;
+            nvds_log_env.erase_cnt[sect] = hdr.erase_cnt;
+            if (hdr.erase_cnt > max_cnt)
+            {
+                max_cnt = hdr.erase_cnt;
+            }
+
+            // Open cut by a reset, a partly written seq must not be taken as the newest one
+            if ((hdr.seq != NVDS_LOG_SEQ_FREE) && (hdr.seq_chk != ~hdr.seq))
+            {
+                nvds_log_sect_format(sect);
+                seq[sect] = NVDS_LOG_SEQ_FREE;
+            }
+        }
+        else
+        {
+            seq[sect] = 0;
+        }
+    }
+
+    // First boot or erase cut by a reset, the lost count is taken as the highest one
+    for (sect = 0; sect < NVDS_LOG_SECT_NB; sect++)
+    {
+        if (seq[sect] == 0)
+        {
+            nvds_log_env.erase_cnt[sect] = max_cnt;
+            nvds_log_sect_format(sect);
+            seq[sect] = NVDS_LOG_SEQ_FREE;
+        }
+    }
+
+    // Replay the sectors from the oldest to the newest, the last one is the active one
+    nvds_log_env.active = NVDS_LOG_SECT_NB;
+    for (;;)
+    {
+        sect = NVDS_LOG_SECT_NB;
+        for (i = 0; i < NVDS_LOG_SECT_NB; i++)
+        {
+            if ((seq[i] != NVDS_LOG_SEQ_FREE) && (seq[i] > last)
+                    && ((sect == NVDS_LOG_SECT_NB) || (seq[i] < seq[sect])))
+            {
+                sect = i;
+            }
+        }
+
+        if (sect == NVDS_LOG_SECT_NB)
+        {
+            break;
+        }
+
+        last = seq[sect];
+        nvds_log_env.active = sect;
+        nvds_log_env.seq = last;
+        nvds_log_env.wr_off = nvds_log_sect_scan(sect);
+    }
+
+    if (nvds_log_env.active == NVDS_LOG_SECT_NB)
+    {
+        nvds_log_sect_open(0);
+    }
+    else
+    {
+        // Finish a collection cut by a reset
+        nvds_log_gc_start((nvds_log_env.active + 1) % NVDS_LOG_SECT_NB, 0);
+        nvds_log_gc(NVDS_LOG_GC_ALL);
+    }
+
+    nvds_log_env.ready = true;
+
+    return NVDS_OK;
+}
+
+void nvds_log_deinit(void)
+{
+    uint8_t sect;
+
+    for (sect = 0; sect < NVDS_LOG_SECT_NB; sect++)
+    {
+        nvds_log_sect_format(sect);
+    }
+
+    memset(nvds_log_env.idx, 0, sizeof(nvds_log_env.idx));
+    memset(nvds_log_env.lock, 0, sizeof(nvds_log_env.lock));
+    nvds_log_gc_start(NVDS_LOG_SECT_NB, 0);
+    nvds_log_sect_open(0);
+
+    nvds_deinit();
+}
+
+uint8_t nvds_log_get(uint16_t tag, nvds_tag_len_t *lengthPtr, uint8_t *buf)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint16_t off;
+
+    if (!nvds_log_env.ready || !NVDS_LOG_TAG_IN_LOG(tag) || (nvds_log_env.idx[tag] == 0))
+    {
+        return nvds_get(tag, lengthPtr, buf);
+    }
+
+    off = nvds_log_env.idx[tag];
+    nvds_log_read(off, sizeof(hdr), (uint8_t *)&hdr);
+
+    if (*lengthPtr < hdr.len)
+    {
+        return NVDS_LENGTH_OUT_OF_RANGE;
+    }
+
+    *lengthPtr = hdr.len;
+    nvds_log_read(off + sizeof(hdr), hdr.len, buf);
+
+    return NVDS_OK;
+}
+
+uint8_t nvds_log_put(uint16_t tag, nvds_tag_len_t length, uint8_t *buf)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint32_t slot, fine;
+    uint8_t status;
+
+    // Mesh storage tags past the RAM index stay in the ROM NVDS, so mesh storage spans
+    // both backends
+    if (!nvds_log_env.ready || !NVDS_LOG_TAG_IN_LOG(tag))
+    {
+        return nvds_put(tag, length, buf);
+    }
+
+    if (nvds_log_is_locked(tag))
+    {
+        return NVDS_PARAM_LOCKED;
+    }
+
+    hdr.tag = tag;
+    hdr.flags = 0;
+    hdr.len = length;
+    hdr.rsvd = 0xFFFF;
+    hdr.crc = nvds_log_crc(nvds_log_crc(0xFFFF, &hdr.tag, 3), buf, length);
+
+    lld_evt_time_get_us(&slot, &fine);
+    status = nvds_log_write_rec(&hdr, buf);
+    co_lat_add(&nvds_log_env.lat, lld_evt_time_elapsed_us(slot, fine));
+
+    return status;
+}
+
+uint8_t nvds_log_del(uint16_t tag)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint8_t status;
+
+    if (!nvds_log_env.ready || !NVDS_LOG_TAG_IN_LOG(tag))
+    {
+        return nvds_del(tag);
+    }
+
+    if (nvds_log_is_locked(tag))
+    {
+        return NVDS_PARAM_LOCKED;
+    }
+
+    // Drop the ROM copy too so that it does not show through the tombstone
+    status = nvds_del(tag);
+
+    if (nvds_log_env.idx[tag] == 0)
+    {
+        return status;
+    }
+
+    hdr.tag = tag;
+    hdr.flags = NVDS_LOG_FLAG_DEL;
+    hdr.len = 0;
+    hdr.rsvd = 0xFFFF;
+    hdr.crc = nvds_log_crc(0xFFFF, &hdr.tag, 3);
+
+    return nvds_log_write_rec(&hdr, NULL);
+}
+
+uint8_t nvds_log_lock(uint16_t tag)
+{
+    struct nvds_log_rec_hdr hdr;
+
+    if (!nvds_log_env.ready || !NVDS_LOG_TAG_IN_LOG(tag) || (nvds_log_env.idx[tag] == 0))
+    {
+        return nvds_lock(tag);
+    }
+
+    if (nvds_log_is_locked(tag))
+    {
+        return NVDS_OK;
+    }
+
+    nvds_log_read(nvds_log_env.idx[tag], sizeof(hdr), (uint8_t *)&hdr);
+    nvds_log_untxn(&hdr, nvds_log_env.idx[tag]);
+    hdr.flags |= NVDS_LOG_FLAG_LOCK;
+    hdr.crc = nvds_log_rec_crc(&hdr, nvds_log_env.idx[tag] + sizeof(hdr));
+
+    return nvds_log_write_rec(&hdr, NULL);
+}
+
+void nvds_log_stats_get(struct nvds_log_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->erase_cnt, nvds_log_env.erase_cnt, sizeof(stats->erase_cnt));
+
+    stats->live_bytes = nvds_log_live_bytes(NVDS_LOG_SECT_NB);
+    stats->free_bytes = NVDS_LOG_SECT_SIZE - nvds_log_env.wr_off;
+    stats->gc_cnt = nvds_log_env.gc_cnt;
+#if (NVDS_LOG_COMPACT_BG)
+    stats->compact_job_cnt = nvds_log_env.compact_job_cnt;
+#endif // (NVDS_LOG_COMPACT_BG)
+    stats->put_nb = nvds_log_env.lat.nb;
+    stats->put_p50_us = co_lat_pct(&nvds_log_env.lat, 50);
+    stats->put_p90_us = co_lat_pct(&nvds_log_env.lat, 90);
+    stats->put_p99_us = co_lat_pct(&nvds_log_env.lat, 99);
+    stats->put_max_us = nvds_log_env.lat.max_us;
+}
+
+uint8_t nvds_txn_begin(void)
+{
+    if (!nvds_log_env.ready)
+    {
+        return NVDS_FAIL;
+    }
+
+    nvds_log_txn.nb = 0;
+    nvds_log_txn.used = 0;
+    nvds_log_txn.open = true;
+
+    return NVDS_OK;
+}
+
+uint8_t nvds_txn_put(uint16_t tag, nvds_tag_len_t length, uint8_t *buf)
+{
+    if (!nvds_log_txn.open || !NVDS_LOG_TAG_IN_LOG(tag))
+    {
+        return NVDS_FAIL;
+    }
+
+    if (nvds_log_is_locked(tag))
+    {
+        return NVDS_PARAM_LOCKED;
+    }
+
+    if ((nvds_log_txn.nb == NVDS_TXN_TAG_MAX) || (nvds_log_txn.used + length > NVDS_TXN_BUF_SIZE))
+    {
+        return NVDS_NO_SPACE_AVAILABLE;
+    }
+
+    nvds_log_txn.tag[nvds_log_txn.nb] = tag;
+    nvds_log_txn.len[nvds_log_txn.nb] = length;
+    memcpy(&nvds_log_txn.buf[nvds_log_txn.used], buf, length);
+    nvds_log_txn.used += length;
+    nvds_log_txn.nb++;
+
+    return NVDS_OK;
+}
+
+uint8_t nvds_txn_commit(void)
+{
+    struct nvds_log_rec_hdr hdr;
+    uint16_t off[NVDS_TXN_TAG_MAX];
+    uint32_t size = NVDS_LOG_REC_SIZE(0);
+    uint16_t pos = 0;
+    uint16_t id;
+    uint8_t i;
+
+    if (!nvds_log_txn.open)
+    {
+        return NVDS_FAIL;
+    }
+
+    nvds_log_txn.open = false;
+
+    for (i = 0; i < nvds_log_txn.nb; i++)
+    {
+        size += NVDS_LOG_REC_SIZE(nvds_log_txn.len[i]);
+    }
+
+    // Records and seal go to one sector, a collection never copies half a transaction
+    if (nvds_log_reserve(size) != NVDS_OK)
+    {
+        return NVDS_NO_SPACE_AVAILABLE;
+    }
+
+    id = nvds_log_env.txn_id + 1;
+    if (id == 0xFFFF)
+    {
+        id = 0;
+    }
+    nvds_log_env.txn_id = id;
+
+    hdr.rsvd = id;
+
+    for (i = 0; i < nvds_log_txn.nb; i++)
+    {
+        hdr.tag = nvds_log_txn.tag[i];
+        hdr.flags = NVDS_LOG_FLAG_TXN;
+        hdr.len = nvds_log_txn.len[i];
+        hdr.crc = nvds_log_crc(nvds_log_crc(0xFFFF, &hdr.tag, 3), &nvds_log_txn.buf[pos], hdr.len);
+
+        off[i] = NVDS_LOG_SECT_OFF(nvds_log_env.active) + nvds_log_env.wr_off;
+        nvds_log_append(&hdr, &nvds_log_txn.buf[pos]);
+        pos += hdr.len;
+    }
+
+    hdr.tag = NVDS_LOG_TAG_NB;
+    hdr.flags = NVDS_LOG_FLAG_SEAL;
+    hdr.len = 0;
+    hdr.crc = nvds_log_crc(0xFFFF, &hdr.tag, 3);
+    nvds_log_append(&hdr, NULL);
+
+    // Sealed, the staged values become the current ones
+    for (i = 0; i < nvds_log_txn.nb; i++)
+    {
+        hdr.tag = nvds_log_txn.tag[i];
+        hdr.flags = NVDS_LOG_FLAG_TXN;
+        nvds_log_index(&hdr, off[i]);
+    }
+
+    nvds_log_compact_check();
+
+    return NVDS_OK;
+}
+
+void nvds_txn_abort(void)
+{
+    nvds_log_txn.open = false;
+}
+
+#endif // NVDS_LOG_STRUCTURED
+
+/// @} NVDS_LOG
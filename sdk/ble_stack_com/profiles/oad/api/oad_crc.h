@@ -0,0 +1,31 @@
+/**
+ ****************************************************************************************
+ *
+ * @file oad_crc.h
+ *
+ * @brief Header file - CRC32 verification of the OTA backup image
+ *
+ * Copyright (C) beken 2009-2015
+ *
+ *
+ ****************************************************************************************
+ */
+#ifndef _OAD_CRC_H_
+#define _OAD_CRC_H_
+
+#include <stdint.h>
+
+/**
+ ****************************************************************************************
+ * @brief CRC32 of the image body in the backup area, read as selected by
+ * OAD_CRC_VERIFY_MODE. The read volume and duration are logged.
+ *
+ * @param[in] img_len  Length of the image body in bytes
+ * @param[in] ref_crc  CRC32 expected by the image header
+ *
+ * @return The CRC32 of the image body
+ ****************************************************************************************
+ */
+uint32_t oad_crc_backup_image(uint32_t img_len, uint32_t ref_crc);
+
+#endif /* _OAD_CRC_H_ */
@@ -0,0 +1,100 @@
+/**
+ ****************************************************************************************
+ *
+ * @file oad_crc.c
+ *
+ * @brief CRC32 verification of the OTA backup image, shared by the OAD and
+ * mesh firmware update paths.
+ *
+ * Copyright (C) beken 2009-2015
+ *
+ *
+ ****************************************************************************************
+ */
+
+#include "rwip_config.h"
+#include <string.h>
+#include "flash.h"
+#include "oad_common.h"
+#include "oad_crc.h"
+#include "lld_evt.h"         // BLE time, for the verification duration
+#include "mesh_log.h"
+
+#if (OAD_CRC_VERIFY_MODE == OAD_CRC_VERIFY_STREAM)
+/*
+ * Accumulate the CRC32 of the backup image body, reading each flash window once.
+ * Returns the number of bytes read through @p bytes_read for statistics.
+ */
+static uint32_t oad_crc_pass(uint32_t total_len, uint32_t *bytes_read)
+{
+    uint8_t data[OAD_CRC_READ_SIZE];
+    uint32_t read_addr = SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR;
+    uint32_t crc = 0xffffffff;
+    uint32_t rd_len;
+
+    while (total_len)
+    {
+        rd_len = (total_len > OAD_CRC_READ_SIZE) ? OAD_CRC_READ_SIZE : total_len;
+        flash_read(0, read_addr, rd_len, data, NULL);
+        crc = make_crc32(crc, data, rd_len);
+        read_addr += rd_len;
+        total_len -= rd_len;
+        *bytes_read += rd_len;
+    }
+
+    return crc;
+}
+#endif
+
+uint32_t oad_crc_backup_image(uint32_t img_len, uint32_t ref_crc)
+{
+    uint32_t calcuCrc;
+    uint32_t bytes_read = 0;
+    uint32_t slot, fine;
+
+    lld_evt_time_get_us(&slot, &fine);
+
+#if (OAD_CRC_VERIFY_MODE == OAD_CRC_VERIFY_DOUBLE_READ)
+    uint8_t data[BLOCK_SIZE];
+    uint8_t tmp_data[BLOCK_SIZE];
+    uint32_t read_addr = SEC_IMAGE_BACKUP_OAD_IMAGE_FADDR;
+
+    calcuCrc = 0xffffffff;
+    for (uint32_t i = 0; i < img_len / BLOCK_SIZE; i++)
+    {
+        flash_read(0, read_addr, BLOCK_SIZE, data, NULL);
+        flash_read(0, read_addr, BLOCK_SIZE, tmp_data, NULL);
+        bytes_read += 2 * BLOCK_SIZE;
+        calcuCrc = make_crc32(calcuCrc, data, BLOCK_SIZE);
+        read_addr+= BLOCK_SIZE;
+
+        if (memcmp(data, tmp_data, BLOCK_SIZE) != 0)
+        {
+            MESH_APP_PRINT_INFO("read_addr error = 0x08%x\r\n", read_addr);
+            for (int a=0; a<BLOCK_SIZE; a++)
+            {
+                MESH_APP_PRINT_INFO("tmp_data = %02x,data = %02x \r\n", tmp_data[a], data[a]);
+            }
+        }
+    }
+#else
+    calcuCrc = oad_crc_pass(img_len, &bytes_read);
+
+    // A disturbed read can only make the CRC mismatch, so a confirmatory pass
+    // is needed only to tell a transient read error from a bad image.
+    if (ref_crc != calcuCrc)
+    {
+        uint32_t confirmCrc = oad_crc_pass(img_len, &bytes_read);
+
+        if (confirmCrc != calcuCrc)
+        {
+            MESH_APP_PRINT_INFO("crc pass unstable 0x%08x/0x%08x\r\n", calcuCrc, confirmCrc);
+            calcuCrc = confirmCrc;
+        }
+    }
+#endif
+
+    MESH_APP_PRINT_INFO("flash bytes read = %d, %d us\r\n", bytes_read, lld_evt_time_elapsed_us(slot, fine));
+
+    return calcuCrc;
+}
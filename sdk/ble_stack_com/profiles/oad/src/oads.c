@@ -218,7 +218,11 @@ uint32_t oad_updating_user_section_pro(void)
         sec_ptr = &bsec;
         wr_addr = sec_ptr->update_offset + (SEC_IMAGE_BACKUP_OAD_HEADER_FADDR);
         len = sec_ptr->data_cnt * 16;
-        flash_write(FLASH_MAIN_BASE_ADDR, wr_addr, len, sec_ptr->data, NULL);
+        // Keep the blocks and retry on the next pass while the queue is full
+        if (flash_wq_push(wr_addr, sec_ptr->data, len) != CO_ERROR_NO_ERROR)
+        {
+            return 0;
+        }
         sec_ptr->update_offset += len;
         sec_ptr->data_cnt = 0;
         bsec.flag_write = 0;
@@ -230,7 +234,9 @@ uint32_t oad_updating_user_section_pro(void)
         sec_ptr = &bsec;
         wr_addr = sec_ptr->update_offset + (SEC_IMAGE_BACKUP_OAD_HEADER_FADDR);
         len = sec_ptr->data_cnt * 16;
-        flash_write(FLASH_MAIN_BASE_ADDR, wr_addr, len, sec_ptr->data, NULL);
+        // Make room for the last blocks, the CRC below flushes the queue again
+        flash_wq_flush();
+        flash_wq_push(wr_addr, sec_ptr->data, len);
         sec_ptr->update_offset += len;
         sec_ptr->data_cnt = 0;
         wdt_disable();
@@ -244,6 +250,7 @@ uint32_t oad_updating_user_section_pro(void)
                 UART_PRINTF("wait for reset!!!\r\n");
             }
             bsec.flag_write = 0;
+            platform_reset_prepare();
             wdt_enable(10);
             while (1);
         }
@@ -292,7 +299,8 @@ uint8_t oadImgIdentifyWrite( uint16_t connHandle, uint16_t length, uint8_t *pVal
         MESH_APP_PRINT_INFO("ImgHdr.ver = %x \r\n", ImgHdr.ver);
         oadBlkTot = rxHdr.len / (OAD_BLOCK_SIZE / HAL_FLASH_WORD_SIZE);
         MESH_APP_PRINT_INFO("oadBlkTot = %x \r\n", oadBlkTot);
-        if (( ImgHdr.ver != rxHdr.ver ) && (oadBlkTot <= OAD_BLOCK_APP_MAX)&&(oadBlkTot != 0) && (rxHdr.rom_ver == ImgHdr.rom_ver))
+        // An image larger than the backup area is refused here, the block writes stay inside it
+        if (( ImgHdr.ver != rxHdr.ver ) && (oadBlkTot <= OAD_BLOCK_APP_MAX) && (oadBlkTot <= SEC_MAX_FSIZE_APP_BLOCK) && (oadBlkTot != 0) && (rxHdr.rom_ver == ImgHdr.rom_ver))
         {
             oad_uid_check_status = 1;
         }
@@ -309,7 +317,7 @@ uint8_t oadImgIdentifyWrite( uint16_t connHandle, uint16_t length, uint8_t *pVal
         MESH_APP_PRINT_INFO("ImgHdr.ver = %x \r\n", ImgHdr.ver);
         oadBlkTot = rxHdr.len / (OAD_BLOCK_SIZE / HAL_FLASH_WORD_SIZE);
         MESH_APP_PRINT_INFO("oadBlkTot = %x \r\n", oadBlkTot);
-        if (((rxHdr.rom_ver != ImgHdr.rom_ver)) && (oadBlkTot <= OAD_BLOCK_STACK_MAX) && (oadBlkTot != 0))
+        if (((rxHdr.rom_ver != ImgHdr.rom_ver)) && (oadBlkTot <= OAD_BLOCK_STACK_MAX) && (oadBlkTot <= SEC_MAX_FSIZE_APP_BLOCK) && (oadBlkTot != 0))
         {
             oad_uid_check_status = 1;
         }
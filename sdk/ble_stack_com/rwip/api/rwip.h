@@ -303,6 +303,18 @@ void rwip_schedule(void);
  */
 uint8_t rwip_sleep(void);
 
+/**
+ ****************************************************************************************
+ * @brief Time left before the next radio event programmed by the Event Arbiter.
+ *
+ * Used to keep long CPU or flash operations of the main loop clear of the radio events.
+ *
+ * @return Time in us, 0 if the event is already due, RWIP_INVALID_TARGET_TIME if no
+ * event is programmed
+ ****************************************************************************************
+ */
+uint32_t rwip_evt_gap_us(void);
+
 #if SYSTEM_SLEEP
 /**
  ****************************************************************************************
@@ -772,6 +772,26 @@ uint8_t rwip_sleep(void)
     return proc_sleep;
 }
 
+uint32_t rwip_evt_gap_us(void)
+{
+    uint32_t current_time, target_time;
+    int32_t gap;
+
+    GLOBAL_INT_DISABLE();
+    current_time = ea_time_get_slot_rounded();
+    target_time = ea_timer_target_get(current_time);
+    GLOBAL_INT_RESTORE();
+
+    if (target_time == RWIP_INVALID_TARGET_TIME)
+    {
+        return (RWIP_INVALID_TARGET_TIME);
+    }
+
+    gap = CLK_DIFF(current_time, target_time);
+
+    return ((gap > 0) ? ((uint32_t)gap * SLOT_SIZE) : 0);
+}
+
 #if (SYSTEM_SLEEP)
 void rwip_wakeup(void)
 {
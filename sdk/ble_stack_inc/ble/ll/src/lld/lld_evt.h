@@ -501,6 +501,27 @@ __INLINE void lld_evt_time_get_us(uint32_t *slot,  uint32_t *slot1)
     //return (ble_finetimecnt_get());
 }
 
+/**
+ ****************************************************************************************
+ * @brief Time elapsed since a sample taken with lld_evt_time_get_us
+ *
+ * @param[in] slot Base time count of the sample
+ * @param[in] fine Fine time count of the sample
+ *
+ * @return The elapsed time in us
+ *
+ ****************************************************************************************
+ */
+__INLINE uint32_t lld_evt_time_elapsed_us(uint32_t slot, uint32_t fine)
+{
+    uint32_t slot_end, fine_end;
+
+    lld_evt_time_get_us(&slot_end, &fine_end);
+
+    // The fine counter counts down within a 625us slot
+    return ((slot_end - slot) & BLE_BASETIMECNT_MASK) * 625 + fine - fine_end;
+}
+
 
 /**
  ****************************************************************************************
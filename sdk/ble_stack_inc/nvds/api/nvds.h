@@ -42,6 +42,7 @@
  */
 #include <stdbool.h>           // boolean definition
 #include <stdint.h>            // integer definition
+#include "flash_map.h"         // NVDS_LOG_STRUCTURED
 
 
 /*
@@ -57,6 +58,12 @@
 
 /// NVDS has 8-bit length tags
 #define NVDS_8BIT_TAGLENGTH      1
+/// NVDS calls from the in-tree sources go to the log-structured backend (nvds_log.h)
+/// when NVDS_LOG_STRUCTURED is set in flash_map.h, next to the sectors it uses
+/// NVDS flash accesses go through the checking wrapper (nvds_flash_chk.h), debug only
+#ifndef NVDS_FLASH_CHK
+#define NVDS_FLASH_CHK           0
+#endif
 
 /// Type of the tag length (8 or 16 bits)
 #if (NVDS_8BIT_TAGLENGTH)
@@ -408,6 +415,21 @@ uint8_t nvds_put(uint16_t tag, nvds_tag_len_t length, uint8_t *buf);
 
 #endif //(NVDS_READ_WRITE == 1)
 
+#if (NVDS_LOG_STRUCTURED)
+#include "nvds_log.h"
+#else // !NVDS_LOG_STRUCTURED
+/// Without the log backend, the puts of a transaction are written one after the other and
+/// a reset may keep only part of them
+#define nvds_txn_begin()                (NVDS_OK)
+#define nvds_txn_put(tag, length, buf)  nvds_put(tag, length, buf)
+#define nvds_txn_commit()               (NVDS_OK)
+#define nvds_txn_abort()
+#endif // NVDS_LOG_STRUCTURED
+
+#if (NVDS_FLASH_CHK)
+#include "nvds_flash_chk.h"
+#endif // NVDS_FLASH_CHK
+
 /// @} NVDS
 
 #endif // _NVDS_H_
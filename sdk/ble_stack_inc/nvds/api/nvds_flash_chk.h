@@ -0,0 +1,136 @@
+/**
+ ****************************************************************************************
+ *
+ * @file nvds_flash_chk.h
+ *
+ * @brief Checked flash access for the Non Volatile Data Storage (NVDS)
+ *
+ ****************************************************************************************
+ */
+
+#ifndef _NVDS_FLASH_CHK_H_
+#define _NVDS_FLASH_CHK_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup NVDS_FLASH_CHK
+ * @ingroup NVDS
+ * @brief Debug wrapper around the flash functions given to nvds_init
+ *
+ *   The flash read/write/erase functions of the NVDS environment are replaced by
+ *   wrappers before the NVDS (ROM or log backend) is initialized. The wrappers:
+ *   - check the NOR rules: a program may only clear bits, an erase must cover whole
+ *     sectors; violations are counted, the access itself is passed through unchanged,
+ *   - count the erases of each flash sector,
+ *   - time each program and erase with the BLE base time and keep a latency histogram,
+ *   - can cut the power after a given number of programmed bytes: the bytes before the
+ *     cut are programmed, the rest of the access and every later one is dropped, then
+ *     the chip is reset by the watchdog without the orderly-reset hooks
+ *     (platform_reset_prepare), as after a brown-out. This exercises the recovery of the storage users (mesh
+ *     storage, light state, OTA progress) on the real flash.
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <stdint.h>
+#include "nvds.h"
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Number of flash sectors tracked for wear
+#ifndef NVDS_FLASH_CHK_SECT_NB
+#define NVDS_FLASH_CHK_SECT_NB      128
+#endif
+/// Size of a flash sector
+#define NVDS_FLASH_CHK_SECT_SIZE    0x1000
+/// Power cut budget meaning no cut is armed
+#define NVDS_FLASH_CHK_CUT_OFF      0xFFFFFFFF
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Latency figures of one kind of flash access
+struct nvds_flash_chk_lat
+{
+    /// Number of accesses timed
+    uint32_t nb;
+    /// Latency in us under which 50 and 99 % of the accesses completed (bucket upper bound)
+    uint32_t p50_us;
+    uint32_t p99_us;
+    /// Longest access in us
+    uint32_t max_us;
+};
+
+/// Report of the checked flash accesses since init
+struct nvds_flash_chk_stats
+{
+    /// Erase count of each flash sector
+    uint16_t erase_cnt[NVDS_FLASH_CHK_SECT_NB];
+    /// Number of bytes programmed
+    uint32_t prog_bytes;
+    /// Program latency
+    struct nvds_flash_chk_lat prog;
+    /// Erase latency
+    struct nvds_flash_chk_lat erase;
+    /// Number of programs that needed a bit to go from 0 to 1 (missing erase)
+    uint32_t bad_prog;
+    /// Number of erases not aligned on sectors
+    uint32_t bad_erase;
+    /// Address of the last bad program or erase
+    uint32_t bad_addr;
+};
+
+/*
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Wrap the flash functions of env, then initialize the NVDS with it.
+ *
+ * @param[in] env  Flash access functions
+ *
+ * @return Status of the NVDS initialization
+ ****************************************************************************************
+ */
+uint8_t nvds_flash_chk_init(struct nvds_env_tag env);
+
+/**
+ ****************************************************************************************
+ * @brief Cut the power once nb more bytes have been programmed.
+ *
+ * @param[in] nb  Number of bytes still programmed, NVDS_FLASH_CHK_CUT_OFF to disarm
+ ****************************************************************************************
+ */
+void nvds_flash_chk_cut_set(uint32_t nb);
+
+/**
+ ****************************************************************************************
+ * @brief Report wear, latency and rule violations of the flash accesses.
+ *
+ * @param[out] stats  Filled with the current figures
+ ****************************************************************************************
+ */
+void nvds_flash_chk_stats_get(struct nvds_flash_chk_stats *stats);
+
+/*
+ * Route nvds_init to the wrapper. nvds_flash_chk.c and nvds_log.c define
+ * NVDS_LOG_INTERNAL to reach the NVDS they sit on.
+ */
+#ifndef NVDS_LOG_INTERNAL
+#undef nvds_init
+#define nvds_init(env)                  nvds_flash_chk_init(env)
+#endif // NVDS_LOG_INTERNAL
+
+/// @} NVDS_FLASH_CHK
+
+#endif // _NVDS_FLASH_CHK_H_
@@ -0,0 +1,299 @@
+/**
+ ****************************************************************************************
+ *
+ * @file nvds_log.h
+ *
+ * @brief Log-structured, wear-levelled Non Volatile Data Storage (NVDS) backend
+ *
+ ****************************************************************************************
+ */
+
+#ifndef _NVDS_LOG_H_
+#define _NVDS_LOG_H_
+
+/**
+ ****************************************************************************************
+ * @addtogroup NVDS_LOG
+ * @ingroup NVDS
+ * @brief Append-only NVDS spread over several flash sectors
+ *
+ *   Every put appends a record to the active sector; a record only counts once its
+ *   state byte has been programmed, so a reset in the middle of a put leaves the
+ *   previous value in place. A RAM index keeps the flash offset of the newest record
+ *   of each tag, so a get is a single flash read. When the active sector is full the
+ *   next sector of the ring is opened and the oldest sector is garbage-collected:
+ *   its live records are copied forward and it is erased, which makes every sector
+ *   see the same number of erases.
+ *
+ *   Only the application and mesh tags (NVDS_LOG_TAG_FIRST to NVDS_LOG_TAG_NB) are kept
+ *   in the log. The other tags stay in the ROM NVDS, which the ROM stack and the
+ *   precompiled libraries keep using directly, so that they see every write of a tag
+ *   they own. A tag of the log absent from it is read from the ROM NVDS, which carries
+ *   the values written before the log was enabled.
+ *
+ *   Related tags can be written all-or-nothing with nvds_txn_begin / nvds_txn_put /
+ *   nvds_txn_commit. The puts are staged in RAM; the commit appends them flagged with
+ *   the transaction id, followed by a sealing record. Transaction records only reach the
+ *   index once their seal is found, so a reset before the seal keeps every old value.
+ *
+ *   With NVDS_LOG_COMPACT_BG, the oldest sector is collected by a mesh deferred job once
+ *   the active sector runs below NVDS_LOG_COMPACT_WATERMARK free bytes, a few records per
+ *   job. A put only collects inline when the active sector is full.
+ *
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include <stdint.h>
+#include "nvds.h"
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Base address of the log area, in the storage sectors kept above the OTA backup area
+/// (flash_map.h)
+#ifndef NVDS_LOG_BASE_ADDR
+#define NVDS_LOG_BASE_ADDR          FLASH_NVDS_LOG_ADDR
+#endif
+/// Number of sectors of the log area (at least 2, one is always kept erased). More than 2
+/// needs a lower NVDS_LOG_BASE_ADDR and storage area
+#ifndef NVDS_LOG_SECT_NB
+#define NVDS_LOG_SECT_NB            2
+#endif
+/// Size of a flash sector
+#define NVDS_LOG_SECT_SIZE          0x1000
+/// Number of tags tracked by the RAM index
+#define NVDS_LOG_TAG_NB             0xFF
+/// First tag kept in the log. The tags below belong to the ROM stack, which reads them from
+/// the ROM NVDS directly, so they stay there
+#define NVDS_LOG_TAG_FIRST          NVDS_TAG_APP_SPECIFIC_FIRST
+/// Tag kept in the log rather than in the ROM NVDS
+#define NVDS_LOG_TAG_IN_LOG(tag)    (((tag) >= NVDS_LOG_TAG_FIRST) && ((tag) < NVDS_LOG_TAG_NB))
+
+/// Sector header magic ("NVDL")
+#define NVDS_LOG_SECT_MAGIC         0x4C44564E
+/// Sequence number of a sector that is erased and not yet opened
+#define NVDS_LOG_SEQ_FREE           0xFFFFFFFF
+
+/// Record state before commit (erased flash)
+#define NVDS_LOG_REC_PENDING        0xFF
+/// Record state once the record is complete
+#define NVDS_LOG_REC_VALID          0x00
+
+/// Record flag: tombstone of a deleted tag
+#define NVDS_LOG_FLAG_DEL           0x01
+/// Record flag: the tag is locked
+#define NVDS_LOG_FLAG_LOCK          0x02
+/// Record flag: part of the transaction given in rsvd, valid once sealed
+#define NVDS_LOG_FLAG_TXN           0x04
+/// Record flag: seals the transaction given in rsvd (tag NVDS_LOG_TAG_NB, no data)
+#define NVDS_LOG_FLAG_SEAL          0x08
+
+/// Maximum number of puts in a transaction
+#ifndef NVDS_TXN_TAG_MAX
+#define NVDS_TXN_TAG_MAX            8
+#endif
+/// Size of the RAM buffer staging the data of a transaction
+#ifndef NVDS_TXN_BUF_SIZE
+#define NVDS_TXN_BUF_SIZE           256
+#endif
+
+/// Collect the oldest sector in the background with a mesh deferred job
+#ifndef NVDS_LOG_COMPACT_BG
+#define NVDS_LOG_COMPACT_BG         1
+#endif
+/// Free bytes of the active sector under which the background collection starts
+#ifndef NVDS_LOG_COMPACT_WATERMARK
+#define NVDS_LOG_COMPACT_WATERMARK  1024
+#endif
+/// Records copied per deferred job, the sector erase takes a job of its own
+#ifndef NVDS_LOG_COMPACT_SLICE
+#define NVDS_LOG_COMPACT_SLICE      4
+#endif
+
+/// Size of a record holding len data bytes, records are word aligned
+#define NVDS_LOG_REC_SIZE(len)      (sizeof(struct nvds_log_rec_hdr) + (((len) + 3) & ~3))
+
+#if (NVDS_LOG_SECT_NB < 2) || (NVDS_LOG_SECT_NB * NVDS_LOG_SECT_SIZE > 0x10000)
+#error "NVDS_LOG_SECT_NB out of range"
+#endif
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Header at the start of each sector
+struct nvds_log_sect_hdr
+{
+    /// NVDS_LOG_SECT_MAGIC once the sector has been formatted
+    uint32_t magic;
+    /// Number of times the sector has been erased
+    uint32_t erase_cnt;
+    /// Sequence number given when the sector is opened, NVDS_LOG_SEQ_FREE before
+    uint32_t seq;
+    /// Complement of seq, written after it so that an open cut by a reset is detected
+    uint32_t seq_chk;
+};
+
+/// Header in front of each record
+struct nvds_log_rec_hdr
+{
+    /// Tag
+    uint8_t  tag;
+    /// NVDS_LOG_FLAG_xxx
+    uint8_t  flags;
+    /// Data length
+    uint8_t  len;
+    /// NVDS_LOG_REC_PENDING until the data is written, then NVDS_LOG_REC_VALID
+    uint8_t  state;
+    /// CRC-16 over tag, flags, len and data
+    uint16_t crc;
+    /// Transaction id with NVDS_LOG_FLAG_TXN or NVDS_LOG_FLAG_SEAL, 0xFFFF otherwise
+    uint16_t rsvd;
+};
+
+/// Usage report of the log area
+struct nvds_log_stats
+{
+    /// Erase count of each sector
+    uint32_t erase_cnt[NVDS_LOG_SECT_NB];
+    /// Bytes used by live records
+    uint32_t live_bytes;
+    /// Bytes left in the active sector
+    uint32_t free_bytes;
+    /// Number of sectors garbage-collected since init
+    uint32_t gc_cnt;
+    /// Number of background collection jobs run since init
+    uint32_t compact_job_cnt;
+    /// Number of puts timed since init
+    uint32_t put_nb;
+    /// Latency in us under which 50, 90 and 99 % of the puts completed (bucket upper bound)
+    uint32_t put_p50_us;
+    uint32_t put_p90_us;
+    uint32_t put_p99_us;
+    /// Longest put in us
+    uint32_t put_max_us;
+};
+
+/*
+ * FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Initialize the log area, build the RAM index and initialize the ROM NVDS.
+ *
+ * @param[in] env  Flash access functions, shared with the ROM NVDS
+ *
+ * @return NVDS_OK
+ ****************************************************************************************
+ */
+uint8_t nvds_log_init(struct nvds_env_tag env);
+
+/**
+ ****************************************************************************************
+ * @brief Erase the log area and the ROM NVDS.
+ ****************************************************************************************
+ */
+void nvds_log_deinit(void);
+
+/**
+ ****************************************************************************************
+ * @brief Read the newest value of a tag, see @ref nvds_get.
+ ****************************************************************************************
+ */
+uint8_t nvds_log_get(uint16_t tag, nvds_tag_len_t *lengthPtr, uint8_t *buf);
+
+/**
+ ****************************************************************************************
+ * @brief Append a new value of a tag, see @ref nvds_put.
+ ****************************************************************************************
+ */
+uint8_t nvds_log_put(uint16_t tag, nvds_tag_len_t length, uint8_t *buf);
+
+/**
+ ****************************************************************************************
+ * @brief Append a tombstone for a tag, see @ref nvds_del.
+ ****************************************************************************************
+ */
+uint8_t nvds_log_del(uint16_t tag);
+
+/**
+ ****************************************************************************************
+ * @brief Re-append a tag with its lock flag set, see @ref nvds_lock.
+ ****************************************************************************************
+ */
+uint8_t nvds_log_lock(uint16_t tag);
+
+/**
+ ****************************************************************************************
+ * @brief Report erase counts, space usage and put latency of the log area.
+ *
+ * @param[out] stats  Filled with the current figures
+ ****************************************************************************************
+ */
+void nvds_log_stats_get(struct nvds_log_stats *stats);
+
+/**
+ ****************************************************************************************
+ * @brief Start staging a transaction, dropping one left open.
+ *
+ * @return NVDS_OK, NVDS_FAIL if the log area is not ready
+ ****************************************************************************************
+ */
+uint8_t nvds_txn_begin(void);
+
+/**
+ ****************************************************************************************
+ * @brief Stage a put in the open transaction. Nothing is written before the commit.
+ *
+ * @param[in] tag     Tag of the log, see NVDS_LOG_TAG_IN_LOG (tags kept in the ROM NVDS
+ *                    cannot be part of a transaction)
+ * @param[in] length  Data length
+ * @param[in] buf     Data, copied
+ *
+ * @return NVDS_OK, NVDS_NO_SPACE_AVAILABLE if the staging buffer is full,
+ *         NVDS_PARAM_LOCKED for a locked tag, NVDS_FAIL otherwise
+ ****************************************************************************************
+ */
+uint8_t nvds_txn_put(uint16_t tag, nvds_tag_len_t length, uint8_t *buf);
+
+/**
+ ****************************************************************************************
+ * @brief Write the staged puts and seal them; either all of them or none survive a reset.
+ *
+ * @return NVDS_OK, NVDS_NO_SPACE_AVAILABLE if the transaction does not fit in a sector,
+ *         NVDS_FAIL if no transaction is open
+ ****************************************************************************************
+ */
+uint8_t nvds_txn_commit(void);
+
+/**
+ ****************************************************************************************
+ * @brief Drop the staged puts of the open transaction.
+ ****************************************************************************************
+ */
+void nvds_txn_abort(void);
+
+/*
+ * Route the in-tree NVDS users to the log backend. nvds_log.c defines
+ * NVDS_LOG_INTERNAL to keep access to the ROM functions.
+ */
+#ifndef NVDS_LOG_INTERNAL
+#define nvds_init(env)                  nvds_log_init(env)
+#define nvds_deinit()                   nvds_log_deinit()
+#define nvds_get(tag, lengthPtr, buf)   nvds_log_get(tag, lengthPtr, buf)
+#define nvds_put(tag, length, buf)      nvds_log_put(tag, length, buf)
+#define nvds_del(tag)                   nvds_log_del(tag)
+#define nvds_lock(tag)                  nvds_log_lock(tag)
+#endif // NVDS_LOG_INTERNAL
+
+/// @} NVDS_LOG
+
+#endif // _NVDS_LOG_H_
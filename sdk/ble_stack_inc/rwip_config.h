@@ -791,6 +791,7 @@ enum KE_EVENT_TYPE
     KE_EVENT_BLE_AUDIO_DEFER = 16,
 #endif // defined(CFG_AUDIO_AOAHI)
     KE_EVENT_AOS_CLI = 17,
+    KE_EVENT_FLASH_ERASE = 18,
     KE_EVENT_MAX        = 32,
 };
 
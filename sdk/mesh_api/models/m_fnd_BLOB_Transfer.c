@@ -567,6 +567,11 @@ __STATIC void m_fnd_blob_handler_obj_obj(mesh_tb_buf_t *p_buf, uint8_t opcode)
             MESH_MODEL_PRINT_DEBUG("Object Size = 0x%x\r\n", start->Object_Size);
             p_m_fnd_blob_env->Object_size = start->Object_Size;
             p_m_fnd_blob_env->block_size_log = start->Block_Size_Log;
+            // The object is received in the backup area
+            if (start->Object_Size > SEC_MAX_FSIZE_BYTE)
+            {
+                stat = BLOB_TRANS_STATUS_NOT_SUPPORTED;
+            }
             MESH_MODEL_PRINT_DEBUG("Current Block Size Log = 0x%x\r\n", start->Block_Size_Log);
             // m_fnd_blob_send_model_obj_trans_status();
 
@@ -596,6 +601,26 @@ __STATIC void m_fnd_blob_handler_obj_obj(mesh_tb_buf_t *p_buf, uint8_t opcode)
     m_fnd_blob_process_next();
 }
 
+/**
+ ****************************************************************************************
+ * @brief Start erasing the backup sector of the current block in the background.
+ * Chunk writes of the block are queued behind the erase by the flash driver.
+ ****************************************************************************************
+ */
+__STATIC void m_fnd_blob_erase_block(void)
+{
+    uint32_t erase_addr = SEC_IMAGE_BACKUP_OAD_HEADER_FADDR + p_m_fnd_blob_env->Block_Number * 0x1000;
+
+    // Refused at block start, checked again as it erases a whole sector
+    if ((erase_addr + 0x1000) > SEC_IMAGE_BACKUP_ALLOC_END_FADDR)
+    {
+        return;
+    }
+
+    MESH_MODEL_PRINT_DEBUG("flash_erase_async addr = 0x%08x\r\n", erase_addr);
+    flash_erase_async(erase_addr, 0x1000, NULL);
+}
+
 /**
  ****************************************************************************************
  * @brief Handle Blob Transfer Model Block Transfer Start or Block Get
@@ -652,6 +677,16 @@ __STATIC void m_fnd_blob_handler_obj_blk(mesh_tb_buf_t *p_buf, uint8_t opcode)
 
         p_m_fnd_blob_env->Block_Number = start->Block_Number;
         p_m_fnd_blob_env->Block_Checksum_Value = start->Block_Checksum_Value;
+
+        // Blocks past the backup area would reach the storage sectors above it
+        if ((SEC_IMAGE_BACKUP_OAD_HEADER_FADDR + (p_m_fnd_blob_env->Block_Number + 1) * 0x1000) > SEC_IMAGE_BACKUP_ALLOC_END_FADDR)
+        {
+            MESH_MODEL_PRINT_DEBUG("Block_Number 0x%x past the backup area\r\n", start->Block_Number);
+            p_m_fnd_blob_env->Current_Chunk_Mask = 0;
+            m_fnd_blob_send_model_obj_blk_trans_status(BLOB_BLK_TRANS_STATUS_INVALID_BLOCK_NUMBLE);
+            m_fnd_blob_process_next();
+            return;
+        }
         MESH_MODEL_PRINT_DEBUG("Block_Number = 0x%x\r\n", start->Block_Number);
         MESH_MODEL_PRINT_DEBUG("Chunk_Size = 0x%x\r\n", start->Chunk_Size);
         MESH_MODEL_PRINT_DEBUG("Checksum_Algorithm = 0x%x\r\n", start->Block_Checksum_Algorithm);
@@ -684,6 +719,8 @@ __STATIC void m_fnd_blob_handler_obj_blk(mesh_tb_buf_t *p_buf, uint8_t opcode)
                 {
                     MESH_MODEL_PRINT_DEBUG("nvds_put---NVDS_TAG_MESH_OTA_INFO fail 1 !!!!\r\n");
                 }
+                // Erase after the NVDS update so that it does not wait for it
+                m_fnd_blob_erase_block();
             }
 
         }
@@ -705,6 +742,7 @@ __STATIC void m_fnd_blob_handler_obj_blk(mesh_tb_buf_t *p_buf, uint8_t opcode)
             {
                 MESH_MODEL_PRINT_DEBUG("nvds_put---NVDS_TAG_MESH_OTA_INFO fail 2!!!!\r\n");
             }
+            m_fnd_blob_erase_block();
 
         }
 
@@ -759,22 +797,24 @@ __STATIC void m_fnd_blob_handler_obj_chunk(mesh_tb_buf_t *p_buf, uint8_t opcode)
         MESH_MODEL_PRINT_DEBUG("Chunk_Number = 0x%x\r\n", chunk->Chunk_Number);
         MESH_MODEL_PRINT_DEBUG("Current_Block_Size = 0x%x\r\n", p_m_fnd_blob_env->Current_Block_Size);
 
-        p_m_fnd_blob_env->Receive_Chunk_Mask |= (0x01 << chunk->Chunk_Number);
-        MESH_MODEL_PRINT_DEBUG("chunk_mask = 0x%04x\r\n", p_m_fnd_blob_env->Receive_Chunk_Mask);
-
         write_addr = SEC_IMAGE_BACKUP_OAD_HEADER_FADDR + p_m_fnd_blob_env->Block_Number * 0x1000 + chunk->Chunk_Number * 0x100;
 
-        GLOBAL_INT_DISABLE();
-        if ((write_addr % 0x1000) == 0)
+        // Programmed from the idle loop once the block sector erase is over
+        MESH_MODEL_PRINT_DEBUG("flash_write_addr = 0x%08x\r\n", write_addr);
+        // Chunks past the backup area are refused, their block was refused at block start.
+        // Write queue full: leave the chunk missing, the client sends it again.
+        if (((write_addr + p_buf->data_len - 2) > SEC_IMAGE_BACKUP_ALLOC_END_FADDR)
+                || (flash_wq_push(write_addr, chunk->Chunk_Data, p_buf->data_len - 2) != CO_ERROR_NO_ERROR))
         {
-            MESH_MODEL_PRINT_DEBUG("flash_erase addr = 0x%08x\r\n", write_addr);
-            flash_erase(FLASH_MAIN_BASE_ADDR, write_addr, 0x1000, NULL);
+            MESH_MODEL_PRINT_DEBUG("chunk %d not written\r\n", chunk->Chunk_Number);
+            m_fnd_blob_process_next();
+            return;
         }
-        MESH_MODEL_PRINT_DEBUG("flash_write_addr = 0x%08x\r\n", write_addr);
-        flash_write(FLASH_MAIN_BASE_ADDR, write_addr, p_buf->data_len - 2, chunk->Chunk_Data, NULL);
+
+        p_m_fnd_blob_env->Receive_Chunk_Mask |= (0x01 << chunk->Chunk_Number);
+        MESH_MODEL_PRINT_DEBUG("chunk_mask = 0x%04x\r\n", p_m_fnd_blob_env->Receive_Chunk_Mask);
         MESH_MODEL_PRINT_DEBUG("p_buf->data_len = %d,\r\n", p_buf->data_len);
         MESH_MODEL_PRINT_DEBUG("Chunk_data = \r\n");
-        GLOBAL_INT_RESTORE();
         for (int i = 0; i < p_buf->data_len - 2; i++)
         {
 
@@ -786,21 +826,18 @@ __STATIC void m_fnd_blob_handler_obj_chunk(mesh_tb_buf_t *p_buf, uint8_t opcode)
             crc_buf[chunk->Chunk_Number*256 + i] = chunk->Chunk_Data[i];
 
         } MESH_MODEL_PRINT_DEBUG("\r\n");
-        //
-        ota_info.Receive_Chunk_Mask = p_m_fnd_blob_env->Receive_Chunk_Mask;
-        if (NVDS_OK == nvds_put(NVDS_TAG_MESH_OTA_INFO, length, (uint8_t*)&ota_info))
-        {
-
-        }
-        else
-        {
-
-            MESH_MODEL_PRINT_DEBUG("nvds_put(NVDS_TAG_MESH_OTA_INFO fail!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\r\n");
-        }
-
 
         if ( (p_m_fnd_blob_env->Receive_Chunk_Mask == p_m_fnd_blob_env->Current_Chunk_Mask))
         {
+            // The chunk mask is only persisted once the whole block is in flash,
+            // a reset in the middle of a block restarts that block
+            flash_wq_flush();
+            ota_info.Receive_Chunk_Mask = p_m_fnd_blob_env->Receive_Chunk_Mask;
+            if (NVDS_OK != nvds_put(NVDS_TAG_MESH_OTA_INFO, length, (uint8_t*)&ota_info))
+            {
+                MESH_MODEL_PRINT_DEBUG("nvds_put(NVDS_TAG_MESH_OTA_INFO fail!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\r\n");
+            }
+
             GLOBAL_INT_DISABLE();
             crc_value = 0xFFFFFFFF;
             make_crc32_table(0xedb88320);
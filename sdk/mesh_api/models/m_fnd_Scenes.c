@@ -29,12 +29,20 @@
 #include "m_lay.h"
 #include "m_fnd_Scenes.h"
 #include "m_fnd_generic_transition_time.h"
+#include "nvds.h"
+#include "m_tb_store.h"     // NVDS_TAG_MESH_SCENES
+#include "lld_evt.h"        // BLE time, for the recall duration
 /*
  * DEFINES
  ****************************************************************************************
  */
 /// Scene Server SIG Model ID
 #define M_FND_SCENES_MODEL_ID                        (0x1203)
+/// Scene Setup Server SIG Model ID
+#define M_FND_SCENES_SETUP_MODEL_ID                  (0x1204)
+
+/// Largest scene table in NVDS: count, then per scene its number, a mask and the words
+#define M_FND_SCENES_NV_SIZE                         (1 + M_FND_SCENES_STORE_MAX * (3 + 2 * M_FND_SCENES_STATE_NB))
 
 
 
@@ -49,11 +57,28 @@
  * STRUCTURES
  ****************************************************************************************
  */
+/// Scene kept in RAM
+typedef struct
+{
+    /// Scene number, 0 if the entry is free
+    uint16_t scene_number;
+    /// Model states stored with the scene
+    m_fnd_scene_state_t state;
+    /// Duration of the last recall in us, not kept in flash
+    uint32_t recall_us;
+} m_fnd_scene_entry_t;
+
 typedef struct
 {
     uint8_t tid;
     uint16_t target_scenes;
 
+    /// Stored scenes, read from NVDS on first use
+    m_fnd_scene_entry_t table[M_FND_SCENES_STORE_MAX];
+    /// The table has been read from NVDS
+    bool loaded;
+    /// Local index of the Scene Setup Server model
+    m_lid_t setup_lid;
 } m_fnd_scenes_info_t, *m_fnd_scenes_info_p;
 
 /*
@@ -103,11 +128,12 @@ __STATIC uint16_t m_fnd_scenes_buf_alloc(mesh_tb_buf_t **pp_buf, uint16_t data_l
  ****************************************************************************************
  * @brief Push a buffer for transmission (response).
  *
+ * @param[in] model_lid Local index of the model sending the response.
  * @param[in] p_buf     Pointer to the buffer containing the message to send.
  * @param[in] opcode    Operation code
  ****************************************************************************************
  */
-__STATIC void m_fnd_scenes_send(mesh_tb_buf_t *p_buf, uint16_t opcode)
+__STATIC void m_fnd_scenes_send(m_lid_t model_lid, mesh_tb_buf_t *p_buf, uint16_t opcode)
 {
     // Retrieve buffer containing the message for which a response is sent
     mesh_tb_buf_t *p_buf_req = (mesh_tb_buf_t *)co_list_pick(&p_m_fnd_env->process_queue);
@@ -118,7 +144,7 @@ __STATIC void m_fnd_scenes_send(mesh_tb_buf_t *p_buf, uint16_t opcode)
 
     MESH_MODEL_PRINT_INFO("%s\r\n", __func__);
     // Send the provided message
-    m_api_model_rsp_send(p_m_fnd_env->model_lid, (uint32_t)opcode, 0,
+    m_api_model_rsp_send(model_lid, (uint32_t)opcode, 0,
                          p_buf, p_env->app_lid, dst, false, false);
 }
 
@@ -183,6 +209,7 @@ static void m_fnd_scene_trans_step_change(const m_fnd_model_env_p pmodel_info, u
     set_data.scene_number = ptarget->target_scenes;
     set_data.total_time = total_time;
     set_data.remaining_time = remaining_time;
+    set_data.p_state = NULL;
     if (NULL != pmodel_info->model_data_cb)
     {
         pmodel_info->model_data_cb(pmodel_info, M_FND_SCENE_SERVER_RECALL, &set_data);
@@ -237,7 +264,7 @@ __STATIC void m_fnd_scenes_send_model_status(m_fnd_scenes_status_t status, uint8
         MESH_MODEL_PRINT_INFO("current_scene = 0x%x,target_scene = 0x%x\r\n", p_status->current_scene, p_status->target_scene);
 
         // Send the message
-        m_fnd_scenes_send(p_buf_status, M_FND_SCENES_OPCODE_STATUS); //
+        m_fnd_scenes_send(p_m_fnd_env->model_lid, p_buf_status, M_FND_SCENES_OPCODE_STATUS); //
     }
 }
 
@@ -245,13 +272,14 @@ __STATIC void m_fnd_scenes_send_model_status(m_fnd_scenes_status_t status, uint8
  ****************************************************************************************
  * @brief Prepare and send a scenes Model register Status message.
  *
+ * @param[in] model_lid     Local index of the model sending the response.
  * @param[in] status        Handling status for the command that triggered sending of this message.
  * @param[in] p_msg         Pointer to the genonoffs_onoff_status message.
  * @param[in] vendor        True if model identifier is a vendor model identifier.
  ****************************************************************************************
  */
 
-__STATIC void m_fnd_scenes_send_model_register_status(m_fnd_scenes_register_status_t status, uint8_t scene_cnt)
+__STATIC void m_fnd_scenes_send_model_register_status(m_lid_t model_lid, m_fnd_scenes_register_status_t status, uint8_t scene_cnt)
 {
     MESH_MODEL_PRINT_INFO("%s\r\n", __func__);
     // Pointer to the buffer that will contain the message
@@ -276,13 +304,132 @@ __STATIC void m_fnd_scenes_send_model_register_status(m_fnd_scenes_register_stat
             MESH_MODEL_PRINT_INFO("scene[%d] = 0x%x\r\n", i, p_status->scenes[i]);
         }
         // Send the message
-        m_fnd_scenes_send(p_buf_status, M_FND_SCENES_2B_OPCODE(M_FND_SCENES_OPCODE_REGISTER_STATUS));
+        m_fnd_scenes_send(model_lid, p_buf_status, M_FND_SCENES_2B_OPCODE(M_FND_SCENES_OPCODE_REGISTER_STATUS));
     }
 
 }
 
 
 
+/**
+ ****************************************************************************************
+ * @brief Read the scene table from NVDS the first time it is needed.
+ *
+ * Each scene is stored as its number, a mask of the state words differing from the
+ * previous scene and those words only, so that scenes sharing most of their states take
+ * little room.
+ ****************************************************************************************
+ */
+__STATIC void m_fnd_scenes_table_load(m_fnd_scenes_info_p pscenes_info)
+{
+    uint8_t buf[M_FND_SCENES_NV_SIZE];
+    nvds_tag_len_t len = sizeof(buf);
+    uint16_t prev[M_FND_SCENES_STATE_NB] = {0};
+    m_fnd_scene_entry_t *p_entry;
+    uint16_t pos = 1;
+    uint8_t mask;
+    uint8_t nb;
+    uint8_t i, j;
+
+    if (pscenes_info->loaded)
+    {
+        return;
+    }
+
+    pscenes_info->loaded = true;
+
+    if ((nvds_get(NVDS_TAG_MESH_SCENES, &len, buf) != NVDS_OK) || (len == 0))
+    {
+        return;
+    }
+
+    nb = co_min(buf[0], M_FND_SCENES_STORE_MAX);
+
+    for (i = 0; (i < nb) && (pos + 3 <= len); i++)
+    {
+        p_entry = &pscenes_info->table[i];
+        p_entry->scene_number = buf[pos] | (buf[pos + 1] << 8);
+        mask = buf[pos + 2];
+        pos += 3;
+
+        for (j = 0; j < M_FND_SCENES_STATE_NB; j++)
+        {
+            if ((mask & CO_BIT(j)) && (pos + 2 <= len))
+            {
+                prev[j] = buf[pos] | (buf[pos + 1] << 8);
+                pos += 2;
+            }
+
+            p_entry->state.val[j] = prev[j];
+        }
+    }
+
+    MESH_MODEL_PRINT_INFO("%s, %d scenes, %d bytes\r\n", __func__, i, len);
+}
+
+/// Write the scene table to NVDS, see m_fnd_scenes_table_load for the format
+__STATIC void m_fnd_scenes_table_save(m_fnd_scenes_info_p pscenes_info)
+{
+    uint8_t buf[M_FND_SCENES_NV_SIZE];
+    const uint16_t zero[M_FND_SCENES_STATE_NB] = {0};
+    const uint16_t *p_prev = zero;
+    m_fnd_scene_entry_t *p_entry;
+    uint16_t pos = 1;
+    uint16_t mask_pos;
+    uint8_t nb = 0;
+    uint8_t i, j;
+
+    for (i = 0; i < M_FND_SCENES_STORE_MAX; i++)
+    {
+        p_entry = &pscenes_info->table[i];
+        if (p_entry->scene_number == 0)
+        {
+            continue;
+        }
+
+        buf[pos] = p_entry->scene_number & 0xFF;
+        buf[pos + 1] = p_entry->scene_number >> 8;
+        mask_pos = pos + 2;
+        buf[mask_pos] = 0;
+        pos += 3;
+
+        for (j = 0; j < M_FND_SCENES_STATE_NB; j++)
+        {
+            if (p_entry->state.val[j] != p_prev[j])
+            {
+                buf[mask_pos] |= CO_BIT(j);
+                buf[pos] = p_entry->state.val[j] & 0xFF;
+                buf[pos + 1] = p_entry->state.val[j] >> 8;
+                pos += 2;
+            }
+        }
+
+        p_prev = p_entry->state.val;
+        nb++;
+    }
+
+    buf[0] = nb;
+    nvds_put(NVDS_TAG_MESH_SCENES, pos, buf);
+}
+
+/// Find a stored scene, NULL if not stored
+__STATIC m_fnd_scene_entry_t *m_fnd_scenes_table_find(m_fnd_scenes_info_p pscenes_info, uint16_t scene_number)
+{
+    uint8_t i;
+
+    m_fnd_scenes_table_load(pscenes_info);
+
+    for (i = 0; i < M_FND_SCENES_STORE_MAX; i++)
+    {
+        if ((pscenes_info->table[i].scene_number != 0) && (pscenes_info->table[i].scene_number == scene_number))
+        {
+            return &pscenes_info->table[i];
+        }
+    }
+
+    return NULL;
+}
+
 /**
  ****************************************************************************************
  * @brief Handle Scene Get ,recall or recall unack message
@@ -354,24 +501,45 @@ __STATIC void m_fnd_scenes_handler_recall(mesh_tb_buf_t *p_buf, uint8_t opcode)
                 MESH_MODEL_PRINT_INFO("Transition_Time = 0x%02x,", pmsg->trans_time.num_steps);
 
             }
-            if (M_IS_SCENES_VALID(pmsg->scene_number))
+            m_fnd_scene_entry_t *p_entry = m_fnd_scenes_table_find(pscenes_info, pmsg->scene_number);
+
+            if (M_IS_SCENES_VALID(pmsg->scene_number) && (p_entry == NULL))
+            {
+                if (opcode == M_FND_SCENES_OPCODE_RECALL)
+                {
+                    m_fnd_scenes_status_t status;
+
+                    status.status_code = SCENES_NOT_FOUND;
+                    status.current_scene = get_present_scene(p_m_fnd_env);
+                    m_fnd_scenes_send_model_status(status, 0);
+                }
+            }
+            else if (M_IS_SCENES_VALID(pmsg->scene_number))
             {
+                uint32_t slot, fine;
+
+                lld_evt_time_get_us(&slot, &fine);
+
                 pscenes_info->target_scenes = pmsg->scene_number;
                 pscenes_info->tid = pmsg->tid;
 
                 /* get scene before set */
                 scene_number_before_recall = get_present_scene(p_m_fnd_env);
 
+                // All the stored states go to the application at once, they start one transition
                 m_fnd_scene_server_set_t trans_set_data;
                 trans_set_data.scene_number = pmsg->scene_number;
                 trans_set_data.total_time = trans_time;
                 trans_set_data.remaining_time = trans_time;
+                trans_set_data.p_state = &p_entry->state;
 
                 if (NULL != p_m_fnd_env->model_data_cb)
                 {
                     p_m_fnd_env->model_data_cb(p_m_fnd_env, M_FND_SCENE_SERVER_RECALL, &trans_set_data);
                 }
 
+                p_entry->recall_us = lld_evt_time_elapsed_us(slot, fine);
+
                 if (M_FND_GENERIC_TRANSITION_NUM_STEPS_IMMEDIATE != trans_time.num_steps)
                 {
                     // generic_transition_timer_start(p_m_fnd_env, GENERIC_TRANSITION_TYPE_SCENE, trans_time, m_fnd_scene_trans_step_change);
@@ -429,26 +597,23 @@ __STATIC void m_fnd_scenes_handler_register(mesh_tb_buf_t *p_buf, uint8_t opcode
     {
         m_fnd_scenes_register_status_t status;
 
-        //m_fnd_scenes_info_p pscenes_info = p_m_fnd_env->pargs;
-        m_fnd_scene_server_get_register_t get_data = {0};
-        if (NULL != p_m_fnd_env->model_data_cb)
-        {
-            p_m_fnd_env->model_data_cb(p_m_fnd_env, M_FND_SCENE_SERVER_GET_REGISTER, &get_data);
-        }
+        m_fnd_scenes_info_p pscenes_info = p_m_fnd_env->pargs;
+
+        m_fnd_scenes_table_load(pscenes_info);
         status.status_code = 0;
         status.current_scene = get_present_scene(p_m_fnd_env);
         uint8_t j = 0;
         for (int i = 0 ; i < M_FND_SCENES_STORE_MAX; i ++)
         {
-            if (get_data.scenes[i])
+            if (pscenes_info->table[i].scene_number)
             {
-                status.scenes[j++] = get_data.scenes[i];
+                status.scenes[j++] = pscenes_info->table[i].scene_number;
             }
         }
 
         MESH_MODEL_PRINT_INFO("status_code = 0x%x,current_scene = 0x%x\r\n", status.status_code, status.current_scene);
 
-        m_fnd_scenes_send_model_register_status(status, j);
+        m_fnd_scenes_send_model_register_status(p_m_fnd_env->model_lid, status, j);
 
     }
     // Process next received message
@@ -456,6 +621,61 @@ __STATIC void m_fnd_scenes_handler_register(mesh_tb_buf_t *p_buf, uint8_t opcode
 
 }
 
+/**
+ ****************************************************************************************
+ * @brief Handle Scene Store, Store Unack, Delete or Delete Unack message received by the
+ * Scene Setup Server model.
+ *
+ * @param[in] p_buf     Pointer to the buffer containing the message.
+ * @param[in] opcode    Operation code
+ ****************************************************************************************
+ */
+__STATIC void m_fnd_scenes_handler_store(mesh_tb_buf_t *p_buf, uint8_t opcode)
+{
+    MESH_MODEL_PRINT_INFO("%s,opcode = %x\r\n", __func__, opcode);
+    m_fnd_scenes_info_p pscenes_info = p_m_fnd_env->pargs;
+    m_fnd_scenes_register_status_t status;
+    uint16_t scene_number;
+
+    if (p_buf->data_len == sizeof(m_fnd_scenes_store_t))
+    {
+        memcpy(&scene_number, MESH_TB_BUF_DATA(p_buf), sizeof(scene_number));
+
+        // Scene number 0 is prohibited, the message is ignored
+        if (M_IS_SCENES_VALID(scene_number))
+        {
+            if ((opcode == M_FND_SCENES_OPCODE_STORE) || (opcode == M_FND_SCENES_OPCODE_STORE_UNACK))
+            {
+                status.status_code = m_fnd_scenes_store(scene_number);
+            }
+            else
+            {
+                // Deleting a scene that is not stored is not an error
+                m_fnd_scenes_delete(scene_number);
+                status.status_code = SCENES_SUCCESS;
+            }
+
+            if ((opcode == M_FND_SCENES_OPCODE_STORE) || (opcode == M_FND_SCENES_OPCODE_DELETE))
+            {
+                status.current_scene = get_present_scene(p_m_fnd_env);
+                uint8_t j = 0;
+                for (int i = 0 ; i < M_FND_SCENES_STORE_MAX; i ++)
+                {
+                    if (pscenes_info->table[i].scene_number)
+                    {
+                        status.scenes[j++] = pscenes_info->table[i].scene_number;
+                    }
+                }
+
+                m_fnd_scenes_send_model_register_status(pscenes_info->setup_lid, status, j);
+            }
+        }
+    }
+
+    // Process next received message
+    m_fnd_scenes_process_next();
+}
+
 
 /**
  ****************************************************************************************
@@ -483,6 +703,10 @@ __STATIC void m_fnd_scenes_process(m_api_buf_t *p_buf)
             case (M_FND_SCENES_OPCODE_RECALL)       :
             case (M_FND_SCENES_OPCODE_RECALL_UNACK) : m_fnd_scenes_handler_recall(p_buf, opcode_2b);  break;
             case (M_FND_SCENES_OPCODE_REGISTER_GET) : m_fnd_scenes_handler_register(p_buf, opcode_2b);  break;
+            case (M_FND_SCENES_OPCODE_STORE)        :
+            case (M_FND_SCENES_OPCODE_STORE_UNACK)  :
+            case (M_FND_SCENES_OPCODE_DELETE)       :
+            case (M_FND_SCENES_OPCODE_DELETE_UNACK) : m_fnd_scenes_handler_store(p_buf, opcode_2b);     break;
             default                                 : m_fnd_scenes_process_next();                       break;
         }
     }
@@ -597,6 +821,43 @@ __STATIC void m_fnd_scenes_cb_opcode_check(m_lid_t model_lid, uint32_t opcode)
     m_api_model_opcode_status(model_lid, opcode, status);
 }
 
+#if (M_FND_SCENES_SETUP_SERVER)
+/**
+ ****************************************************************************************
+ * @brief Callback function called upon reception of a message in order to know if the
+ * Scene Setup Server model supports the received operation code.
+ *
+ * @param[in] model_lid     Model local index
+ * @param[in] opcode        Operation code to check
+ ****************************************************************************************
+ */
+__STATIC void m_fnd_scenes_setup_cb_opcode_check(m_lid_t model_lid, uint32_t opcode)
+{
+    // Status
+    uint16_t status = MESH_ERR_NOT_SUPPORTED;
+
+    // Check that opcode is a 2-byte opcode
+    if (MESH_IS_2_OCT_OPCODE(opcode) && M_IS_SCENES_OPCODE(opcode))
+    {
+        switch ((uint8_t)(opcode >> 8))
+        {
+            case M_FND_SCENES_OPCODE_STORE:
+            case M_FND_SCENES_OPCODE_STORE_UNACK:
+            case M_FND_SCENES_OPCODE_DELETE:
+            case M_FND_SCENES_OPCODE_DELETE_UNACK:
+            {
+                status = MESH_ERR_NO_ERROR;
+            } break;
+
+            default:break;
+        }
+    }
+
+    // Indicate if provided operation code is supported or not
+    m_api_model_opcode_status(model_lid, opcode, status);
+}
+#endif //(M_FND_SCENES_SETUP_SERVER)
+
 
 /**
  ****************************************************************************************
@@ -650,6 +911,17 @@ const m_api_model_cb_t m_fnd_scenes_cb =
     .cb_publish_param = m_fnd_scenes_cb_publish_period,
 };
 
+#if (M_FND_SCENES_SETUP_SERVER)
+/// Scene Setup Server Model callback functions
+const m_api_model_cb_t m_fnd_scenes_setup_cb =
+{
+    .cb_rx             = m_fnd_scenes_cb_rx,
+    .cb_sent           = m_fnd_scenes_cb_sent,
+    .cb_opcode_check   = m_fnd_scenes_setup_cb_opcode_check,
+    .cb_publish_param = m_fnd_scenes_cb_publish_period,
+};
+#endif //(M_FND_SCENES_SETUP_SERVER)
+
 
 
 /*
@@ -685,6 +957,13 @@ uint16_t m_fnd_scenes_init(m_fnd_data_cb_p cb)
     m_api_register_model(p_m_fnd_env->model_id, 0, false, &m_fnd_scenes_cb,
                          &p_m_fnd_env->model_lid);
 
+#if (M_FND_SCENES_SETUP_SERVER)
+    m_api_register_model(M_FND_SCENES_SETUP_MODEL_ID, 0, false, &m_fnd_scenes_setup_cb,
+                         &((m_fnd_scenes_info_p)p_m_fnd_env->pargs)->setup_lid);
+#else
+    ((m_fnd_scenes_info_p)p_m_fnd_env->pargs)->setup_lid = p_m_fnd_env->model_lid;
+#endif //(M_FND_SCENES_SETUP_SERVER)
+
     p_m_fnd_env->djob.cb = m_fnd_scenes_process;
 
     // Return environment size
@@ -698,6 +977,82 @@ uint16_t m_fnd_scenes_get_env_size(const m_cfg_t* p_cfg)
     return (sizeof(m_fnd_model_env_t));
 }
 
+uint8_t m_fnd_scenes_store(uint16_t scene_number)
+{
+    m_fnd_scenes_info_p pscenes_info = p_m_fnd_env->pargs;
+    m_fnd_scene_entry_t *p_entry = m_fnd_scenes_table_find(pscenes_info, scene_number);
+    m_fnd_scene_server_store_t store_data;
+    uint8_t i;
+
+    if (!M_IS_SCENES_VALID(scene_number))
+    {
+        return SCENES_NOT_FOUND;
+    }
+
+    for (i = 0; (p_entry == NULL) && (i < M_FND_SCENES_STORE_MAX); i++)
+    {
+        if (pscenes_info->table[i].scene_number == 0)
+        {
+            p_entry = &pscenes_info->table[i];
+        }
+    }
+
+    if (p_entry == NULL)
+    {
+        return SCENES_REGISTER_FULL;
+    }
+
+    memset(&store_data, 0, sizeof(store_data));
+    store_data.scene_number = scene_number;
+
+    if (NULL != p_m_fnd_env->model_data_cb)
+    {
+        p_m_fnd_env->model_data_cb(p_m_fnd_env, M_FND_SCENE_SERVER_STORE, &store_data);
+    }
+
+    // Storing the same states again does not cost a flash write
+    if ((p_entry->scene_number != scene_number)
+            || (memcmp(&p_entry->state, &store_data.state, sizeof(m_fnd_scene_state_t)) != 0))
+    {
+        p_entry->scene_number = scene_number;
+        p_entry->state = store_data.state;
+        p_entry->recall_us = 0;
+        m_fnd_scenes_table_save(pscenes_info);
+    }
+
+    return SCENES_SUCCESS;
+}
+
+uint8_t m_fnd_scenes_delete(uint16_t scene_number)
+{
+    m_fnd_scenes_info_p pscenes_info = p_m_fnd_env->pargs;
+    m_fnd_scene_entry_t *p_entry = m_fnd_scenes_table_find(pscenes_info, scene_number);
+    m_fnd_scenes_delete_t delete_data;
+
+    if (p_entry == NULL)
+    {
+        return SCENES_NOT_FOUND;
+    }
+
+    delete_data.scene_number = scene_number;
+    if (NULL != p_m_fnd_env->model_data_cb)
+    {
+        p_m_fnd_env->model_data_cb(p_m_fnd_env, M_FND_SCENE_SERVER_DELETE, &delete_data);
+    }
+
+    memset(p_entry, 0, sizeof(m_fnd_scene_entry_t));
+    m_fnd_scenes_table_save(pscenes_info);
+
+    return SCENES_SUCCESS;
+}
+
+uint32_t m_fnd_scenes_recall_time_get(uint16_t scene_number)
+{
+    m_fnd_scene_entry_t *p_entry = m_fnd_scenes_table_find(p_m_fnd_env->pargs, scene_number);
+
+    return (p_entry != NULL) ? p_entry->recall_us : 0;
+}
+
 
 
 
@@ -56,6 +56,16 @@
 
 
 #define M_FND_SCENES_STORE_MAX                      (14)
+
+/// Number of 16-bit model state words kept per scene (8 at most, one mask bit per word)
+#ifndef M_FND_SCENES_STATE_NB
+#define M_FND_SCENES_STATE_NB                       (7)
+#endif
+
+/// Register the Scene Setup Server model, which adds a model to the composition data
+#ifndef M_FND_SCENES_SETUP_SERVER
+#define M_FND_SCENES_SETUP_SERVER                   (0)
+#endif
 /*
 * ENUMERATIONS
 ****************************************************************************************
@@ -77,13 +87,28 @@ typedef struct
     generic_transition_time_t trans_time;
 } m_fnd_scene_server_get_default_transition_time_t;
 
+/// Model states kept in a scene, the application gives the meaning of each word
+typedef struct
+{
+    uint16_t val[M_FND_SCENES_STATE_NB];
+} m_fnd_scene_state_t;
+
 typedef struct
 {
     uint16_t scene_number;
     generic_transition_time_t total_time;
     generic_transition_time_t remaining_time;
+    /// States of the recalled scene, to be applied in one batch
+    const m_fnd_scene_state_t *p_state;
 } m_fnd_scene_server_set_t;
 
+/// Data of M_FND_SCENE_SERVER_STORE, the application fills the current states
+typedef struct
+{
+    uint16_t scene_number;
+    m_fnd_scene_state_t state;
+} m_fnd_scene_server_store_t;
+
 
 /*
  * MACROS
@@ -304,6 +329,41 @@ uint16_t m_fnd_scenes_init(m_fnd_data_cb_p cb);
  */
 uint16_t m_fnd_scenes_get_env_size(const m_cfg_t* p_cfg);
 
+/**
+ ****************************************************************************************
+ * @brief Store the current states of the bound models as a scene, as a Scene Store
+ * message would.
+ *
+ * @param[in] scene_number    Scene number, not 0
+ *
+ * @return SCENES_SUCCESS or SCENES_REGISTER_FULL
+ ****************************************************************************************
+ */
+uint8_t m_fnd_scenes_store(uint16_t scene_number);
+
+/**
+ ****************************************************************************************
+ * @brief Delete a scene, as a Scene Delete message would.
+ *
+ * @param[in] scene_number    Scene number
+ *
+ * @return SCENES_SUCCESS or SCENES_NOT_FOUND
+ ****************************************************************************************
+ */
+uint8_t m_fnd_scenes_delete(uint16_t scene_number);
+
+/**
+ ****************************************************************************************
+ * @brief Get the duration of the last recall of a scene, from the handling of the
+ * message to the application having applied the scene states.
+ *
+ * @param[in] scene_number    Scene number
+ *
+ * @return Duration in us, 0 if the scene is not stored or has not been recalled
+ ****************************************************************************************
+ */
+uint32_t m_fnd_scenes_recall_time_get(uint16_t scene_number);
+
 
 
 
@@ -22,8 +22,27 @@
  */
 
 #include "mm_gens_int.h"      // Mesh Model Generic Server Module Internal Definitions
+#include "m_defines.h"        // Mesh Profile Definitions
+#include "m_tb_state.h"       // Mesh Profile State Manager Definitions
 
 #if (BLE_MESH_MDL_GENS)
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Latency of one relay hop up to its first transmission, in milliseconds (relay queue
+/// and first advertising event)
+#ifndef MM_GENS_RELAY_HOP_DELAY_MS
+#define MM_GENS_RELAY_HOP_DELAY_MS      (20)
+#endif
+
+/// Duration of one Relay Retransmit Interval Step, in milliseconds
+#define MM_GENS_RELAY_RETX_STEP_MS      (10)
+
+/// Transition delay step, in milliseconds
+#define MM_GENS_DELAY_STEP_MS           (5)
+
 /*
  * LOCAL FUNCTIONS
  ****************************************************************************************
@@ -350,6 +369,32 @@ void mm_gens_add_to_grp(uint8_t elmt_idx, uint32_t model_id, uint8_t grp_lid)
         mm_tb_bind_group_add_mdl(grp_lid, mdl_lid, model_id, cb_grp_event, cb_set_state);
     }
 }
+
+uint8_t mm_gens_trans_delay(uint8_t delay, mm_route_buf_env_t *p_route_env)
+{
+    // A delay of 0 is applied on reception, a late node cannot catch up
+    if ((delay != 0) && GETB(p_route_env->info, MM_ROUTE_BUF_INFO_RELAY))
+    {
+        // Relay retransmit state
+        uint8_t retx_state;
+        // Hop latency in milliseconds
+        uint16_t hop_ms;
+
+        m_tb_state_get_relay_state(&retx_state);
+
+        // The relays of the network are taken configured as this node. The copy that is
+        // received is on average in the middle of the retransmissions of the hop.
+        hop_ms = MM_GENS_RELAY_HOP_DELAY_MS
+                 + ((GETF(retx_state, M_RETX_NB)
+                     * ((GETF(retx_state, M_RETX_STEP) + 1) * MM_GENS_RELAY_RETX_STEP_MS)) >> 1);
+
+        // The TTL is not reported to the models, a relayed message is counted as one hop
+        hop_ms /= MM_GENS_DELAY_STEP_MS;
+        delay = (delay > hop_ms) ? (delay - hop_ms) : 0;
+    }
+
+    return (delay);
+}
 #if (BLE_MESH_MDL_GENS_BAT)
 void mm_gens_cfm_bat(uint16_t status, uint8_t elmt_idx, uint8_t bat_lvl, uint32_t time_charge,
                      uint32_t time_discharge, uint8_t flags)
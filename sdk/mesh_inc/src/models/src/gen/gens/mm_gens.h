@@ -81,6 +81,24 @@ uint16_t mm_gens_register(uint8_t elmt_idx, uint8_t mdl_cfg_idx, bool main);
  */
 void mm_gens_add_to_grp(uint8_t elmt_idx, uint32_t model_id, uint8_t grp_lid);
 
+/**
+ ****************************************************************************************
+ * @brief Compensate the delay of a received transition for the relay latency
+ *
+ * A relayed message reaches the node later than the nodes in range of the sender. Its
+ * delay is shortened by the latency of a hop, derived from the Relay Retransmit state,
+ * so that all the nodes of a group start and end the transition together. The received
+ * TTL is not provided to the models, a relayed message is counted as a single hop. A
+ * message without delay cannot be compensated, it is applied as soon as it is received.
+ *
+ * @param[in] delay         Delay received in the message, in steps of 5ms
+ * @param[in] p_route_env   Pointer to routing information for the received buffer
+ *
+ * @return Delay to be given to the Binding Manager
+ ****************************************************************************************
+ */
+uint8_t mm_gens_trans_delay(uint8_t delay, mm_route_buf_env_t *p_route_env);
+
 /**
  ****************************************************************************************
  * @brief Function called upon reception of Generic Battery state value for a local element.
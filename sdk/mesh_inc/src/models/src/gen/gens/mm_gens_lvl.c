@@ -356,7 +356,7 @@ __STATIC bool mm_gens_lvl_handler_set(mm_gens_lvl_env_t *p_env_lvl, mesh_tb_buf_
                 break;
             }
 
-            delay = *(p_data + MM_GEN_LVL_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_GEN_LVL_SET_DELAY_POS), p_route_env);
         }
 
         // Check if received message is a retransmitted one, if state is modified and if
@@ -450,7 +450,7 @@ __STATIC bool mm_gens_lvl_handler_set_delta(mm_gens_lvl_env_t *p_env_lvl, mesh_t
                 break;
             }
 
-            delay = *(p_data + MM_GEN_LVL_SET_DELTA_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_GEN_LVL_SET_DELTA_DELAY_POS), p_route_env);
         }
 
         if (delta == 0)
@@ -543,7 +543,7 @@ __STATIC bool mm_gens_lvl_handler_set_move(mm_gens_lvl_env_t *p_env_lvl, mesh_tb
                 break;
             }
 
-            delay = *(p_data + MM_GEN_LVL_SET_MOVE_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_GEN_LVL_SET_MOVE_DELAY_POS), p_route_env);
         }
 
         // Check if received message is a retransmitted one, if state is modified and if
@@ -231,7 +231,7 @@ __STATIC void mm_gens_oo_handler_set(mm_gens_oo_env_t *p_env_oo, mesh_tb_buf_t *
                 break;
             }
 
-            delay = *(p_data + MM_GEN_OO_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_GEN_OO_SET_DELAY_POS), p_route_env);
         }
 
         // Check if received message is a retransmitted one, if state is modified and if
@@ -22,6 +22,7 @@
  */
 
 #include "mm_lights_int.h"      // Mesh Model Lighting Module Internal Definitions
+#include "mm_lights_ctl_conv.h"  // Light CTL Temperature conversions
 #include "uart.h"
 
 #if (BLE_MESH_MDL_LIGHTS_CTL)
@@ -152,6 +153,9 @@ struct mm_lights_ctlt_env
     uint16_t temp_min;
     /// Light CTL Temperature Range Max state value
     uint16_t temp_max;
+    /// Multiplier and shift dividing by the range for Generic Level conversion
+    uint32_t lvl_mul;
+    uint8_t lvl_shift;
 };
 
 /*
@@ -570,25 +574,39 @@ __STATIC void mm_lights_ctl_check_status_rsp(mm_lights_ctl_env_t *p_env_ctl)
 
 /**
  ****************************************************************************************
- * @brief Convert a Generic Level value into a Light CTL Temperature value
+ * @brief Set the Light CTL Temperature Range state and prepare the conversions between
+ * Generic Level and Light CTL Temperature for it.
  *
- * @param[in] lvl           Generic level value
+ * The division by the range in mm_lights_ctl_temp_to_lvl is replaced by a multiplication
+ * and a shift, see mm_lights_ctl_conv_mul. Ranges of 32768 and wider keep the division.
+ *
+ * @param[in] p_env_ctlt    Pointer to Light CTL Temperature Server model environment
  * @param[in] temp_min      Light CTL Temperature Min value
  * @param[in] temp_max      Light CTL Temperature Max value
+ ****************************************************************************************
+ */
+__STATIC void mm_lights_ctl_range_set(mm_lights_ctlt_env_t *p_env_ctlt, uint16_t temp_min,
+                                      uint16_t temp_max)
+{
+    p_env_ctlt->temp_min = temp_min;
+    p_env_ctlt->temp_max = temp_max;
+    p_env_ctlt->lvl_mul = mm_lights_ctl_conv_mul((uint32_t)(temp_max - temp_min),
+                                                 &p_env_ctlt->lvl_shift);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Convert a Generic Level value into a Light CTL Temperature value
+ *
+ * @param[in] lvl           Generic level value
+ * @param[in] p_env_ctlt    Pointer to Light CTL Temperature Server model environment
  *
  * @return Light CTL Temperature value
  ****************************************************************************************
  */
-__STATIC uint16_t mm_lights_ctl_lvl_to_temp(int16_t lvl, uint16_t temp_min, uint16_t temp_max)
+__STATIC uint16_t mm_lights_ctl_lvl_to_temp(int16_t lvl, mm_lights_ctlt_env_t *p_env_ctlt)
 {
-    // Temperature value
-    uint32_t temp = (int32_t)lvl + 32768;
-
-    temp *= (temp_max - temp_min);
-    temp /= 65535;
-    temp += temp_min;
-
-    return ((uint16_t)temp);
+    return (mm_lights_ctl_conv_lvl_to_temp(lvl, p_env_ctlt->temp_min, p_env_ctlt->temp_max));
 }
 
 /**
@@ -596,22 +614,15 @@ __STATIC uint16_t mm_lights_ctl_lvl_to_temp(int16_t lvl, uint16_t temp_min, uint
  * @brief Convert a Light CTL Temperature value into a Generic Level value
  *
  * @param[in] temp          Light CTL Temperature value
- * @param[in] temp_min      Light CTL Temperature Min value
- * @param[in] temp_max      Light CTL Temperature Max value
+ * @param[in] p_env_ctlt    Pointer to Light CTL Temperature Server model environment
  *
  * @return Generic Level value
  ****************************************************************************************
  */
-__STATIC int16_t mm_lights_ctl_temp_to_lvl(uint16_t temp, uint16_t temp_min, uint16_t temp_max)
+__STATIC int16_t mm_lights_ctl_temp_to_lvl(uint16_t temp, mm_lights_ctlt_env_t *p_env_ctlt)
 {
-    // Level value
-    int32_t lvl = ((int32_t)temp - temp_min);
-
-    lvl *= 65535;
-    lvl /= (temp_max - temp_min);
-    lvl -= 32768;
-
-    return ((int16_t)lvl);
+    return (mm_lights_ctl_conv_temp_to_lvl(temp, p_env_ctlt->temp_min, p_env_ctlt->temp_max,
+                                           p_env_ctlt->lvl_mul, p_env_ctlt->lvl_shift));
 }
 
 /**
@@ -699,7 +710,7 @@ __STATIC void mm_lights_ctl_handler_set(mm_lights_ctl_env_t *p_env_ctl, mesh_tb_
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_CTL_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_CTL_SET_DELAY_POS), p_route_env);
         }
         else
         {
@@ -835,7 +846,7 @@ __STATIC void mm_lights_ctl_handler_set_temp(mm_lights_ctlt_env_t *p_env_ctlt, m
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_CTL_TEMP_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_CTL_TEMP_SET_DELAY_POS), p_route_env);
         }
 
         temp = co_read16p(p_data + MM_LIGHT_CTL_TEMP_SET_TEMP_POS);
@@ -997,8 +1008,7 @@ __STATIC void mm_lights_ctl_handler_set_temp_range(mm_lights_ctl_env_t *p_env_ct
                 && ((p_env_ctlt->temp_min != temp_min)
                     || (p_env_ctlt->temp_max != temp_max)))
         {
-            p_env_ctlt->temp_min = temp_min;
-            p_env_ctlt->temp_max = temp_max;
+            mm_lights_ctl_range_set(p_env_ctlt, temp_min, temp_max);
 
             // Inform application about received value
             mm_api_send_srv_state_upd_ind(MM_STATE_LIGHT_CTL_TEMP_RANGE, p_env_ctlt->env.elmt_idx,
@@ -1300,9 +1310,8 @@ __STATIC uint16_t mm_lights_ctl_cb_set(mm_tb_state_mdl_env_t *p_env, uint16_t st
 
         case (MM_STATE_LIGHT_CTL_TEMP_RANGE):
         {
-            // Keep the provided state value
-            p_env_ctlt->temp_min = state;
-            p_env_ctlt->temp_max = state;
+            // Keep the provided state value, Min in the LSBs and Max in the MSBs
+            mm_lights_ctl_range_set(p_env_ctlt, (uint16_t)state, (uint16_t)(state >> 16));
         } break;
 
         default:
@@ -1429,8 +1438,7 @@ uint16_t mm_lights_ctl_register(uint8_t elmt_idx, m_lid_t *p_mdl_lid, m_lid_t *p
         p_cb_srv = p_env_ctlt->env.cb.u.p_cb_srv;
 
         // Set initial range
-        p_env_ctlt->temp_min = MM_LIGHTS_CTL_TEMP_MIN;
-        p_env_ctlt->temp_max = MM_LIGHTS_CTL_TEMP_MAX;
+        mm_lights_ctl_range_set(p_env_ctlt, MM_LIGHTS_CTL_TEMP_MIN, MM_LIGHTS_CTL_TEMP_MAX);
 
         // And initial value
         p_env_ctlt->temp = MM_LIGHTS_CTL_TEMP_MIN;
@@ -1632,8 +1640,7 @@ void mm_lights_ctl_cb_grp_event_temp(m_lid_t mdl_lid, uint8_t event, uint8_t inf
         case (MESH_MDL_GRP_EVENT_GROUP_FULL):
         {
             // Deduce Generic Level state value from Light CTL Temperature state value
-            int16_t lvl = mm_lights_ctl_temp_to_lvl(p_env_ctlt->temp, p_env_ctlt->temp_min,
-                                                    p_env_ctlt->temp_max);
+            int16_t lvl = mm_lights_ctl_temp_to_lvl(p_env_ctlt->temp, p_env_ctlt);
 
             // Set the current Generic Level state value
             mm_tb_bind_set_state(p_env_ctlt->env.grp_lid, MM_STATE_TYPE_CURRENT, MM_ID_GENS_LVL, lvl);
@@ -1770,7 +1777,7 @@ void mm_lights_ctl_cb_trans_req_temp(m_lid_t main_mdl_lid, uint32_t req_model_id
         // Requested Generic Level state value
         int16_t lvl = (int16_t)state_delta;
 
-        temp_tgt = mm_lights_ctl_lvl_to_temp(lvl, p_env_ctlt->temp_min, p_env_ctlt->temp_max);
+        temp_tgt = mm_lights_ctl_lvl_to_temp(lvl, p_env_ctlt);
     }
     else     // ((trans_type == MM_TRANS_TYPE_DELTA) || trans_type == MM_TRANS_TYPE_MOVE))
     {
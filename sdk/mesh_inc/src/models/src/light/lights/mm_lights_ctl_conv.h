@@ -0,0 +1,162 @@
+/**
+ ****************************************************************************************
+ * @file mm_lights_ctl_conv.h
+ *
+ * @brief Mesh Model Light CTL Server Module, Generic Level and Light CTL Temperature
+ * conversions
+ *
+ * Only integer maths, so that mm_lights_ctl_conv_chk.c can check them on a host.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef MM_LIGHTS_CTL_CONV_H_
+#define MM_LIGHTS_CTL_CONV_H_
+
+/**
+ ****************************************************************************************
+ * @defgroup MM_LIGHTS_CTL_CONV Light CTL Temperature conversions
+ * @ingroup MM_LIGHTS_CTL
+ * @brief Light CTL Temperature conversions
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include <stdint.h>             // standard integer definitions
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Build the exhaustive check of the conversions against the division (debug)
+#ifndef MM_LIGHTS_CTL_CONV_CHK
+#define MM_LIGHTS_CTL_CONV_CHK              (0)
+#endif
+
+/// Widest range converted with the multiplier, wider ranges keep the division
+#define MM_LIGHTS_CTL_CONV_RANGE_MAX        (32767)
+
+/*
+ * FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Compute the multiplier replacing the division by the range in
+ * mm_lights_ctl_conv_temp_to_lvl.
+ *
+ * The multiplier is ceil(65535 * 2^shift / range). With 2^shift > range^2 the error stays
+ * below 1 / range so that the quotient is exact, and the multiplier fits in 32 bits for
+ * any range up to MM_LIGHTS_CTL_CONV_RANGE_MAX.
+ *
+ * @param[in] range         Light CTL Temperature Max - Min
+ * @param[out] p_shift      Shift applied after the multiplication
+ *
+ * @return The multiplier, 0 when the range keeps the division
+ ****************************************************************************************
+ */
+static __inline uint32_t mm_lights_ctl_conv_mul(uint32_t range, uint8_t *p_shift)
+{
+    uint8_t shift = 0;
+
+    *p_shift = 0;
+
+    if ((range == 0) || (range > MM_LIGHTS_CTL_CONV_RANGE_MAX))
+    {
+        return (0);
+    }
+
+    while (((uint64_t)1 << shift) <= (uint64_t)range * range)
+    {
+        shift++;
+    }
+
+    *p_shift = shift;
+
+    return ((uint32_t)((((uint64_t)65535 << shift) + range - 1) / range));
+}
+
+/**
+ ****************************************************************************************
+ * @brief Convert a Generic Level value into a Light CTL Temperature value
+ *
+ * @param[in] lvl           Generic level value
+ * @param[in] temp_min      Light CTL Temperature Range Min
+ * @param[in] temp_max      Light CTL Temperature Range Max
+ *
+ * @return Light CTL Temperature value
+ ****************************************************************************************
+ */
+static __inline uint16_t mm_lights_ctl_conv_lvl_to_temp(int16_t lvl, uint16_t temp_min,
+                                                       uint16_t temp_max)
+{
+    // Temperature value
+    uint32_t temp = (int32_t)lvl + 32768;
+
+    temp *= (temp_max - temp_min);
+    // temp / 65535, exact up to 65535 * 65535
+    temp = (temp + (temp >> 16) + 1) >> 16;
+    temp += temp_min;
+
+    return ((uint16_t)temp);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Convert a Light CTL Temperature value into a Generic Level value
+ *
+ * @param[in] temp          Light CTL Temperature value
+ * @param[in] temp_min      Light CTL Temperature Range Min
+ * @param[in] temp_max      Light CTL Temperature Range Max
+ * @param[in] mul           Multiplier of mm_lights_ctl_conv_mul for the range, 0 to divide
+ * @param[in] shift         Shift of mm_lights_ctl_conv_mul for the range
+ *
+ * @return Generic Level value
+ ****************************************************************************************
+ */
+static __inline int16_t mm_lights_ctl_conv_temp_to_lvl(uint16_t temp, uint16_t temp_min,
+                                                      uint16_t temp_max, uint32_t mul,
+                                                      uint8_t shift)
+{
+    // Level value
+    int32_t lvl = ((int32_t)temp - temp_min);
+
+    if ((mul != 0) && (temp <= temp_max) && (lvl >= 0))
+    {
+        // lvl * 65535 / range
+        lvl = (int32_t)(((uint64_t)lvl * mul) >> shift);
+    }
+    else
+    {
+        // Temperature out of the range
+        lvl *= 65535;
+        lvl /= (temp_max - temp_min);
+    }
+    lvl -= 32768;
+
+    return ((int16_t)lvl);
+}
+
+#if (MM_LIGHTS_CTL_CONV_CHK)
+/**
+ ****************************************************************************************
+ * @brief Compare the conversions with the division they replace, for every range and
+ * every Generic Level and in-range Light CTL Temperature value. Takes seconds on a host,
+ * see mm_lights_ctl_conv_chk.c.
+ *
+ * @return Number of values that differ
+ ****************************************************************************************
+ */
+uint32_t mm_lights_ctl_conv_chk(void);
+#endif //(MM_LIGHTS_CTL_CONV_CHK)
+
+/// @} end of group
+
+#endif // MM_LIGHTS_CTL_CONV_H_
@@ -0,0 +1,105 @@
+/**
+ ****************************************************************************************
+ * @file mm_lights_ctl_conv_chk.c
+ *
+ * @brief Mesh Model Light CTL Server Module, exhaustive check of the Light CTL Temperature
+ * conversions (debug)
+ *
+ * Compares mm_lights_ctl_conv.h with the divisions it replaces. Not part of the projects,
+ * run it on a host:
+ *
+ *     gcc -O2 -DMM_LIGHTS_CTL_CONV_CHK=1 -DMM_LIGHTS_CTL_CONV_CHK_MAIN=1 mm_lights_ctl_conv_chk.c
+ *     ./a.out
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup MM_LIGHTS_CTL_CONV
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "mm_lights_ctl_conv.h"
+
+#if (MM_LIGHTS_CTL_CONV_CHK)
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Range Min used for the check, the conversions only depend on the range
+#define MM_LIGHTS_CTL_CONV_CHK_MIN          (0x0320)
+
+/*
+ * GLOBAL FUNCTIONS
+ ****************************************************************************************
+ */
+
+uint32_t mm_lights_ctl_conv_chk(void)
+{
+    uint32_t nb_err = 0;
+    uint32_t range;
+
+    // Every range the Range Min/Max states can give
+    for (range = 1; range <= 0xFFFF; range++)
+    {
+        uint16_t temp_min = (range <= (0xFFFF - MM_LIGHTS_CTL_CONV_CHK_MIN))
+                            ? MM_LIGHTS_CTL_CONV_CHK_MIN : 0;
+        uint16_t temp_max = temp_min + range;
+        uint8_t shift;
+        uint32_t mul = mm_lights_ctl_conv_mul(range, &shift);
+        int32_t lvl;
+        uint32_t temp;
+
+        // Every Generic Level value against (lvl + 32768) * range / 65535
+        for (lvl = -32768; lvl <= 32767; lvl++)
+        {
+            uint32_t ref = ((uint32_t)(lvl + 32768) * range) / 65535 + temp_min;
+
+            if (mm_lights_ctl_conv_lvl_to_temp((int16_t)lvl, temp_min, temp_max) != (uint16_t)ref)
+            {
+                nb_err++;
+            }
+        }
+
+        // Every in-range temperature against (temp - min) * 65535 / range, the
+        // multiplier only applies up to MM_LIGHTS_CTL_CONV_RANGE_MAX
+        for (temp = temp_min; (mul != 0) && (temp <= temp_max); temp++)
+        {
+            int32_t ref = (int32_t)(((uint32_t)(temp - temp_min) * 65535) / range) - 32768;
+
+            if (mm_lights_ctl_conv_temp_to_lvl((uint16_t)temp, temp_min, temp_max, mul, shift)
+                    != (int16_t)ref)
+            {
+                nb_err++;
+            }
+        }
+    }
+
+    return (nb_err);
+}
+
+#if (MM_LIGHTS_CTL_CONV_CHK_MAIN)
+#include <stdio.h>
+
+int main(void)
+{
+    uint32_t nb_err = mm_lights_ctl_conv_chk();
+
+    printf("mm_lights_ctl_conv_chk: %lu error(s)\n", (unsigned long)nb_err);
+
+    return ((nb_err == 0) ? 0 : 1);
+}
+#endif //(MM_LIGHTS_CTL_CONV_CHK_MAIN)
+
+#endif //(MM_LIGHTS_CTL_CONV_CHK)
+
+/// @} end of group
@@ -819,7 +819,7 @@ __STATIC void mm_lights_hsl_handler_set(mm_lights_hsl_env_t *p_env_hsl, mesh_tb_
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_HSL_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_HSL_SET_DELAY_POS), p_route_env);
         }
         else
         {
@@ -976,7 +976,7 @@ __STATIC void mm_lights_hsl_handler_set_hue(mm_lights_hslh_env_t *p_env_hslh, me
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_HSL_HUE_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_HSL_HUE_SET_DELAY_POS), p_route_env);
         }
         else
         {
@@ -1081,7 +1081,7 @@ __STATIC void mm_lights_hsl_handler_set_sat(mm_lights_hslsat_env_t *p_env_hslsat
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_HSL_SAT_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_HSL_SAT_SET_DELAY_POS), p_route_env);
         }
         else
         {
@@ -434,7 +434,7 @@ __STATIC void mm_lights_ln_handler_set(mm_lights_ln_env_t *p_env_ln, mesh_tb_buf
                 break;
             }
 
-            delay = *(p_data + MM_LIGHT_LN_SET_DELAY_POS);
+            delay = mm_gens_trans_delay(*(p_data + MM_LIGHT_LN_SET_DELAY_POS), p_route_env);
         }
 
         if (linear)
@@ -36,6 +36,18 @@
 /// Get first entry in a section
 #define M_TB_STORE_GET_NVDS_TAG(tag)  (NVDS_TAG_MESH_FIRST + tag)
 
+/// Build m_tb_store_config parameter
+///  - period_s:    Period of IV/SEQ check in seconds, 0 disables storage (only m_tb_store_save stores)
+///  - quiet_100ms: Quiet time after last update before storing, in 100ms steps (0 = 1s)
+///  - max_lat_s:   Maximum delay between an update and its store, in seconds (0 = period)
+#define M_TB_STORE_CONFIG(period_s, quiet_100ms, max_lat_s)                                  \
+    (((uint32_t)(period_s) & 0xFFFF) | (((uint32_t)(quiet_100ms) & 0xFF) << 16)              \
+     | (((uint32_t)(max_lat_s) & 0xFF) << 24))
+/// Extract fields of m_tb_store_config parameter
+#define M_TB_STORE_CONFIG_PERIOD(config)    ((config) & 0xFFFF)
+#define M_TB_STORE_CONFIG_QUIET(config)     (((config) >> 16) & 0xFF)
+#define M_TB_STORE_CONFIG_MAX_LAT(config)   (((config) >> 24) & 0xFF)
+
 /*
  * ENUMERATIONS
  ****************************************************************************************
@@ -142,6 +154,24 @@ enum m_tb_store_nvds_tag
 #endif //(BLE_MESH_FRIEND || BLE_MESH_LPN)
 };
 
+/// NVDS tags of the mesh SDK outside of the mesh range. They are taken from the end of the
+/// application specific range (NVDS_TAG_APP_SPECIFIC_LAST) so that they fit on 8 bits;
+/// application tags must end below NVDS_TAG_MESH_SDK_FIRST.
+enum m_tb_store_sdk_nvds_tag
+{
+    NVDS_TAG_MESH_SDK_FIRST             = 0xAD,
+
+    /// Subscription List changes of all models recorded since their last snapshot
+    NVDS_TAG_MESH_SUBS_DELTA            = NVDS_TAG_MESH_SDK_FIRST,
+    /// Binding changes of all models recorded since their last snapshot
+    NVDS_TAG_MESH_BINDINGS_DELTA        = NVDS_TAG_MESH_SDK_FIRST + 1,
+    /// Stored scenes of the Scene Server model (m_fnd_Scenes.c)
+    NVDS_TAG_MESH_SCENES                = NVDS_TAG_MESH_SDK_FIRST + 2,
+    /// Operation count followed by up to 8 operations (opcode, model slot, address or AppKey
+    /// index, Label UUID)
+    NVDS_LEN_MESH_DELTA                 = 1 + 8 * (4 + 16),
+};
+
 /// Update types
 enum m_tb_store_upd_type
 {
@@ -226,6 +256,33 @@ typedef void (*m_tb_store_cb_compo_data_t)(uint8_t page, uint8_t length, uint8_t
  */
 typedef void (*m_tb_store_cb_load_t)(uint16_t status);
 
+/// Storage statistics
+typedef struct m_tb_store_stats
+{
+    /// Number of write-backs performed
+    uint32_t nb_store;
+    /// Number of tags stored
+    uint32_t nb_tag;
+    /// Longest time spent storing a single tag (in milliseconds)
+    uint32_t tag_max_ms;
+    /// Scanner off time of last store performed with scanner stopped (in milliseconds)
+    uint32_t scan_off_last_ms;
+    /// Longest scanner off time (in milliseconds)
+    uint32_t scan_off_max_ms;
+    /// Cumulated scanner off time (in milliseconds)
+    uint32_t scan_off_total_ms;
+    /// Longest time a main loop pass spent storing tags with scanner enabled (in microseconds)
+    uint32_t slice_max_us;
+    /// Number of tag stores which lasted beyond the next radio event
+    uint32_t nb_slice_overrun;
+    /// Number of main loop passes without tag store because next radio event was too close
+    uint32_t nb_slice_defer;
+    /// Number of IV/SEQ stores
+    uint32_t nb_iv_seq;
+    /// Number of sequence numbers reserved by an IV/SEQ store
+    uint32_t seq_reserve;
+} m_tb_store_stats_t;
+
 /*
  * FUNCTION DECLARATIONS
  ****************************************************************************************
@@ -234,6 +291,9 @@ typedef void (*m_tb_store_cb_load_t)(uint16_t status);
 /**
  ****************************************************************************************
  * @brief Configure storage manager behavior
+ *
+ * @param[in] config    Storage configuration (@see M_TB_STORE_CONFIG). A plain period in
+ * seconds keeps default quiet time and stores updates at most one period late.
  ****************************************************************************************
  */
 uint16_t m_tb_store_config(uint32_t config);
@@ -287,11 +347,39 @@ void m_tb_store_get_compo_data(uint8_t page, m_tb_store_cb_compo_data_t cb);
  */
 void m_tb_store_rx_compo_data(uint8_t page, uint8_t length, uint8_t *p_data);
 
+/**
+ ****************************************************************************************
+ * @brief Request IV/SEQ to be stored once the sequence number has gone past the
+ * stored reservation
+ ****************************************************************************************
+ */
+void m_tb_store_iv_seq_update(void);
+
 bool m_tb_store_nvs_check(void);
 
 void m_tb_stop_scan_before_store_nvs(void);
 void m_tb_store_nvs_after_stop_scan(void);
 
+/**
+ ****************************************************************************************
+ * @brief Store tags waiting for a write-back while the next radio event is far enough.
+ * To be called from the main loop between scheduler passes so that storage never stops
+ * the scanner.
+ *
+ * @return True if tags are still waiting to be stored, false otherwise
+ ****************************************************************************************
+ */
+bool m_tb_store_process(void);
+
+/**
+ ****************************************************************************************
+ * @brief Get storage statistics
+ *
+ * @param[out] p_stats      Pointer to statistics to fill
+ ****************************************************************************************
+ */
+void m_tb_store_get_stats(m_tb_store_stats_t *p_stats);
+
 /// @} end of group
 
 #endif //_M_TB_STORE_H_
@@ -0,0 +1,2308 @@
+/**
+ ****************************************************************************************
+ * @file m_tb_store_nvds.c
+ *
+ * @brief Storage Manager Toolbox - NVDS backend
+ *
+ * Copyright (C) RivieraWaves 2017-2019
+ *
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @addtogroup M_TB_STORE
+ * @{
+ ****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+
+#include "m_inc.h"          // Mesh Profile Include Files
+#include "m_tb.h"           // Mesh Toolboxes
+#include "m_tb_int.h"       // Mesh Toolboxes Internals
+#include "m_bearer_int.h"   // Mesh Bearer Layer Internals
+#include "mesh_tb_timer.h"  // Mesh Timer Toolbox
+#include "co_utils.h"
+#include "nvds.h"
+#include "flash.h"
+#include "rwip.h"           // Time left before next radio event
+#include "lld_evt.h"        // BLE time, for the tag store duration
+
+#if (!BLE_MESH_STORAGE_NONE)
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+
+/// Number of NVDS tags handled by the storage manager
+#define M_TB_STORE_NB_TAG                   (NVDS_TAG_MESH_NB)
+/// Number of key slots (network keys followed by application keys)
+#define M_TB_STORE_NB_KEY_SLOT              (M_TB_KEY_MAX_NB_NET + M_TB_KEY_MAX_NB_APP)
+/// Invalid slot or local index
+#define M_TB_STORE_INVALID_SLOT             (0xFF)
+/// Default period between two storage updates (in seconds)
+#define M_TB_STORE_DFT_DELAY_S              (10)
+/// Minimum number of sequence numbers reserved by a stored IV/SEQ (and skipped on load)
+#define M_TB_STORE_SEQ_RESERVE_MIN          (140)
+/// Maximum number of sequence numbers reserved by a stored IV/SEQ
+#define M_TB_STORE_SEQ_RESERVE_MAX          (8192)
+/// Number of periodic checks a reservation lasts at the observed sending rate
+#define M_TB_STORE_SEQ_RESERVE_PERIODS      (32)
+/// Store IV/SEQ in a dedicated flash sector, one record appended per store, instead of
+/// rewriting the NVDS tag. The NVDS tag is only written when the sector is full or the
+/// IV index changes. The sector is one of the storage sectors kept above the OTA backup
+/// area, below the log NVDS area. Enabled by M_TB_STORE_IV_SEQ_SLOT in flash_map.h.
+/// Address of the IV/SEQ sector
+#define M_TB_STORE_IV_SEQ_SLOT_ADDR         (FLASH_IV_SEQ_SLOT_ADDR)
+/// Size of the IV/SEQ sector
+#define M_TB_STORE_IV_SEQ_SLOT_SIZE         (FLASH_IV_SEQ_SLOT_SIZE)
+/// IV/SEQ sector offset not known yet
+#define M_TB_STORE_IV_SEQ_SLOT_UNKNOWN      (0xFFFF)
+
+#if (M_TB_STORE_IV_SEQ_SLOT && (M_TB_STORE_IV_SEQ_SLOT_ADDR < FLASH_STORAGE_START_ADDR))
+#error "IV/SEQ sector outside of the storage sectors"
+#endif
+/// Default quiet time after last update before dirty tags are stored (in milliseconds)
+#define M_TB_STORE_DFT_QUIET_MS             (1000)
+/// Delay before an urgent update (IV/SEQ) is stored (in milliseconds)
+#define M_TB_STORE_URGENT_DELAY_MS          (10)
+/// Stop the scanner and store all dirty tags at once instead of storing tags between radio
+/// events from the main loop (m_tb_store_process) with the scanner kept enabled
+#ifndef M_TB_STORE_STOP_SCAN
+#define M_TB_STORE_STOP_SCAN                (0)
+#endif
+/// Lowest expected duration of a tag store, a tag is only stored if the next radio event is
+/// further away than the expected duration (in microseconds)
+#define M_TB_STORE_SLICE_MIN_US             (625)
+/// Longest time tags wait for a gap between radio events before one is stored anyway (in
+/// milliseconds)
+#define M_TB_STORE_SLICE_WAIT_MAX_MS        (100)
+
+/// Network key record
+#define M_TB_STORE_NET_KEY_FLAGS_POS        (0)
+#define M_TB_STORE_NET_KEY_ID_POS           (2)
+#define M_TB_STORE_NET_KEY_POS              (4)
+#define M_TB_STORE_NET_KEY_NEW_POS          (20)
+#define M_TB_STORE_NET_KEY_LEN              (20)
+/// Network key record flags
+#define M_TB_STORE_NET_KEY_FLAG_NEW         (0x04)
+#define M_TB_STORE_NET_KEY_FLAG_PHASE2      (0x08)
+
+/// Application key record
+#define M_TB_STORE_APP_KEY_FLAGS_POS        (0)
+#define M_TB_STORE_APP_KEY_NET_ID_POS       (2)
+#define M_TB_STORE_APP_KEY_ID_POS           (4)
+#define M_TB_STORE_APP_KEY_POS              (6)
+#define M_TB_STORE_APP_KEY_NEW_POS          (22)
+#define M_TB_STORE_APP_KEY_LEN              (22)
+/// Application key record flags
+#define M_TB_STORE_APP_KEY_FLAG_NEW         (0x01)
+
+/// State record
+#define M_TB_STORE_STATE_LEN                (16)
+#define M_TB_STORE_IV_POS                   (0)
+#define M_TB_STORE_SEQ_POS                  (4)
+/// IV/SEQ record: reservation size, 0 in records written before reservations were adapted
+#define M_TB_STORE_SEQ_RESERVE_POS          (8)
+/// IV/SEQ record: check word, only used in the IV/SEQ sector
+#define M_TB_STORE_IV_SEQ_CHECK_POS         (12)
+
+/// Publication record
+#define M_TB_STORE_PUBLI_FLAGS_POS          (0)
+#define M_TB_STORE_PUBLI_ELT_ADDR_POS       (2)
+#define M_TB_STORE_PUBLI_MODEL_ID_POS       (4)
+#define M_TB_STORE_PUBLI_ADDR_POS           (8)
+#define M_TB_STORE_PUBLI_APP_KEY_ID_POS     (10)
+#define M_TB_STORE_PUBLI_TTL_POS            (12)
+#define M_TB_STORE_PUBLI_PERIOD_POS         (13)
+#define M_TB_STORE_PUBLI_RETX_POS           (14)
+#define M_TB_STORE_PUBLI_FRIEND_CRED_POS    (15)
+#define M_TB_STORE_PUBLI_LABEL_POS          (16)
+#define M_TB_STORE_PUBLI_LEN                (16)
+/// Publication record flags
+#define M_TB_STORE_PUBLI_FLAG_VENDOR        (0x01)
+
+/// Subscription list and binding records: header, element address, model ID, entries
+#define M_TB_STORE_LIST_HDR_POS             (0)
+#define M_TB_STORE_LIST_ELT_ADDR_POS        (2)
+#define M_TB_STORE_LIST_MODEL_ID_POS        (4)
+#define M_TB_STORE_LIST_ENTRY_POS           (8)
+/// List header: number of entries on 7 bits, vendor model bit
+#define M_TB_STORE_LIST_NB_MASK             (0x7F)
+#define M_TB_STORE_LIST_VENDOR_BIT          (0x80)
+
+/// Maximum number of operations in a delta record, all models included
+#define M_TB_STORE_DELTA_NB_MAX             (8)
+/// Delta record operation: opcode, model slot, 16-bit value, Label UUID for a virtual address
+#define M_TB_STORE_DELTA_OP_LEN             (4)
+#define M_TB_STORE_DELTA_OP_SLOT_POS        (1)
+#define M_TB_STORE_DELTA_OP_VAL_POS         (2)
+#define M_TB_STORE_DELTA_OP_ADD             (0x01)
+#define M_TB_STORE_DELTA_OP_DEL             (0x02)
+/// Maximum number of entries in a list folded from a snapshot and its delta record
+#define M_TB_STORE_LIST_ENTRY_MAX           (M_TB_MIO_SUBS_LIST_SIZE + M_TB_STORE_DELTA_NB_MAX)
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+
+/// Load procedure environment
+typedef struct m_tb_store_load_env
+{
+    /// Callback executed at end of load procedure
+    m_tb_store_cb_load_t cb_load;
+    /// Buffer in which stored entries are read
+    uint8_t buf[NVDS_LEN_MESH_SUBS];
+    /// Index of entry being loaded
+    uint8_t idx;
+    /// Number of entries found
+    uint8_t nb_loaded;
+} m_tb_store_load_env_t;
+
+/// Storage manager environment
+typedef struct m_tb_store_env
+{
+    /// Callback executed when a composition data page is received
+    m_tb_store_cb_compo_data_t cb_compo;
+    /// Load procedure environment, allocated only during load
+    m_tb_store_load_env_t *p_load;
+    /// Periodic update timer
+    mesh_tb_timer_t timer;
+    /// Period between two updates (in seconds), 0 if disabled
+    uint32_t delay_s;
+    /// Write-back timer, expires when dirty tags have to be stored
+    mesh_tb_timer_t timer_flush;
+    /// Maximum time between first update and store of dirty tags (in milliseconds)
+    uint32_t max_latency_ms;
+    /// Time of oldest update not stored yet (ms part)
+    uint32_t dirty_time_ms;
+    /// Time of oldest update not stored yet (wrap part)
+    uint16_t dirty_nb_wrap;
+    /// Quiet time after last update before dirty tags are stored (in milliseconds)
+    uint16_t quiet_ms;
+    /// Some tags are dirty and write-back timer is running
+    bool dirty;
+    /// Write-back timer has been programmed for an urgent update
+    bool urgent;
+    /// Dirty tags are being stored from m_tb_store_process
+    bool slicing;
+    /// Next tag to check from m_tb_store_process
+    uint8_t slice_idx;
+    /// Expected duration of a tag store (in microseconds)
+    uint32_t slice_cost_us;
+    /// Time of last tag store from m_tb_store_process (ms part)
+    uint32_t slice_time_ms;
+    /// Time at which scanner has been stopped for a store
+    uint32_t scan_off_time_ms;
+    /// Storage statistics
+    m_tb_store_stats_t stats;
+    /// Key slot for each key local index (indexed by key LID - 1)
+    uint8_t key_slot[M_TB_STORE_NB_KEY_SLOT];
+    /// Key local index for each key slot
+    uint8_t key_lid[M_TB_STORE_NB_KEY_SLOT];
+    /// Model local index for each model slot
+    uint8_t model_lid[M_TB_MIO_MODEL_NB];
+    /// Model slot for each model local index
+    uint8_t model_slot[M_TB_MIO_MODEL_NB];
+    /// Tags waiting to be stored (one bit per tag)
+    uint32_t upd_bits[(M_TB_STORE_NB_TAG + 31) / 32];
+    /// Sequence number up to which sequence numbers are reserved by stored IV/SEQ
+    uint32_t seq;
+    /// Stored IV index
+    uint32_t iv;
+    /// Number of sequence numbers reserved by next IV/SEQ store
+    uint32_t seq_reserve;
+    /// Sequence number at last periodic check
+    uint32_t seq_prev;
+    /// Averaged number of sequence numbers used between two periodic checks (x16)
+    uint32_t seq_rate;
+    #if (M_TB_STORE_IV_SEQ_SLOT)
+    /// Write offset in the IV/SEQ sector
+    uint16_t slot_off;
+    /// NVDS tag exists, IV/SEQ sector records are only checked on top of it
+    bool slot_anchored;
+    #endif //(M_TB_STORE_IV_SEQ_SLOT)
+} m_tb_store_env_t;
+
+/// Subscription list or binding list as seen by the storage manager
+typedef struct m_tb_store_list
+{
+    /// Number of entries
+    uint8_t nb;
+    /// Address or AppKey index of each entry
+    uint16_t val[M_TB_STORE_LIST_ENTRY_MAX];
+    /// Label UUID of each virtual address entry (NULL otherwise)
+    uint8_t *p_label[M_TB_STORE_LIST_ENTRY_MAX];
+} m_tb_store_list_t;
+
+/*
+ * GLOBAL VARIABLES
+ ****************************************************************************************
+ */
+
+/// Storage manager environment
+static m_tb_store_env_t *p_m_tb_store_env;
+/// Store has been requested and will be performed once scanning is stopped
+static bool is_store_nvs;
+
+/*
+ * LOCAL FUNCTION DECLARATIONS
+ ****************************************************************************************
+ */
+
+static void m_tb_store_load_fsm(uint16_t status);
+
+/*
+ * LOCAL FUNCTIONS - UPDATE
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Program write-back of dirty tags.
+ *
+ * Dirty tags are stored once no update has been received for the quiet time, or at the
+ * latest max latency after the first update, so that a burst of configuration messages
+ * writes each touched tag once. An urgent update is stored without waiting.
+ *
+ * @param[in] urgent    True if update must be stored as soon as possible
+ ****************************************************************************************
+ */
+static void m_tb_store_sched(bool urgent)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint32_t delay_ms;
+
+    // Storage disabled, tags are only stored by m_tb_store_save
+    if (p_env->delay_s == 0)
+    {
+        return;
+    }
+
+    if (!p_env->dirty)
+    {
+        mesh_tb_timer_get_cur_time(&p_env->dirty_time_ms, &p_env->dirty_nb_wrap);
+        p_env->dirty = true;
+    }
+
+    if (urgent)
+    {
+        delay_ms = M_TB_STORE_URGENT_DELAY_MS;
+        p_env->urgent = true;
+    }
+    else if (p_env->urgent)
+    {
+        // Flush already programmed sooner than quiet time
+        return;
+    }
+    else
+    {
+        delay_ms = mesh_tb_timer_get_rem_duration(p_env->max_latency_ms, p_env->dirty_time_ms,
+                                                  p_env->dirty_nb_wrap);
+
+        if (delay_ms > p_env->quiet_ms)
+        {
+            delay_ms = p_env->quiet_ms;
+        }
+    }
+
+    mesh_tb_timer_clear(&p_env->timer_flush);
+    mesh_tb_timer_set(&p_env->timer_flush, delay_ms);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Mark a tag as waiting to be stored.
+ *
+ * @param[in] idx       Tag index (relative to NVDS_TAG_MESH_FIRST)
+ ****************************************************************************************
+ */
+static void m_tb_store_set_upd(uint8_t idx)
+{
+    if (idx < M_TB_STORE_NB_TAG)
+    {
+        p_m_tb_store_env->upd_bits[idx >> 5] |= (1UL << (idx & 0x1F));
+
+        m_tb_store_sched(idx == NVDS_TAG_MESH_IV_SEQ);
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Get model slot of a model, allocate a slot if model has none.
+ *
+ * @param[in] model_lid     Model local index
+ *
+ * @return Model slot, M_TB_STORE_INVALID_SLOT if no slot is available
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_get_model_slot(m_lid_t model_lid)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint8_t slot;
+
+    if (model_lid >= M_TB_MIO_MODEL_NB)
+    {
+        return M_TB_STORE_INVALID_SLOT;
+    }
+
+    if (p_env->model_slot[model_lid] == M_TB_STORE_INVALID_SLOT)
+    {
+        for (slot = 0; slot < M_TB_MIO_MODEL_NB; slot++)
+        {
+            if (p_env->model_lid[slot] == M_TB_STORE_INVALID_SLOT)
+            {
+                p_env->model_slot[model_lid] = slot;
+                p_env->model_lid[slot] = model_lid;
+                break;
+            }
+        }
+    }
+
+    return p_env->model_slot[model_lid];
+}
+
+/**
+ ****************************************************************************************
+ * @brief Check if IV/SEQ has to be stored, either because IV index has changed or
+ * because half of the reserved sequence numbers have been used.
+ *
+ * @return True if IV/SEQ has to be stored, false otherwise
+ ****************************************************************************************
+ */
+static bool m_tb_store_iv_seq_due(void)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint32_t iv, seq;
+
+    m_tb_key_get_cur_iv_seq(&seq, &iv);
+
+    return ((iv != p_env->iv) || ((seq + (p_env->seq_reserve >> 1)) >= p_env->seq));
+}
+
+#if (M_TB_STORE_IV_SEQ_SLOT)
+/**
+ ****************************************************************************************
+ * @brief Compute check word of an IV/SEQ record.
+ *
+ * @param[in] p_rec     Pointer to the record
+ *
+ * @return Check word
+ ****************************************************************************************
+ */
+static uint32_t m_tb_store_slot_check(const uint8_t *p_rec)
+{
+    return (~(co_read32p(p_rec + M_TB_STORE_IV_POS) ^ co_read32p(p_rec + M_TB_STORE_SEQ_POS)
+              ^ co_read32p(p_rec + M_TB_STORE_SEQ_RESERVE_POS)));
+}
+
+/**
+ ****************************************************************************************
+ * @brief Read newest record of the IV/SEQ sector and set write offset after it.
+ *
+ * @param[out] p_rec    Pointer to buffer filled with newest record
+ *
+ * @return True if a valid record has been found, false otherwise
+ ****************************************************************************************
+ */
+static bool m_tb_store_slot_scan(uint8_t *p_rec)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint8_t buf[M_TB_STORE_STATE_LEN];
+    uint16_t off;
+    bool found = false;
+
+    for (off = 0; off < M_TB_STORE_IV_SEQ_SLOT_SIZE; off += M_TB_STORE_STATE_LEN)
+    {
+        flash_read(0, M_TB_STORE_IV_SEQ_SLOT_ADDR + off, M_TB_STORE_STATE_LEN, &buf[0], NULL);
+
+        // First erased record, a stored reservation is never 0xFFFFFFFF
+        if (co_read32p(&buf[M_TB_STORE_SEQ_RESERVE_POS]) == 0xFFFFFFFF)
+        {
+            break;
+        }
+
+        // A torn record is skipped, the previous one stays valid
+        if (co_read32p(&buf[M_TB_STORE_IV_SEQ_CHECK_POS]) == m_tb_store_slot_check(&buf[0]))
+        {
+            memcpy(p_rec, &buf[0], M_TB_STORE_STATE_LEN);
+            found = true;
+        }
+    }
+
+    p_env->slot_off = off;
+
+    return (found);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Append an IV/SEQ record to the IV/SEQ sector. The record is first written to
+ * the NVDS tag when the sector has to be erased, when the IV index changes or when the
+ * NVDS tag does not exist yet, so that the NVDS tag always holds an IV/SEQ at least as
+ * recent as the oldest record of the sector with the same IV index.
+ *
+ * @param[in] p_rec     Pointer to the record
+ * @param[in] new_iv    True if IV index differs from the stored one
+ ****************************************************************************************
+ */
+static void m_tb_store_slot_put(uint8_t *p_rec, bool new_iv)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint8_t buf[M_TB_STORE_STATE_LEN];
+
+    if (p_env->slot_off == M_TB_STORE_IV_SEQ_SLOT_UNKNOWN)
+    {
+        m_tb_store_slot_scan(&buf[0]);
+    }
+
+    co_write32p(&p_rec[M_TB_STORE_IV_SEQ_CHECK_POS], m_tb_store_slot_check(p_rec));
+
+    if (!p_env->slot_anchored || new_iv || (p_env->slot_off >= M_TB_STORE_IV_SEQ_SLOT_SIZE))
+    {
+        nvds_put(M_TB_STORE_GET_NVDS_TAG(NVDS_TAG_MESH_IV_SEQ), M_TB_STORE_STATE_LEN, p_rec);
+        p_env->slot_anchored = true;
+    }
+
+    if (p_env->slot_off >= M_TB_STORE_IV_SEQ_SLOT_SIZE)
+    {
+        flash_erase(0, M_TB_STORE_IV_SEQ_SLOT_ADDR, M_TB_STORE_IV_SEQ_SLOT_SIZE, NULL);
+        p_env->slot_off = 0;
+    }
+
+    flash_write(0, M_TB_STORE_IV_SEQ_SLOT_ADDR + p_env->slot_off, M_TB_STORE_STATE_LEN, p_rec, NULL);
+    p_env->slot_off += M_TB_STORE_STATE_LEN;
+}
+#endif //(M_TB_STORE_IV_SEQ_SLOT)
+
+/**
+ ****************************************************************************************
+ * @brief Store a state value (unicast address, configuration states, device key, IV/SEQ).
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_state(uint8_t idx)
+{
+    uint8_t buf[M_TB_STORE_STATE_LEN];
+    uint8_t len = 1;
+
+    switch (idx)
+    {
+        case (NVDS_TAG_MESH_UNICAST_ADDR):
+        {
+            co_write16p(&buf[0], m_tb_mio_get_prim_addr());
+            len = NVDS_LEN_MESH_UNICAST_ADDR;
+        } break;
+
+        case (NVDS_TAG_MESH_DEFAULT_TTL):
+        {
+            buf[0] = m_tb_state_get_default_ttl();
+        } break;
+
+        case (NVDS_TAG_MESH_SECURE_BCN):
+        {
+            buf[0] = m_tb_state_get_beacon_state();
+        } break;
+
+        case (NVDS_TAG_MESH_NETWORK_TX):
+        {
+            buf[0] = m_tb_state_get_net_tx_state();
+        } break;
+
+        case (NVDS_TAG_MESH_RELAY):
+        {
+            buf[0] = m_tb_state_get_relay_state(&buf[1]);
+            len = NVDS_LEN_MESH_RELAY;
+        } break;
+
+        case (NVDS_TAG_MESH_GATT_PROXY):
+        {
+            buf[0] = m_tb_state_get_gatt_proxy_state();
+        } break;
+
+        case (NVDS_TAG_MESH_DEV_KEY):
+        {
+            const m_tb_key_dev_t *p_dev_key;
+
+            if (m_tb_key_dev_get(0, &p_dev_key) != MESH_ERR_NO_ERROR)
+            {
+                return;
+            }
+
+            memcpy(&buf[0], &p_dev_key->key[0], MESH_KEY_LEN);
+            len = NVDS_LEN_MESH_DEV_KEY;
+        } break;
+
+        case (NVDS_TAG_MESH_IV_SEQ):
+        {
+            m_tb_store_env_t *p_env = p_m_tb_store_env;
+            uint32_t iv, seq;
+
+            // Store end of a block of reserved sequence numbers, skipped to on load
+            m_tb_key_get_iv_seq(&seq, &iv);
+            seq += p_env->seq_reserve;
+
+            co_write32p(&buf[M_TB_STORE_IV_POS], iv);
+            co_write32p(&buf[M_TB_STORE_SEQ_POS], seq);
+            co_write32p(&buf[M_TB_STORE_SEQ_RESERVE_POS], p_env->seq_reserve);
+            co_write32p(&buf[M_TB_STORE_IV_SEQ_CHECK_POS], 0);
+            len = M_TB_STORE_STATE_LEN;
+            p_env->stats.nb_iv_seq++;
+
+            #if (M_TB_STORE_IV_SEQ_SLOT)
+            m_tb_store_slot_put(&buf[0], (iv != p_env->iv));
+            p_env->iv = iv;
+            p_env->seq = seq;
+            return;
+            #else //(M_TB_STORE_IV_SEQ_SLOT)
+            p_env->iv = iv;
+            p_env->seq = seq;
+            #endif //(M_TB_STORE_IV_SEQ_SLOT)
+        } break;
+
+        default:
+        {
+            // Friend and CTL set states are not stored
+            return;
+        }
+    }
+
+    nvds_put(M_TB_STORE_GET_NVDS_TAG(idx), len, &buf[0]);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store a network key (and its new value during a key refresh).
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_net_key(uint8_t idx)
+{
+    uint8_t buf[NVDS_LEN_MESH_NET_KEY];
+    m_lid_t net_key_lid = p_m_tb_store_env->key_lid[idx - NVDS_TAG_MESH_NET_KEY_FIRST];
+    const m_tb_key_net_t *p_net_key;
+    const m_tb_key_net_t *p_new_key;
+    uint16_t flags = 0;
+    uint8_t len = M_TB_STORE_NET_KEY_LEN;
+
+    if ((net_key_lid == M_TB_STORE_INVALID_SLOT)
+            || (m_tb_key_net_get(net_key_lid, &p_net_key, false) != MESH_ERR_NO_ERROR))
+    {
+        nvds_del(M_TB_STORE_GET_NVDS_TAG(idx));
+        return;
+    }
+
+    co_write16p(&buf[M_TB_STORE_NET_KEY_ID_POS], p_net_key->net_key_id);
+    memcpy(&buf[M_TB_STORE_NET_KEY_POS], &p_net_key->key[0], MESH_KEY_LEN);
+
+    // Key refresh in progress, keep the new key too
+    if ((p_net_key->state != 0)
+            && (m_tb_key_net_get(net_key_lid | 0x80, &p_new_key, false) == MESH_ERR_NO_ERROR))
+    {
+        flags |= M_TB_STORE_NET_KEY_FLAG_NEW;
+
+        if (p_net_key->state == 2)
+        {
+            flags |= M_TB_STORE_NET_KEY_FLAG_PHASE2;
+        }
+
+        memcpy(&buf[M_TB_STORE_NET_KEY_NEW_POS], &p_new_key->key[0], MESH_KEY_LEN);
+        len = NVDS_LEN_MESH_NET_KEY;
+    }
+
+    co_write16p(&buf[M_TB_STORE_NET_KEY_FLAGS_POS], flags);
+    nvds_put(M_TB_STORE_GET_NVDS_TAG(idx), len, &buf[0]);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store an application key (and its new value during a key refresh).
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_app_key(uint8_t idx)
+{
+    uint8_t buf[NVDS_LEN_MESH_APP_KEY];
+    m_lid_t app_key_lid = p_m_tb_store_env->key_lid[idx - NVDS_TAG_MESH_NET_KEY_FIRST];
+    const m_tb_key_app_t *p_app_key;
+    const m_tb_key_app_t *p_new_key;
+    const m_tb_key_net_t *p_net_key;
+    uint16_t flags = 0;
+    uint8_t len = M_TB_STORE_APP_KEY_LEN;
+
+    if ((app_key_lid == M_TB_STORE_INVALID_SLOT)
+            || (m_tb_key_app_get(app_key_lid, &p_app_key, false) != MESH_ERR_NO_ERROR)
+            || (m_tb_key_net_get(p_app_key->net_key_lid, &p_net_key, false) != MESH_ERR_NO_ERROR))
+    {
+        nvds_del(M_TB_STORE_GET_NVDS_TAG(idx));
+        return;
+    }
+
+    co_write16p(&buf[M_TB_STORE_APP_KEY_NET_ID_POS], p_net_key->net_key_id);
+    co_write16p(&buf[M_TB_STORE_APP_KEY_ID_POS], p_app_key->app_key_id);
+    memcpy(&buf[M_TB_STORE_APP_KEY_POS], &p_app_key->key[0], MESH_KEY_LEN);
+
+    if ((p_net_key->state != 0)
+            && (m_tb_key_app_get(app_key_lid | 0x80, &p_new_key, false) == MESH_ERR_NO_ERROR))
+    {
+        flags |= M_TB_STORE_APP_KEY_FLAG_NEW;
+        memcpy(&buf[M_TB_STORE_APP_KEY_NEW_POS], &p_new_key->key[0], MESH_KEY_LEN);
+        len = NVDS_LEN_MESH_APP_KEY;
+    }
+
+    co_write16p(&buf[M_TB_STORE_APP_KEY_FLAGS_POS], flags);
+    nvds_put(M_TB_STORE_GET_NVDS_TAG(idx), len, &buf[0]);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store publication parameters of a model.
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_publi_param(uint8_t idx)
+{
+    uint8_t buf[NVDS_LEN_MESH_PUBLI];
+    m_lid_t model_lid = p_m_tb_store_env->model_lid[idx - NVDS_TAG_MESH_PUBLI_FIRST];
+    uint32_t model_id = m_tb_mio_get_model_id(model_lid);
+    uint16_t elt_addr, addr;
+    uint16_t app_key_id = 0;
+    m_lid_t va_lid, app_key_lid;
+    uint8_t len = M_TB_STORE_PUBLI_LEN;
+
+    m_tb_mio_get_element_addr(model_lid, &elt_addr);
+    m_tb_mio_get_publi_param(model_lid, &addr, &va_lid, &app_key_lid, &buf[M_TB_STORE_PUBLI_TTL_POS],
+                             &buf[M_TB_STORE_PUBLI_PERIOD_POS], &buf[M_TB_STORE_PUBLI_RETX_POS],
+                             &buf[M_TB_STORE_PUBLI_FRIEND_CRED_POS]);
+
+    if (app_key_lid != MESH_INVALID_LID)
+    {
+        const m_tb_key_app_t *p_app_key;
+
+        if (m_tb_key_app_get(app_key_lid, &p_app_key, false) == MESH_ERR_NO_ERROR)
+        {
+            app_key_id = p_app_key->app_key_id;
+        }
+    }
+
+    co_write16p(&buf[M_TB_STORE_PUBLI_FLAGS_POS], (model_id >> 16) ? M_TB_STORE_PUBLI_FLAG_VENDOR : 0);
+    co_write16p(&buf[M_TB_STORE_PUBLI_ELT_ADDR_POS], elt_addr);
+    co_write32p(&buf[M_TB_STORE_PUBLI_MODEL_ID_POS], model_id);
+    co_write16p(&buf[M_TB_STORE_PUBLI_ADDR_POS], addr);
+    co_write16p(&buf[M_TB_STORE_PUBLI_APP_KEY_ID_POS], app_key_id);
+
+    if (M_IS_VIRTUAL_ADDR(addr))
+    {
+        memcpy(&buf[M_TB_STORE_PUBLI_LABEL_POS], m_tb_mio_get_vaddr(va_lid), M_LABEL_UUID_LEN);
+        len = NVDS_LEN_MESH_PUBLI;
+    }
+
+    nvds_put(M_TB_STORE_GET_NVDS_TAG(idx), len, &buf[0]);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Fill the header of a subscription list or binding record.
+ *
+ * @param[in] p_buf         Record buffer
+ * @param[in] model_lid     Model local index
+ * @param[in] nb            Number of entries
+ ****************************************************************************************
+ */
+static void m_tb_store_list_hdr(uint8_t *p_buf, m_lid_t model_lid, uint8_t nb)
+{
+    uint32_t model_id = m_tb_mio_get_model_id(model_lid);
+    uint16_t elt_addr;
+    uint16_t hdr = nb & M_TB_STORE_LIST_NB_MASK;
+
+    if (model_id >> 16)
+    {
+        hdr |= M_TB_STORE_LIST_VENDOR_BIT;
+    }
+
+    m_tb_mio_get_element_addr(model_lid, &elt_addr);
+
+    co_write16p(p_buf + M_TB_STORE_LIST_HDR_POS, hdr);
+    co_write16p(p_buf + M_TB_STORE_LIST_ELT_ADDR_POS, elt_addr);
+    co_write32p(p_buf + M_TB_STORE_LIST_MODEL_ID_POS, model_id);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Look for an entry in a list.
+ *
+ * @param[in] p_list        List
+ * @param[in] val           Address or AppKey index
+ * @param[in] p_label       Label UUID for a virtual address, NULL otherwise
+ *
+ * @return Position of the entry, p_list->nb if not found
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_list_find(m_tb_store_list_t *p_list, uint16_t val, const uint8_t *p_label)
+{
+    uint8_t pos;
+
+    for (pos = 0; pos < p_list->nb; pos++)
+    {
+        if ((p_list->val[pos] == val)
+                && ((p_label == NULL) || (p_list->p_label[pos] == NULL)
+                    || (memcmp(p_list->p_label[pos], p_label, M_LABEL_UUID_LEN) == 0)))
+        {
+            break;
+        }
+    }
+
+    return pos;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Apply an add or remove operation on a list. Adding an entry already present or
+ * removing an absent one leaves the list unchanged.
+ *
+ * @param[in] p_list        List
+ * @param[in] op            M_TB_STORE_DELTA_OP_ADD or M_TB_STORE_DELTA_OP_DEL
+ * @param[in] val           Address or AppKey index
+ * @param[in] p_label       Label UUID for a virtual address, NULL otherwise
+ ****************************************************************************************
+ */
+static void m_tb_store_list_apply(m_tb_store_list_t *p_list, uint8_t op, uint16_t val, uint8_t *p_label)
+{
+    uint8_t pos = m_tb_store_list_find(p_list, val, p_label);
+
+    if ((op == M_TB_STORE_DELTA_OP_ADD) && (pos == p_list->nb) && (pos < M_TB_STORE_LIST_ENTRY_MAX))
+    {
+        p_list->val[pos] = val;
+        p_list->p_label[pos] = p_label;
+        p_list->nb++;
+    }
+    else if ((op == M_TB_STORE_DELTA_OP_DEL) && (pos < p_list->nb))
+    {
+        p_list->nb--;
+        p_list->val[pos] = p_list->val[p_list->nb];
+        p_list->p_label[pos] = p_list->p_label[p_list->nb];
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Extract entries of a subscription list or binding record.
+ *
+ * @param[out] p_list       List
+ * @param[in] p_buf         Record buffer
+ * @param[in] len           Record length
+ * @param[in] label         True if virtual addresses are followed by their Label UUID
+ ****************************************************************************************
+ */
+static void m_tb_store_list_parse(m_tb_store_list_t *p_list, uint8_t *p_buf, uint8_t len, bool label)
+{
+    uint8_t nb = p_buf[M_TB_STORE_LIST_HDR_POS] & M_TB_STORE_LIST_NB_MASK;
+    uint8_t pos = M_TB_STORE_LIST_ENTRY_POS;
+
+    p_list->nb = 0;
+
+    while (nb-- && ((pos + 2) <= len))
+    {
+        uint16_t val = co_read16p(p_buf + pos);
+        uint8_t *p_label = NULL;
+
+        pos += 2;
+
+        if (label && M_IS_VIRTUAL_ADDR(val))
+        {
+            p_label = p_buf + pos;
+            pos += M_LABEL_UUID_LEN;
+        }
+
+        m_tb_store_list_apply(p_list, M_TB_STORE_DELTA_OP_ADD, val, p_label);
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Get length of an operation of a delta record.
+ *
+ * @param[in] p_op          Operation
+ * @param[in] label         True if virtual addresses are followed by their Label UUID
+ *
+ * @return Length of the operation
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_delta_op_len(const uint8_t *p_op, bool label)
+{
+    uint16_t val = co_read16p(p_op + M_TB_STORE_DELTA_OP_VAL_POS);
+
+    return (M_TB_STORE_DELTA_OP_LEN + ((label && M_IS_VIRTUAL_ADDR(val)) ? M_LABEL_UUID_LEN : 0));
+}
+
+/**
+ ****************************************************************************************
+ * @brief Replay the operations of a model found in a delta record on a list.
+ *
+ * @param[in] p_list        List
+ * @param[in] p_delta       Delta record buffer
+ * @param[in] len           Delta record length
+ * @param[in] slot          Model slot
+ * @param[out] p_own        Length of the operations of the model, may be NULL
+ * @param[in] label         True if virtual addresses are followed by their Label UUID
+ *
+ * @return Length of the delta record actually used
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_list_replay(m_tb_store_list_t *p_list, uint8_t *p_delta, uint8_t len, uint8_t slot,
+                                      uint8_t *p_own, bool label)
+{
+    uint8_t nb = p_delta[0];
+    uint8_t pos = 1;
+    uint8_t own = 0;
+
+    while (nb-- && ((pos + M_TB_STORE_DELTA_OP_LEN) <= len))
+    {
+        uint8_t op_len = m_tb_store_delta_op_len(p_delta + pos, label);
+
+        if (p_delta[pos + M_TB_STORE_DELTA_OP_SLOT_POS] == slot)
+        {
+            m_tb_store_list_apply(p_list, p_delta[pos], co_read16p(p_delta + pos + M_TB_STORE_DELTA_OP_VAL_POS),
+                                  (op_len != M_TB_STORE_DELTA_OP_LEN) ? (p_delta + pos + M_TB_STORE_DELTA_OP_LEN) : NULL);
+            own += op_len;
+        }
+
+        pos += op_len;
+    }
+
+    if (p_own != NULL)
+    {
+        *p_own = own;
+    }
+
+    return pos;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Remove the operations of a model from a delta record.
+ *
+ * @param[in] p_delta       Delta record buffer
+ * @param[in] len           Delta record length
+ * @param[in] slot          Model slot
+ * @param[in] label         True if virtual addresses are followed by their Label UUID
+ *
+ * @return Length of the remaining delta record
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_delta_strip(uint8_t *p_delta, uint8_t len, uint8_t slot, bool label)
+{
+    uint8_t nb = p_delta[0];
+    uint8_t pos = 1;
+    uint8_t out = 1;
+
+    p_delta[0] = 0;
+
+    while (nb-- && ((pos + M_TB_STORE_DELTA_OP_LEN) <= len))
+    {
+        uint8_t op_len = m_tb_store_delta_op_len(p_delta + pos, label);
+
+        if (p_delta[pos + M_TB_STORE_DELTA_OP_SLOT_POS] != slot)
+        {
+            memmove(p_delta + out, p_delta + pos, op_len);
+            out += op_len;
+            p_delta[0]++;
+        }
+
+        pos += op_len;
+    }
+
+    return out;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Append an operation to a delta record.
+ *
+ * @param[in] p_delta       Delta record buffer
+ * @param[in,out] p_len     Delta record length
+ * @param[in] op            M_TB_STORE_DELTA_OP_ADD or M_TB_STORE_DELTA_OP_DEL
+ * @param[in] slot          Model slot
+ * @param[in] val           Address or AppKey index
+ * @param[in] p_label       Label UUID for a virtual address, NULL otherwise
+ *
+ * @return False if delta record is full and must be folded into a snapshot
+ ****************************************************************************************
+ */
+static bool m_tb_store_delta_push(uint8_t *p_delta, uint8_t *p_len, uint8_t op, uint8_t slot, uint16_t val,
+                                  const uint8_t *p_label)
+{
+    uint8_t op_len = M_TB_STORE_DELTA_OP_LEN + ((p_label != NULL) ? M_LABEL_UUID_LEN : 0);
+
+    if ((p_delta[0] >= M_TB_STORE_DELTA_NB_MAX) || ((*p_len + op_len) > NVDS_LEN_MESH_DELTA))
+    {
+        return false;
+    }
+
+    p_delta[*p_len] = op;
+    p_delta[*p_len + M_TB_STORE_DELTA_OP_SLOT_POS] = slot;
+    co_write16p(p_delta + *p_len + M_TB_STORE_DELTA_OP_VAL_POS, val);
+
+    if (p_label != NULL)
+    {
+        memcpy(p_delta + *p_len + M_TB_STORE_DELTA_OP_LEN, p_label, M_LABEL_UUID_LEN);
+    }
+
+    *p_len += op_len;
+    p_delta[0]++;
+
+    return true;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store a subscription list or binding record.
+ *
+ * The record stored in NVDS (snapshot) plus the operations of the model found in the delta
+ * record are compared with the new content. Differences are appended to the delta record as
+ * add/remove operations, which costs a few bytes of flash per configuration message. The
+ * delta record is shared by all models of a kind so that it needs a single tag. The snapshot
+ * is rewritten and the operations of the model removed from the delta record when no
+ * snapshot exists yet, when the delta record is full or when the operations of the model
+ * would grow beyond the size of the snapshot itself.
+ *
+ * @param[in] idx           Tag index of the snapshot
+ * @param[in] slot          Model slot
+ * @param[in] delta_tag     NVDS tag of the delta record
+ * @param[in] p_snap        New content of the record
+ * @param[in] snap_len      Length of the new content
+ * @param[in] label         True if virtual addresses are followed by their Label UUID
+ ****************************************************************************************
+ */
+static void m_tb_store_update_list(uint8_t idx, uint8_t slot, uint8_t delta_tag, uint8_t *p_snap,
+                                   uint8_t snap_len, bool label)
+{
+    uint8_t *p_old = (uint8_t *)mal_malloc(NVDS_LEN_MESH_SUBS);
+    uint8_t *p_delta = (uint8_t *)mal_malloc(NVDS_LEN_MESH_DELTA);
+    nvds_tag_len_t old_len = NVDS_LEN_MESH_SUBS;
+    nvds_tag_len_t delta_len = NVDS_LEN_MESH_DELTA;
+    bool snapshot = true;
+
+    // Operations of the model could not be removed from the delta record, keep stored content
+    if ((p_old == NULL) || (p_delta == NULL))
+    {
+        snapshot = false;
+    }
+    else if ((nvds_get(delta_tag, &delta_len, p_delta) != NVDS_OK) || (delta_len == 0))
+    {
+        p_delta[0] = 0;
+        delta_len = 1;
+    }
+
+    do
+    {
+        m_tb_store_list_t stored;
+        m_tb_store_list_t cur;
+        uint8_t len, start, own, pos;
+
+        if (!snapshot
+                || (nvds_get(M_TB_STORE_GET_NVDS_TAG(idx), &old_len, p_old) != NVDS_OK)
+                || (old_len < M_TB_STORE_LIST_ENTRY_POS)
+                // Model identification is only kept in the snapshot
+                || (memcmp(p_old + M_TB_STORE_LIST_ELT_ADDR_POS, p_snap + M_TB_STORE_LIST_ELT_ADDR_POS,
+                           M_TB_STORE_LIST_ENTRY_POS - M_TB_STORE_LIST_ELT_ADDR_POS) != 0))
+        {
+            break;
+        }
+
+        // Content currently known by the storage
+        m_tb_store_list_parse(&stored, p_old, old_len, label);
+        start = m_tb_store_list_replay(&stored, p_delta, delta_len, slot, &own, label);
+        len = start;
+
+        // Content to store
+        m_tb_store_list_parse(&cur, p_snap, snap_len, label);
+
+        for (pos = 0; pos < stored.nb; pos++)
+        {
+            if ((m_tb_store_list_find(&cur, stored.val[pos], stored.p_label[pos]) == cur.nb)
+                    && !m_tb_store_delta_push(p_delta, &len, M_TB_STORE_DELTA_OP_DEL, slot, stored.val[pos],
+                                              stored.p_label[pos]))
+            {
+                break;
+            }
+        }
+
+        if (pos != stored.nb)
+        {
+            break;
+        }
+
+        for (pos = 0; pos < cur.nb; pos++)
+        {
+            if ((m_tb_store_list_find(&stored, cur.val[pos], cur.p_label[pos]) == stored.nb)
+                    && !m_tb_store_delta_push(p_delta, &len, M_TB_STORE_DELTA_OP_ADD, slot, cur.val[pos],
+                                              cur.p_label[pos]))
+            {
+                break;
+            }
+        }
+
+        if ((pos != cur.nb) || ((own + len - start) >= snap_len))
+        {
+            break;
+        }
+
+        snapshot = false;
+
+        // Nothing changed since last store
+        if (len != start)
+        {
+            nvds_put(delta_tag, len, p_delta);
+        }
+    } while (0);
+
+    if (snapshot)
+    {
+        delta_len = m_tb_store_delta_strip(p_delta, delta_len, slot, label);
+
+        // Both records in one transaction when the log NVDS holds both tags. Otherwise delta
+        // record first: operations left over a newer snapshot would be replayed on it at
+        // load. If power is lost in between, the previous snapshot is loaded alone and only
+        // the changes of the model since that snapshot are lost
+        nvds_txn_begin();
+
+        if ((nvds_txn_put(delta_tag, delta_len, p_delta) != NVDS_OK)
+                || (nvds_txn_put(M_TB_STORE_GET_NVDS_TAG(idx), snap_len, p_snap) != NVDS_OK)
+                || (nvds_txn_commit() != NVDS_OK))
+        {
+            nvds_txn_abort();
+
+            if (p_delta[0] == 0)
+            {
+                nvds_del(delta_tag);
+            }
+            else
+            {
+                nvds_put(delta_tag, delta_len, p_delta);
+            }
+
+            nvds_put(M_TB_STORE_GET_NVDS_TAG(idx), snap_len, p_snap);
+        }
+    }
+
+    if (p_old != NULL)
+    {
+        mal_free(p_old);
+    }
+
+    if (p_delta != NULL)
+    {
+        mal_free(p_delta);
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store subscription list of a model.
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_subs_list(uint8_t idx)
+{
+    uint8_t slot = idx - NVDS_TAG_MESH_SUBS_FIRST;
+    m_lid_t model_lid = p_m_tb_store_env->model_lid[slot];
+    uint8_t nb = m_tb_mio_get_subscription_list_size(model_lid);
+    uint8_t len = M_TB_STORE_LIST_ENTRY_POS + (nb * 2)
+                  + (m_tb_mio_get_subscription_list_size_vaddr(model_lid) * M_LABEL_UUID_LEN);
+    uint8_t *p_buf = (uint8_t *)mal_malloc(len);
+
+    if (p_buf != NULL)
+    {
+        m_tb_store_list_hdr(p_buf, model_lid, nb);
+        m_tb_mio_get_subscription_list(model_lid, p_buf + M_TB_STORE_LIST_ENTRY_POS, true);
+
+        m_tb_store_update_list(idx, slot, NVDS_TAG_MESH_SUBS_DELTA, p_buf, len, true);
+        mal_free(p_buf);
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store application keys bound with a model.
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag_binding(uint8_t idx)
+{
+    uint8_t slot = idx - NVDS_TAG_MESH_BINDINGS_FIRST;
+    m_lid_t model_lid = p_m_tb_store_env->model_lid[slot];
+    uint8_t nb = m_tb_mio_get_nb_bound_app(model_lid);
+    uint8_t len = M_TB_STORE_LIST_ENTRY_POS + (nb * 2);
+    uint8_t *p_buf = (uint8_t *)mal_malloc(len);
+
+    if (p_buf != NULL)
+    {
+        m_tb_store_list_hdr(p_buf, model_lid, nb);
+        m_tb_key_get_model_appkey_ids(model_lid, nb, p_buf + M_TB_STORE_LIST_ENTRY_POS, false);
+
+        m_tb_store_update_list(idx, slot, NVDS_TAG_MESH_BINDINGS_DELTA, p_buf, len, false);
+        mal_free(p_buf);
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Get time elapsed since a time value read from the mesh timer.
+ *
+ * @param[in] start_ms      Start time (ms part)
+ *
+ * @return Elapsed time in milliseconds
+ ****************************************************************************************
+ */
+static uint32_t m_tb_store_elapsed_ms(uint32_t start_ms)
+{
+    uint32_t now_ms;
+    uint16_t nb_wrap;
+
+    mesh_tb_timer_get_cur_time(&now_ms, &nb_wrap);
+
+    return (now_ms - start_ms);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Get next tag marked as waiting to be stored and clear its mark.
+ *
+ * @param[in] idx       Tag index from which search starts
+ *
+ * @return Tag index, M_TB_STORE_NB_TAG if no tag is waiting to be stored
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_get_upd(uint8_t idx)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+
+    for (; idx < M_TB_STORE_NB_TAG; idx++)
+    {
+        uint32_t mask = (1UL << (idx & 0x1F));
+
+        if (p_env->upd_bits[idx >> 5] & mask)
+        {
+            p_env->upd_bits[idx >> 5] &= ~mask;
+            break;
+        }
+    }
+
+    return (idx);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store a tag.
+ *
+ * @param[in] idx       Tag index
+ ****************************************************************************************
+ */
+static void m_tb_store_update_tag(uint8_t idx)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint32_t start_ms, duration_ms;
+    uint16_t nb_wrap;
+
+    mesh_tb_timer_get_cur_time(&start_ms, &nb_wrap);
+
+    if (idx <= NVDS_TAG_MESH_IV_SEQ)
+    {
+        m_tb_store_update_tag_state(idx);
+    }
+    else if (idx <= NVDS_TAG_MESH_NET_KEY_LAST)
+    {
+        m_tb_store_update_tag_net_key(idx);
+    }
+    else if (idx <= NVDS_TAG_MESH_APP_KEY_LAST)
+    {
+        m_tb_store_update_tag_app_key(idx);
+    }
+    else if (idx <= NVDS_TAG_MESH_PUBLI_LAST)
+    {
+        m_tb_store_update_tag_publi_param(idx);
+    }
+    else if (idx <= NVDS_TAG_MESH_SUBS_LAST)
+    {
+        m_tb_store_update_tag_subs_list(idx);
+    }
+    else if (idx <= NVDS_TAG_MESH_BINDINGS_LAST)
+    {
+        m_tb_store_update_tag_binding(idx);
+    }
+
+    duration_ms = m_tb_store_elapsed_ms(start_ms);
+    p_env->stats.nb_tag++;
+
+    if (duration_ms > p_env->stats.tag_max_ms)
+    {
+        p_env->stats.tag_max_ms = duration_ms;
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Store all tags marked as waiting to be stored.
+ ****************************************************************************************
+ */
+static void m_tb_store_update(void)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint8_t idx;
+
+    mesh_tb_timer_clear(&p_env->timer_flush);
+    p_env->dirty = false;
+    p_env->urgent = false;
+    p_env->slicing = false;
+
+    for (idx = m_tb_store_get_upd(0); idx < M_TB_STORE_NB_TAG; idx = m_tb_store_get_upd(idx + 1))
+    {
+        m_tb_store_update_tag(idx);
+    }
+
+    p_env->stats.nb_store++;
+}
+
+/**
+ ****************************************************************************************
+ * @brief Callback executed when periodic update timer expires.
+ *
+ * @param[in] p_env     Pointer to timer environment (not used)
+ ****************************************************************************************
+ */
+static void m_tb_store_cb_timer_upd(void *p_env)
+{
+    m_tb_store_iv_seq_update();
+
+    // Tags left dirty by a write-back which could not be performed
+    if (!p_m_tb_store_env->dirty && m_tb_store_nvs_check())
+    {
+        m_tb_store_sched(false);
+    }
+
+    mesh_tb_timer_set(&p_m_tb_store_env->timer, p_m_tb_store_env->delay_s * 1000);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Callback executed when write-back timer expires.
+ *
+ * @param[in] p_env     Pointer to timer environment (not used)
+ ****************************************************************************************
+ */
+static void m_tb_store_cb_timer_flush(void *p_env)
+{
+    p_m_tb_store_env->dirty = false;
+    p_m_tb_store_env->urgent = false;
+
+    #if (M_TB_STORE_STOP_SCAN)
+    m_tb_stop_scan_before_store_nvs();
+    #else //(M_TB_STORE_STOP_SCAN)
+    uint16_t nb_wrap;
+
+    // Tags are stored between radio events from the main loop, scanner is kept enabled
+    p_m_tb_store_env->slicing = true;
+    p_m_tb_store_env->slice_idx = 0;
+    mesh_tb_timer_get_cur_time(&p_m_tb_store_env->slice_time_ms, &nb_wrap);
+    #endif //(M_TB_STORE_STOP_SCAN)
+}
+
+/*
+ * LOCAL FUNCTIONS - LOAD
+ ****************************************************************************************
+ */
+
+/**
+ ****************************************************************************************
+ * @brief Load a state value.
+ *
+ * @return Execution status
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_states(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    uint8_t *p_buf = &p_load->buf[0];
+    nvds_tag_len_t len = M_TB_STORE_STATE_LEN;
+    uint16_t status = MESH_ERR_NO_ERROR;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, p_buf) != NVDS_OK)
+    {
+        return (status);
+    }
+
+    p_load->nb_loaded++;
+
+    switch (p_load->idx)
+    {
+        case (NVDS_TAG_MESH_UNICAST_ADDR):
+        {
+            m_tb_mio_set_prim_addr(co_read16p(p_buf));
+        } break;
+
+        case (NVDS_TAG_MESH_DEFAULT_TTL):
+        {
+            status = m_tb_state_set_default_ttl(p_buf[0]);
+        } break;
+
+        case (NVDS_TAG_MESH_SECURE_BCN):
+        {
+            m_tb_state_set_beacon_state(p_buf[0]);
+        } break;
+
+        case (NVDS_TAG_MESH_NETWORK_TX):
+        {
+            m_tb_state_set_net_tx_state(p_buf[0]);
+        } break;
+
+        case (NVDS_TAG_MESH_RELAY):
+        {
+            m_tb_state_set_relay_state(p_buf[0], p_buf[1]);
+        } break;
+
+        case (NVDS_TAG_MESH_GATT_PROXY):
+        {
+            m_tb_state_set_gatt_proxy_state(p_buf[0]);
+        } break;
+
+        case (NVDS_TAG_MESH_DEV_KEY):
+        {
+            status = m_tb_key_dev_add(p_buf, 0);
+
+            if (status == MESH_ERR_NO_ERROR)
+            {
+                m_tb_key_model_bind(0, 0);
+            }
+        } break;
+
+        case (NVDS_TAG_MESH_IV_SEQ):
+        {
+            m_tb_store_env_t *p_env = p_m_tb_store_env;
+            uint32_t iv = co_read32p(p_buf + M_TB_STORE_IV_POS);
+            uint32_t seq = co_read32p(p_buf + M_TB_STORE_SEQ_POS);
+            uint32_t reserve = co_read32p(p_buf + M_TB_STORE_SEQ_RESERVE_POS);
+
+            if (reserve == 0)
+            {
+                // Record holds the sequence number in use when it was stored
+                seq += M_TB_STORE_SEQ_RESERVE_MIN;
+            }
+
+            #if (M_TB_STORE_IV_SEQ_SLOT)
+            {
+                uint8_t rec[M_TB_STORE_STATE_LEN];
+
+                p_env->slot_anchored = true;
+
+                // Sector records with another IV index are older than the NVDS tag
+                if (m_tb_store_slot_scan(&rec[0]) && (co_read32p(&rec[M_TB_STORE_IV_POS]) == iv)
+                        && (co_read32p(&rec[M_TB_STORE_SEQ_POS]) > seq))
+                {
+                    seq = co_read32p(&rec[M_TB_STORE_SEQ_POS]);
+                    reserve = co_read32p(&rec[M_TB_STORE_SEQ_RESERVE_POS]);
+                }
+            }
+            #endif //(M_TB_STORE_IV_SEQ_SLOT)
+
+            // Skip sequence numbers which may have been used since last store
+            m_tb_key_set_iv_seq(iv, seq);
+            p_env->iv = iv;
+            p_env->seq_prev = seq;
+            p_env->seq_reserve = co_max(reserve, M_TB_STORE_SEQ_RESERVE_MIN);
+            m_tb_store_update_tag_state(NVDS_TAG_MESH_IV_SEQ);
+        } break;
+
+        default:
+        {
+        } break;
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Callback executed when a network key has been added by the key manager.
+ *
+ * @param[in] status        Execution status
+ * @param[in] net_key_lid   Network key local index
+ ****************************************************************************************
+ */
+static void m_tb_store_cb_netkey_added(uint16_t status, m_lid_t net_key_lid)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    m_tb_store_load_env_t *p_load = p_env->p_load;
+    uint8_t slot;
+
+    if (status == MESH_ERR_NO_ERROR)
+    {
+        uint16_t flags = co_read16p(&p_load->buf[M_TB_STORE_NET_KEY_FLAGS_POS]);
+
+        // Key refresh was in progress, restore the new key
+        if (flags & M_TB_STORE_NET_KEY_FLAG_NEW)
+        {
+            co_write16p(&p_load->buf[M_TB_STORE_NET_KEY_FLAGS_POS], flags & ~M_TB_STORE_NET_KEY_FLAG_NEW);
+            status = m_tb_key_net_update(net_key_lid, &p_load->buf[M_TB_STORE_NET_KEY_NEW_POS],
+                                         m_tb_store_cb_netkey_added);
+
+            if (status == MESH_ERR_NO_ERROR)
+            {
+                return;
+            }
+        }
+        else
+        {
+            net_key_lid &= 0x7F;
+            slot = p_load->idx - NVDS_TAG_MESH_NET_KEY_FIRST;
+
+            p_env->key_lid[slot] = net_key_lid;
+            if ((net_key_lid > 0) && (net_key_lid <= M_TB_STORE_NB_KEY_SLOT))
+            {
+                p_env->key_slot[net_key_lid - 1] = slot;
+            }
+
+            p_load->idx++;
+        }
+    }
+
+    m_tb_store_load_fsm(status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Callback executed when an application key has been added by the key manager.
+ *
+ * @param[in] status        Execution status
+ * @param[in] app_key_lid   Application key local index
+ ****************************************************************************************
+ */
+static void m_tb_store_cb_appkey_added(uint16_t status, m_lid_t app_key_lid)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    m_tb_store_load_env_t *p_load = p_env->p_load;
+    uint8_t slot;
+
+    if (status == MESH_ERR_NO_ERROR)
+    {
+        uint16_t flags = co_read16p(&p_load->buf[M_TB_STORE_APP_KEY_FLAGS_POS]);
+
+        if (flags & M_TB_STORE_APP_KEY_FLAG_NEW)
+        {
+            m_lid_t net_key_lid;
+
+            co_write16p(&p_load->buf[M_TB_STORE_APP_KEY_FLAGS_POS], flags & ~M_TB_STORE_APP_KEY_FLAG_NEW);
+            status = m_tb_key_net_find(co_read16p(&p_load->buf[M_TB_STORE_APP_KEY_NET_ID_POS]), &net_key_lid);
+
+            if (status == MESH_ERR_NO_ERROR)
+            {
+                status = m_tb_key_app_update(co_read16p(&p_load->buf[M_TB_STORE_APP_KEY_ID_POS]),
+                                             &p_load->buf[M_TB_STORE_APP_KEY_NEW_POS], net_key_lid,
+                                             m_tb_store_cb_appkey_added);
+            }
+
+            if (status == MESH_ERR_NO_ERROR)
+            {
+                return;
+            }
+        }
+        else
+        {
+            app_key_lid &= 0x7F;
+            slot = p_load->idx - NVDS_TAG_MESH_NET_KEY_FIRST;
+
+            p_env->key_lid[slot] = app_key_lid;
+            if ((app_key_lid > 0) && (app_key_lid <= M_TB_STORE_NB_KEY_SLOT))
+            {
+                p_env->key_slot[app_key_lid - 1] = slot;
+            }
+
+            p_load->idx++;
+        }
+    }
+
+    m_tb_store_load_fsm(status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load a network key.
+ *
+ * @return MESH_ERR_NO_ERROR if key manager will call back, MESH_ERR_NOT_FOUND if key is
+ * not stored, another error status else.
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_net_key(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    nvds_tag_len_t len = NVDS_LEN_MESH_NET_KEY;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, &p_load->buf[0]) != NVDS_OK)
+    {
+        return (MESH_ERR_NOT_FOUND);
+    }
+
+    p_load->nb_loaded++;
+
+    return (m_tb_key_net_add(co_read16p(&p_load->buf[M_TB_STORE_NET_KEY_ID_POS]),
+                             &p_load->buf[M_TB_STORE_NET_KEY_POS], 0, m_tb_store_cb_netkey_added));
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load an application key.
+ *
+ * @return MESH_ERR_NO_ERROR if key manager will call back, MESH_ERR_NOT_FOUND if key is
+ * not stored, another error status else.
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_app_key(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    nvds_tag_len_t len = NVDS_LEN_MESH_APP_KEY;
+    m_lid_t net_key_lid;
+    uint16_t status;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, &p_load->buf[0]) != NVDS_OK)
+    {
+        return (MESH_ERR_NOT_FOUND);
+    }
+
+    p_load->nb_loaded++;
+
+    status = m_tb_key_net_find(co_read16p(&p_load->buf[M_TB_STORE_APP_KEY_NET_ID_POS]), &net_key_lid);
+
+    if (status == MESH_ERR_NO_ERROR)
+    {
+        status = m_tb_key_app_add(co_read16p(&p_load->buf[M_TB_STORE_APP_KEY_ID_POS]),
+                                  &p_load->buf[M_TB_STORE_APP_KEY_POS], net_key_lid,
+                                  m_tb_store_cb_appkey_added);
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Map a model slot on the model identified in a loaded record.
+ *
+ * @param[in] slot          Model slot
+ * @param[out] p_model_lid  Model local index
+ *
+ * @return Execution status
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_model(uint8_t slot, m_lid_t *p_model_lid)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint8_t *p_buf = &p_env->p_load->buf[0];
+    uint16_t status;
+
+    // Element address and model ID are at the same position in all model records
+    status = m_tb_mio_get_local_id(co_read16p(p_buf + M_TB_STORE_LIST_ELT_ADDR_POS),
+                                   co_read32p(p_buf + M_TB_STORE_LIST_MODEL_ID_POS), p_model_lid);
+
+    if ((status == MESH_ERR_NO_ERROR) && (*p_model_lid < M_TB_MIO_MODEL_NB))
+    {
+        p_env->model_slot[*p_model_lid] = slot;
+        p_env->model_lid[slot] = *p_model_lid;
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load publication parameters of a model.
+ *
+ * @return Execution status
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_publi_param(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    uint8_t *p_buf = &p_load->buf[0];
+    nvds_tag_len_t len = NVDS_LEN_MESH_PUBLI;
+    m_lid_t model_lid;
+    m_lid_t app_key_lid = MESH_INVALID_LID;
+    uint16_t addr;
+    uint16_t status;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, p_buf) != NVDS_OK)
+    {
+        return (MESH_ERR_NO_ERROR);
+    }
+
+    p_load->nb_loaded++;
+
+    status = m_tb_store_load_model(p_load->idx - NVDS_TAG_MESH_PUBLI_FIRST, &model_lid);
+
+    if (status == MESH_ERR_NO_ERROR)
+    {
+        addr = co_read16p(p_buf + M_TB_STORE_PUBLI_ADDR_POS);
+        m_tb_key_app_find(co_read16p(p_buf + M_TB_STORE_PUBLI_APP_KEY_ID_POS), &app_key_lid);
+
+        status = m_tb_mio_set_publi_param(model_lid, addr,
+                                          M_IS_VIRTUAL_ADDR(addr) ? (p_buf + M_TB_STORE_PUBLI_LABEL_POS) : NULL,
+                                          app_key_lid, p_buf[M_TB_STORE_PUBLI_TTL_POS],
+                                          p_buf[M_TB_STORE_PUBLI_PERIOD_POS], p_buf[M_TB_STORE_PUBLI_RETX_POS],
+                                          p_buf[M_TB_STORE_PUBLI_FRIEND_CRED_POS]);
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Read the delta record of subscription lists or bindings into the load buffer.
+ *
+ * @param[in] delta_tag     NVDS tag of the delta record
+ *
+ * @return Length of the delta record, 0 if there is none
+ ****************************************************************************************
+ */
+static uint8_t m_tb_store_load_delta(uint8_t delta_tag)
+{
+    nvds_tag_len_t len = NVDS_LEN_MESH_DELTA;
+
+    if (nvds_get(delta_tag, &len, &p_m_tb_store_env->p_load->buf[0]) != NVDS_OK)
+    {
+        len = 0;
+    }
+
+    return (len);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load subscription list of a model: snapshot then delta record.
+ *
+ * @return Execution status
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_subs_list(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    uint8_t slot = p_load->idx - NVDS_TAG_MESH_SUBS_FIRST;
+    uint8_t *p_buf = &p_load->buf[0];
+    nvds_tag_len_t len = NVDS_LEN_MESH_SUBS;
+    m_lid_t model_lid;
+    m_tb_store_list_t list;
+    uint8_t pos;
+    uint16_t status;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, p_buf) != NVDS_OK)
+    {
+        return (MESH_ERR_NO_ERROR);
+    }
+
+    p_load->nb_loaded++;
+
+    status = m_tb_store_load_model(slot, &model_lid);
+
+    if (status != MESH_ERR_NO_ERROR)
+    {
+        return (status);
+    }
+
+    m_tb_store_list_parse(&list, p_buf, len, true);
+
+    for (pos = 0; (pos < list.nb) && (status == MESH_ERR_NO_ERROR); pos++)
+    {
+        if (list.p_label[pos] != NULL)
+        {
+            status = m_tb_mio_add_subscription_virt(model_lid, list.val[pos], list.p_label[pos]);
+        }
+        else
+        {
+            status = m_tb_mio_add_subscription(model_lid, list.val[pos]);
+        }
+    }
+
+    len = m_tb_store_load_delta(NVDS_TAG_MESH_SUBS_DELTA);
+    pos = 1;
+
+    // Replay changes of the model; an operation already reflected by the snapshot has no effect
+    while ((status == MESH_ERR_NO_ERROR) && len && p_buf[0]-- && ((pos + M_TB_STORE_DELTA_OP_LEN) <= len))
+    {
+        uint8_t op = p_buf[pos];
+        uint16_t addr = co_read16p(p_buf + pos + M_TB_STORE_DELTA_OP_VAL_POS);
+
+        if (p_buf[pos + M_TB_STORE_DELTA_OP_SLOT_POS] != slot)
+        {
+            pos += m_tb_store_delta_op_len(p_buf + pos, true);
+            continue;
+        }
+
+        pos += M_TB_STORE_DELTA_OP_LEN;
+
+        if (M_IS_VIRTUAL_ADDR(addr))
+        {
+            if (op == M_TB_STORE_DELTA_OP_ADD)
+            {
+                m_tb_mio_add_subscription_virt(model_lid, addr, p_buf + pos);
+            }
+            else
+            {
+                m_tb_mio_delete_subscription_virt(model_lid, p_buf + pos, &addr);
+            }
+
+            pos += M_LABEL_UUID_LEN;
+        }
+        else if (op == M_TB_STORE_DELTA_OP_ADD)
+        {
+            m_tb_mio_add_subscription(model_lid, addr);
+        }
+        else
+        {
+            m_tb_mio_delete_subscription(model_lid, addr);
+        }
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load application keys bound with a model: snapshot then delta record.
+ *
+ * @return Execution status
+ ****************************************************************************************
+ */
+static uint16_t m_tb_store_load_binding(void)
+{
+    m_tb_store_load_env_t *p_load = p_m_tb_store_env->p_load;
+    uint8_t slot = p_load->idx - NVDS_TAG_MESH_BINDINGS_FIRST;
+    uint8_t *p_buf = &p_load->buf[0];
+    nvds_tag_len_t len = NVDS_LEN_MESH_BINDINGS;
+    m_lid_t model_lid, app_key_lid;
+    m_tb_store_list_t list;
+    uint8_t pos;
+    uint16_t status;
+
+    if (nvds_get(M_TB_STORE_GET_NVDS_TAG(p_load->idx), &len, p_buf) != NVDS_OK)
+    {
+        return (MESH_ERR_NO_ERROR);
+    }
+
+    p_load->nb_loaded++;
+
+    status = m_tb_store_load_model(slot, &model_lid);
+
+    if (status != MESH_ERR_NO_ERROR)
+    {
+        return (status);
+    }
+
+    m_tb_store_list_parse(&list, p_buf, len, false);
+
+    len = m_tb_store_load_delta(NVDS_TAG_MESH_BINDINGS_DELTA);
+
+    if (len != 0)
+    {
+        m_tb_store_list_replay(&list, p_buf, len, slot, NULL, false);
+    }
+
+    for (pos = 0; pos < list.nb; pos++)
+    {
+        status = m_tb_key_app_find(list.val[pos], &app_key_lid);
+
+        if (status != MESH_ERR_NO_ERROR)
+        {
+            break;
+        }
+
+        m_tb_key_model_bind(app_key_lid, model_lid);
+        m_tb_mio_bind(model_lid);
+    }
+
+    return (status);
+}
+
+/**
+ ****************************************************************************************
+ * @brief Load stored entries one after the other. Keys are added asynchronously by the
+ * key manager, the procedure then continues from the key manager callback.
+ *
+ * @param[in] status    Status of the previous step
+ ****************************************************************************************
+ */
+static void m_tb_store_load_fsm(uint16_t status)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    m_tb_store_load_env_t *p_load = p_env->p_load;
+
+    while ((status == MESH_ERR_NO_ERROR) && (p_load->idx < M_TB_STORE_NB_TAG))
+    {
+        if (p_load->idx <= NVDS_TAG_MESH_IV_SEQ)
+        {
+            status = m_tb_store_load_states();
+        }
+        else if (p_load->idx <= NVDS_TAG_MESH_APP_KEY_LAST)
+        {
+            status = (p_load->idx <= NVDS_TAG_MESH_NET_KEY_LAST)
+                     ? m_tb_store_load_net_key() : m_tb_store_load_app_key();
+
+            if (status == MESH_ERR_NO_ERROR)
+            {
+                // Wait for key manager, index is increased once key is added
+                return;
+            }
+
+            if (status == MESH_ERR_NOT_FOUND)
+            {
+                status = MESH_ERR_NO_ERROR;
+            }
+        }
+        else if (p_load->idx <= NVDS_TAG_MESH_PUBLI_LAST)
+        {
+            status = m_tb_store_load_publi_param();
+        }
+        else if (p_load->idx <= NVDS_TAG_MESH_SUBS_LAST)
+        {
+            status = m_tb_store_load_subs_list();
+        }
+        else
+        {
+            status = m_tb_store_load_binding();
+        }
+
+        p_load->idx++;
+    }
+
+    if ((status == MESH_ERR_NO_ERROR) && (p_load->nb_loaded != 0))
+    {
+        m_tb_state_set_prov_state(M_TB_STATE_PROV_STATE_PROV);
+
+        if (p_env->delay_s != 0)
+        {
+            mesh_tb_timer_set(&p_env->timer, p_env->delay_s * 1000);
+        }
+    }
+
+    p_env->p_load = NULL;
+    p_load->cb_load(status);
+    mal_free(p_load);
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ ****************************************************************************************
+ */
+
+uint16_t m_tb_store_init(bool reset, void *p_env, const m_cfg_t *p_cfg)
+{
+    if (reset)
+    {
+        if ((p_m_tb_store_env != NULL) && (p_m_tb_store_env->p_load != NULL))
+        {
+            mal_free(p_m_tb_store_env->p_load);
+        }
+
+        p_m_tb_store_env = NULL;
+    }
+    else
+    {
+        p_m_tb_store_env = (m_tb_store_env_t *)p_env;
+
+        memset(p_m_tb_store_env, 0, sizeof(m_tb_store_env_t));
+        p_m_tb_store_env->timer.cb = m_tb_store_cb_timer_upd;
+        p_m_tb_store_env->timer_flush.cb = m_tb_store_cb_timer_flush;
+        p_m_tb_store_env->delay_s = M_TB_STORE_DFT_DELAY_S;
+        p_m_tb_store_env->quiet_ms = M_TB_STORE_DFT_QUIET_MS;
+        p_m_tb_store_env->max_latency_ms = M_TB_STORE_DFT_DELAY_S * 1000;
+        p_m_tb_store_env->slice_cost_us = M_TB_STORE_SLICE_MIN_US;
+        p_m_tb_store_env->seq_reserve = M_TB_STORE_SEQ_RESERVE_MIN;
+        #if (M_TB_STORE_IV_SEQ_SLOT)
+        p_m_tb_store_env->slot_off = M_TB_STORE_IV_SEQ_SLOT_UNKNOWN;
+        #endif //(M_TB_STORE_IV_SEQ_SLOT)
+
+        memset(p_m_tb_store_env->key_slot, M_TB_STORE_INVALID_SLOT, sizeof(p_m_tb_store_env->key_slot));
+        memset(p_m_tb_store_env->key_lid, M_TB_STORE_INVALID_SLOT, sizeof(p_m_tb_store_env->key_lid));
+        memset(p_m_tb_store_env->model_lid, M_TB_STORE_INVALID_SLOT, sizeof(p_m_tb_store_env->model_lid));
+        memset(p_m_tb_store_env->model_slot, M_TB_STORE_INVALID_SLOT, sizeof(p_m_tb_store_env->model_slot));
+    }
+
+    return (CO_ALIGN4_HI(sizeof(m_tb_store_env_t)));
+}
+
+uint16_t m_tb_store_get_env_size(const m_cfg_t *p_cfg)
+{
+    return (CO_ALIGN4_HI(sizeof(m_tb_store_env_t)));
+}
+
+void m_tb_store_update_ind(uint8_t upd_type, uint32_t dummy)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    m_lid_t lid = (m_lid_t)dummy;
+    uint8_t slot;
+
+    // Nothing to store while stored content is being loaded
+    if ((p_env == NULL) || (p_env->p_load != NULL))
+    {
+        return;
+    }
+
+    switch (upd_type)
+    {
+        case (M_TB_STORE_UPD_TYPE_NET_KEY_UPDATED):
+        case (M_TB_STORE_UPD_TYPE_APP_KEY_UPDATED):
+        {
+            if ((lid == 0) || (lid > M_TB_STORE_NB_KEY_SLOT))
+            {
+                break;
+            }
+
+            if (p_env->key_slot[lid - 1] == M_TB_STORE_INVALID_SLOT)
+            {
+                uint8_t first = (upd_type == M_TB_STORE_UPD_TYPE_NET_KEY_UPDATED) ? 0 : M_TB_KEY_MAX_NB_NET;
+                uint8_t last = (upd_type == M_TB_STORE_UPD_TYPE_NET_KEY_UPDATED)
+                               ? M_TB_KEY_MAX_NB_NET : M_TB_STORE_NB_KEY_SLOT;
+
+                for (slot = first; slot < last; slot++)
+                {
+                    if (p_env->key_lid[slot] == M_TB_STORE_INVALID_SLOT)
+                    {
+                        p_env->key_slot[lid - 1] = slot;
+                        p_env->key_lid[slot] = lid;
+                        break;
+                    }
+                }
+            }
+
+            slot = p_env->key_slot[lid - 1];
+
+            if (slot != M_TB_STORE_INVALID_SLOT)
+            {
+                m_tb_store_set_upd(NVDS_TAG_MESH_NET_KEY_FIRST + slot);
+            }
+        } break;
+
+        case (M_TB_STORE_UPD_TYPE_NET_KEY_DELETED):
+        case (M_TB_STORE_UPD_TYPE_APP_KEY_DELETED):
+        {
+            if ((lid == 0) || (lid > M_TB_STORE_NB_KEY_SLOT))
+            {
+                break;
+            }
+
+            slot = p_env->key_slot[lid - 1];
+
+            if (slot != M_TB_STORE_INVALID_SLOT)
+            {
+                p_env->key_slot[lid - 1] = M_TB_STORE_INVALID_SLOT;
+                p_env->key_lid[slot] = M_TB_STORE_INVALID_SLOT;
+
+                // Key slot is now free, record will be deleted
+                m_tb_store_set_upd(NVDS_TAG_MESH_NET_KEY_FIRST + slot);
+            }
+        } break;
+
+        case (M_TB_STORE_UPD_TYPE_PUBLI_PARAM):
+        case (M_TB_STORE_UPD_TYPE_SUBS_LIST):
+        case (M_TB_STORE_UPD_TYPE_BINDING):
+        {
+            slot = m_tb_store_get_model_slot(lid);
+
+            if (slot == M_TB_STORE_INVALID_SLOT)
+            {
+                break;
+            }
+
+            if (upd_type == M_TB_STORE_UPD_TYPE_PUBLI_PARAM)
+            {
+                m_tb_store_set_upd(NVDS_TAG_MESH_PUBLI_FIRST + slot);
+            }
+            else if (upd_type == M_TB_STORE_UPD_TYPE_SUBS_LIST)
+            {
+                m_tb_store_set_upd(NVDS_TAG_MESH_SUBS_FIRST + slot);
+            }
+            else
+            {
+                m_tb_store_set_upd(NVDS_TAG_MESH_BINDINGS_FIRST + slot);
+            }
+        } break;
+
+        case (M_TB_STORE_UPD_TYPE_STATE):
+        {
+            switch (dummy)
+            {
+                case (M_TB_STORE_TYPE_UNICAST_ADDR):
+                case (M_TB_STORE_TYPE_DEFAULT_TTL_STATE):
+                case (M_TB_STORE_TYPE_SEC_BCN_STATE):
+                case (M_TB_STORE_TYPE_NET_TX_STATE):
+                case (M_TB_STORE_TYPE_RELAY_STATE):
+                case (M_TB_STORE_TYPE_GATT_PROXY_STATE):
+                {
+                    // State types and tag indexes are the same for configuration states
+                    m_tb_store_set_upd(dummy);
+                } break;
+
+                case (M_TB_STORE_TYPE_DEV_KEY):
+                {
+                    m_tb_store_set_upd(NVDS_TAG_MESH_DEV_KEY);
+                } break;
+
+                case (M_TB_STORE_TYPE_IV_SEQ):
+                {
+                    // Sequence numbers are still covered by the stored reservation
+                    if (m_tb_store_iv_seq_due())
+                    {
+                        m_tb_store_set_upd(NVDS_TAG_MESH_IV_SEQ);
+                    }
+                } break;
+
+                default:
+                {
+                    // Friend state is not stored
+                } break;
+            }
+        } break;
+
+        default:
+        {
+            // Friendship information is not stored
+        } break;
+    }
+}
+
+void m_tb_store_iv_seq_update(void)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint32_t iv, seq, nb_used, reserve;
+
+    m_tb_key_get_cur_iv_seq(&seq, &iv);
+
+    // Sequence number restarts from 0 on IV index update
+    nb_used = (seq >= p_env->seq_prev) ? (seq - p_env->seq_prev) : seq;
+    p_env->seq_prev = seq;
+
+    // Size reservation on the averaged rate, or on the last period for a burst
+    p_env->seq_rate = p_env->seq_rate - (p_env->seq_rate >> 2) + (nb_used << 2);
+    reserve = co_max(p_env->seq_rate >> 4, nb_used) * M_TB_STORE_SEQ_RESERVE_PERIODS;
+    p_env->seq_reserve = co_min(co_max(reserve, M_TB_STORE_SEQ_RESERVE_MIN), M_TB_STORE_SEQ_RESERVE_MAX);
+
+    m_tb_store_update_ind(M_TB_STORE_UPD_TYPE_STATE, M_TB_STORE_TYPE_IV_SEQ);
+}
+
+bool m_tb_store_nvs_check(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < ARRAY_LEN(p_m_tb_store_env->upd_bits); i++)
+    {
+        if (p_m_tb_store_env->upd_bits[i] != 0)
+        {
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+void m_tb_stop_scan_before_store_nvs(void)
+{
+    if ((p_m_bearer_env != NULL) && m_tb_store_nvs_check())
+    {
+        uint16_t nb_wrap;
+
+        is_store_nvs = true;
+        mesh_tb_timer_get_cur_time(&p_m_tb_store_env->scan_off_time_ms, &nb_wrap);
+        m_api_disable();
+    }
+}
+
+void m_tb_store_nvs_after_stop_scan(void)
+{
+    if (is_store_nvs)
+    {
+        m_tb_store_stats_t *p_stats = &p_m_tb_store_env->stats;
+
+        is_store_nvs = false;
+        m_tb_store_update();
+
+        // Scanner is enabled again by the caller once storage is done
+        p_stats->scan_off_last_ms = m_tb_store_elapsed_ms(p_m_tb_store_env->scan_off_time_ms);
+        p_stats->scan_off_total_ms += p_stats->scan_off_last_ms;
+
+        if (p_stats->scan_off_last_ms > p_stats->scan_off_max_ms)
+        {
+            p_stats->scan_off_max_ms = p_stats->scan_off_last_ms;
+        }
+    }
+}
+
+bool m_tb_store_process(void)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    uint32_t gap_us, tag_us, slot, fine;
+    uint32_t pass_us = 0;
+    uint16_t nb_wrap;
+    uint8_t idx;
+
+    if ((p_env == NULL) || !p_env->slicing)
+    {
+        return (false);
+    }
+
+    gap_us = rwip_evt_gap_us();
+
+    // Keep next radio event clear of flash programming, unless tags waited too long
+    if ((gap_us < p_env->slice_cost_us)
+            && (m_tb_store_elapsed_ms(p_env->slice_time_ms) < M_TB_STORE_SLICE_WAIT_MAX_MS))
+    {
+        p_env->stats.nb_slice_defer++;
+        return (true);
+    }
+
+    do
+    {
+        idx = m_tb_store_get_upd(p_env->slice_idx);
+
+        if (idx >= M_TB_STORE_NB_TAG)
+        {
+            // Tags marked during the pass are covered by a new write-back
+            p_env->slicing = false;
+            p_env->stats.nb_store++;
+            break;
+        }
+
+        lld_evt_time_get_us(&slot, &fine);
+        m_tb_store_update_tag(idx);
+        tag_us = lld_evt_time_elapsed_us(slot, fine);
+        p_env->slice_idx = idx + 1;
+        pass_us += tag_us;
+
+        if (tag_us > gap_us)
+        {
+            p_env->stats.nb_slice_overrun++;
+        }
+
+        gap_us = (tag_us < gap_us) ? (gap_us - tag_us) : 0;
+
+        // Follow recent stores so that a single NVDS purge does not hold the next passes
+        p_env->slice_cost_us = co_max(M_TB_STORE_SLICE_MIN_US, ((p_env->slice_cost_us * 3) + tag_us) / 4);
+    } while (gap_us >= p_env->slice_cost_us);
+
+    mesh_tb_timer_get_cur_time(&p_env->slice_time_ms, &nb_wrap);
+
+    if (pass_us > p_env->stats.slice_max_us)
+    {
+        p_env->stats.slice_max_us = pass_us;
+    }
+
+    return (p_env->slicing);
+}
+
+void m_tb_store_get_stats(m_tb_store_stats_t *p_stats)
+{
+    if (p_m_tb_store_env != NULL)
+    {
+        *p_stats = p_m_tb_store_env->stats;
+        p_stats->seq_reserve = p_m_tb_store_env->seq_reserve;
+    }
+    else
+    {
+        memset(p_stats, 0, sizeof(m_tb_store_stats_t));
+    }
+}
+
+uint16_t m_tb_store_save(void)
+{
+    // Barrier: everything updated so far is stored before returning
+    m_tb_store_update();
+
+    return (MESH_ERR_NO_ERROR);
+}
+
+uint16_t m_tb_store_config(uint32_t config)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+
+    p_env->delay_s = M_TB_STORE_CONFIG_PERIOD(config);
+    p_env->quiet_ms = M_TB_STORE_CONFIG_QUIET(config) * 100;
+    p_env->max_latency_ms = M_TB_STORE_CONFIG_MAX_LAT(config) * 1000;
+
+    if (p_env->quiet_ms == 0)
+    {
+        p_env->quiet_ms = M_TB_STORE_DFT_QUIET_MS;
+    }
+
+    if (p_env->max_latency_ms == 0)
+    {
+        p_env->max_latency_ms = p_env->delay_s * 1000;
+    }
+
+    if (p_env->delay_s != 0)
+    {
+        m_tb_store_update_ind(M_TB_STORE_UPD_TYPE_STATE, M_TB_STORE_TYPE_IV_SEQ);
+        mesh_tb_timer_set(&p_env->timer, p_env->delay_s * 1000);
+    }
+    else
+    {
+        mesh_tb_timer_clear(&p_env->timer);
+        mesh_tb_timer_clear(&p_env->timer_flush);
+        p_env->dirty = false;
+        p_env->urgent = false;
+    }
+
+    return (MESH_ERR_NO_ERROR);
+}
+
+uint16_t m_tb_store_load(uint16_t length, uint8_t *p_data, m_tb_store_cb_load_t cb_load)
+{
+    m_tb_store_env_t *p_env = p_m_tb_store_env;
+    m_tb_store_load_env_t *p_load;
+
+    if (p_env->p_load != NULL)
+    {
+        return (MESH_ERR_COMMAND_DISALLOWED);
+    }
+
+    p_load = (m_tb_store_load_env_t *)mal_malloc(sizeof(m_tb_store_load_env_t));
+
+    if (p_load == NULL)
+    {
+        return (MESH_ERR_INSUFFICIENT_RESOURCES);
+    }
+
+    p_load->cb_load = cb_load;
+    p_load->idx = 0;
+    p_load->nb_loaded = 0;
+    p_env->p_load = p_load;
+
+    m_tb_store_load_fsm(MESH_ERR_NO_ERROR);
+
+    return (MESH_ERR_NO_ERROR);
+}
+
+void m_tb_store_get_compo_data(uint8_t page, m_tb_store_cb_compo_data_t cb)
+{
+    m_api_send_compo_data_req_ind(page);
+    p_m_tb_store_env->cb_compo = cb;
+}
+
+void m_tb_store_rx_compo_data(uint8_t page, uint8_t length, uint8_t *p_data)
+{
+    if (p_m_tb_store_env->cb_compo != NULL)
+    {
+        p_m_tb_store_env->cb_compo(page, length, p_data);
+        p_m_tb_store_env->cb_compo = NULL;
+    }
+}
+
+#endif //(!BLE_MESH_STORAGE_NONE)
+
+/// @} end of group
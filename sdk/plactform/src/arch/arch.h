@@ -138,6 +138,16 @@ uint16_t get_stack_usage(void);
  */
 void platform_reset(uint32_t error);
 
+/**
+ ****************************************************************************************
+ * @brief Save the application data still waiting in RAM before an orderly reset.
+ *
+ * Called by platform_reset for RESET_NO_ERROR and by wdt_reset. Implemented by the
+ * application; a reset following an error does not call it.
+ ****************************************************************************************
+ */
+void platform_reset_prepare(void);
+
 //#if PLF_DEBUG
 /**
  ****************************************************************************************
@@ -0,0 +1,113 @@
+/**
+ ****************************************************************************************
+ *
+ * @file co_lat.h
+ *
+ * @brief Latency histogram with power-of-two buckets
+ *
+ ****************************************************************************************
+ */
+
+#ifndef _CO_LAT_H_
+#define _CO_LAT_H_
+
+/**
+ *****************************************************************************************
+ * @defgroup CO_LAT Latency histogram
+ * @ingroup COMMON
+ * @brief  Count durations in power-of-two buckets and read back their percentiles.
+ *
+ * @{
+ *****************************************************************************************
+ */
+
+/*
+ * INCLUDE FILES
+ ****************************************************************************************
+ */
+#include "compiler.h"      // for __INLINE
+#include <stdint.h>        // standard integer definitions
+
+/*
+ * DEFINES
+ ****************************************************************************************
+ */
+/// Number of power-of-two buckets, the last one holds everything above 32ms
+#define CO_LAT_BUCKET_NB            16
+
+/*
+ * TYPE DEFINITIONS
+ ****************************************************************************************
+ */
+/// Latency histogram
+struct co_lat_hist
+{
+    /// Number of samples per power-of-two bucket in us
+    uint32_t cnt[CO_LAT_BUCKET_NB];
+    /// Number of samples
+    uint32_t nb;
+    /// Longest sample in us
+    uint32_t max_us;
+};
+
+/*
+ * FUNCTION DEFINITIONS
+ ****************************************************************************************
+ */
+/**
+ ****************************************************************************************
+ * @brief Count a duration in the histogram.
+ *
+ * @param[in] hist Histogram
+ * @param[in] us   Duration in us
+ ****************************************************************************************
+ */
+__INLINE void co_lat_add(struct co_lat_hist *hist, uint32_t us)
+{
+    uint8_t i = 0;
+
+    while ((i < (CO_LAT_BUCKET_NB - 1)) && (us >> (i + 1)))
+    {
+        i++;
+    }
+
+    hist->cnt[i]++;
+    hist->nb++;
+
+    if (us > hist->max_us)
+    {
+        hist->max_us = us;
+    }
+}
+
+/**
+ ****************************************************************************************
+ * @brief Upper bound of the bucket holding a percentile.
+ *
+ * @param[in] hist Histogram
+ * @param[in] pct  Percentile, 1 to 100
+ *
+ * @return The upper bound in us, 0 when the histogram is empty
+ ****************************************************************************************
+ */
+__INLINE uint32_t co_lat_pct(const struct co_lat_hist *hist, uint32_t pct)
+{
+    uint32_t rank = (hist->nb * pct + 99) / 100;
+    uint32_t nb = 0;
+    uint8_t i;
+
+    for (i = 0; i < CO_LAT_BUCKET_NB; i++)
+    {
+        nb += hist->cnt[i];
+        if ((nb != 0) && (nb >= rank))
+        {
+            return (1UL << (i + 1));
+        }
+    }
+
+    return 0;
+}
+
+/// @} CO_LAT
+
+#endif // _CO_LAT_H_
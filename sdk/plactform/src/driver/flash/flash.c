@@ -6,6 +6,8 @@
 #include "uart.h"
 #include "rwip.h"
 #include "ll.h"
+#include "ke_event.h"
+#include "lld_evt.h"
 
 
 
@@ -27,6 +29,69 @@ struct flash_env_tag
 /// Flash environment structure variable
 struct flash_env_tag flash_env;
 
+/// Asynchronous erase job, advanced from KE_EVENT_FLASH_ERASE
+struct flash_erase_job_tag
+{
+    /// Address of the sector to erase or being erased
+    uint32_t    addr;
+    /// Number of sectors left, including the one being erased
+    uint32_t    sect_cnt;
+    /// Completion callback
+    void        (*callback)(void);
+    /// A sector erase has been issued and is not yet completed
+    bool        busy;
+};
+
+static struct flash_erase_job_tag flash_erase_job;
+
+/// One pending write of the deferred write queue
+struct flash_wq_slot
+{
+    /// Data, word aligned for the window fast path
+    uint32_t    data[FLASH_WQ_SLOT_SIZE / 4];
+    /// Flash address
+    uint32_t    addr;
+    /// Number of bytes
+    uint16_t    len;
+};
+
+/// Deferred write queue environment
+struct flash_wq_env_tag
+{
+    struct flash_wq_slot slot[FLASH_WQ_SLOT_NB];
+    /// Oldest pending slot
+    uint8_t     head;
+    /// Number of pending slots
+    uint8_t     cnt;
+    /// Bytes pushed since boot
+    uint32_t    queued;
+    /// Bytes programmed since boot
+    uint32_t    written;
+};
+
+static struct flash_wq_env_tag flash_wq_env;
+
+/// Line mode and clock selected by flash_auto_config()
+struct flash_mode_status flash_mode_status;
+
+/// Read mode decision table, the last entry is used for unknown parts.
+/// Entries that are not validated keep the shipped dual mode at 16MHz.
+static const struct flash_mode_cfg flash_mode_cfg_tab[] =
+{
+    {MX_FLASH_1,    FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    {MX_FLASH_4M,   FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    {GD_FLASH_1,    FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    {BY25Q80,       FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    {PN25f04,       FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    {P25Q40U,       FLASH_LINE_4,   FLASH_CLK_CONF_XTAL_16M,    0},
+    // No QE bit, quad read needs EQPI
+    {XTX_FLASH_1,   FLASH_LINE_2,   FLASH_CLK_CONF_XTAL_16M,    1},
+    // Dual output parts
+    {GD_MD25D40,    FLASH_LINE_2,   FLASH_CLK_CONF_XTAL_16M,    1},
+    {GD_GD25WD40,   FLASH_LINE_2,   FLASH_CLK_CONF_XTAL_16M,    1},
+    {FLASH_TYPE_UNKNOWN, FLASH_LINE_2, FLASH_CLK_CONF_XTAL_16M, 1},
+};
+
 
 extern uint8_t system_mode;
 
@@ -36,6 +101,11 @@ uint8_t flash_enable_write_flag3;
 uint8_t flash_enable_write_flag4;
 uint8_t flash_enable_erase_flag1;
 uint8_t flash_enable_erase_flag2;
+/// Program/erase operations holding the flash unprotected, they nest when an
+/// interrupt writes between the slices of another operation
+static uint8_t flash_unprotect_cnt;
+/// flash_write calls in progress, the last one to return drops write guards 1 and 2
+static uint8_t flash_write_cnt;
 
 
 
@@ -103,6 +173,26 @@ uint32_t flash_read_sr( )
 
 
 
+/*
+ * QE bit of the part in a status register value of the given bytes, 0 when it has none.
+ */
+static uint16_t flash_sr_qe_bit(uint8_t bytes)
+{
+    switch(flash_mid)
+    {
+        case MX_FLASH_4M:
+        case MX_FLASH_1:
+            return 0x0040;                          // SR bit 6
+        case GD_FLASH_1:
+        case BY25Q80:
+        case PN25f04:
+        case P25Q40U:
+            return (bytes == 2) ? 0x0200 : 0;       // SR2 bit 1
+        default:
+            return 0;
+    }
+}
+
 void flash_write_sr( uint8_t bytes,  uint16_t val )
 {
 	if(flash_mid != get_flash_ID())
@@ -129,6 +219,9 @@ void flash_write_sr( uint8_t bytes,  uint16_t val )
 
     if(val==0||bytes>2)	
         return;
+    // The bus keeps fetching in quad mode, the write must not clear QE
+    if(flash_mode_status.line_mode == FLASH_LINE_4)
+        val |= flash_sr_qe_bit(bytes);
     REG_FLASH_CONF |= (val << BIT_WRSR_DATA)|SET_FWREN_FLASH_CPU;
     while(REG_FLASH_OPERATE_SW & 0x80000000);
 	if(flash_mid != get_flash_ID())
@@ -211,6 +304,8 @@ void flash_advance_init(void)
     flash_mid = get_flash_ID();
 
     flash_sr=flash_read_sr( );
+    // QE left set by quad mode is not a protection change
+    flash_sr &= ~flash_sr_qe_bit(2);
 
     switch(flash_mid)
     {
@@ -242,23 +337,162 @@ void flash_advance_init(void)
 
 void flash_init(void)
 {
+    // Select the read line mode and clock from the flash ID
+    flash_auto_config();
+}
+
+/*
+ * Open the flash for program/erase, called with interrupts disabled.
+ * Only the outermost of nested operations changes the protection.
+ */
+static void flash_unprotect_begin(void)
+{
+    if(flash_unprotect_cnt++ == 0)
+    {
+        flash_set_line_mode(1);
+        while(REG_FLASH_OPERATE_SW & 0x80000000);
+        flash_wp_256k();
+    }
+}
 
-    flash_mid = get_flash_ID();
+/*
+ * Close an operation opened by flash_unprotect_begin, called with interrupts
+ * disabled. The last one restores the protection and drops the write guards.
+ */
+static void flash_unprotect_end(void)
+{
+    if(flash_unprotect_cnt && (--flash_unprotect_cnt == 0))
+    {
+        flash_wp_ALL();
+        flash_enable_write_flag3=0;
+        flash_enable_write_flag4=0;
+        flash_set_line_mode(4);
+    }
+}
+
+
+/*
+ * Advance the asynchronous erase job by at most one sector.
+ * Only the controller programming is done with interrupts disabled, the erase
+ * itself runs while the scheduler keeps going.
+ */
+static void flash_erase_job_step(void)
+{
+    void (*callback)(void);
+
+    if(REG_FLASH_OPERATE_SW & 0x80000000)
+        return;
+
+    if(flash_erase_job.busy)
+    {
+        flash_erase_job.busy = false;
+        flash_erase_job.addr += FLASH_ERASE_SECTOR_SIZE;
+        flash_erase_job.sect_cnt--;
+    }
+
+    if(flash_erase_job.sect_cnt == 0)
+    {
+        callback = flash_erase_job.callback;
+
+        GLOBAL_INT_DISABLE();
+        flash_unprotect_end();
+        flash_enable_erase_flag1=0;
+        flash_enable_erase_flag2=0;
+        GLOBAL_INT_RESTORE();
+
+        flash_erase_job.callback = NULL;
+        if(callback != NULL)
+            callback();
+        return;
+    }
+
+    GLOBAL_INT_DISABLE();
+    if(flash_enable_erase_flag1==FLASH_ERASE_ENABLE1&&flash_enable_erase_flag2==FLASH_ERASE_ENABLE2)
+    {
+        REG_FLASH_OPERATE_SW = (  (flash_erase_job.addr << BIT_ADDRESS_SW)
+                                | (FLASH_OPCODE_SE<< BIT_OP_TYPE_SW)
+                                | (0x1             << BIT_OP_SW));
+        flash_erase_job.busy = true;
+    }
+    else
+    {
+        // Guard flags lost, abort the remaining sectors
+        flash_erase_job.sect_cnt = 1;
+    }
+    GLOBAL_INT_RESTORE();
+}
+
+static void flash_erase_evt_handler(void)
+{
+    ke_event_clear(KE_EVENT_FLASH_ERASE);
+
+    flash_erase_job_step();
+
+    // Keep polling while the job is not over
+    if(flash_erase_job.sect_cnt)
+    {
+        ke_event_set(KE_EVENT_FLASH_ERASE);
+    }
+}
+
+bool flash_erase_ongoing(void)
+{
+    return (flash_erase_job.sect_cnt != 0);
+}
+
+void flash_erase_flush(void)
+{
+    while(flash_erase_job.sect_cnt)
+    {
+        flash_erase_job_step();
+    }
+    ke_event_clear(KE_EVENT_FLASH_ERASE);
+}
+
+uint8_t flash_erase_async(uint32_t address, uint32_t len, void (*callback)(void))
+{
+    // One job at a time, a new request waits for the previous one
+    flash_erase_flush();
+    // Writes queued before the erase land first
+    flash_wq_flush();
+
+    if(flash_mid != get_flash_ID())
+    {
+        return CO_ERROR_UNDEFINED;
+    }
 
-    flash_set_dual_mode();
-       
-    // Set the flash clock mode to XTAL mode and 16MHz
-    set_flash_clk(0x8);
+    flash_erase_job.addr = address & (~FLASH_ERASE_SECTOR_SIZE_MASK);
+    flash_erase_job.sect_cnt = len >> FLASH_ERASE_SECTOR_SIZE_RSL_BIT_CNT;
+    flash_erase_job.callback = callback;
+    flash_erase_job.busy = false;
+
+    GLOBAL_INT_DISABLE();
+    flash_enable_erase_flag1=FLASH_ERASE_ENABLE1;
+    flash_enable_erase_flag2=FLASH_ERASE_ENABLE2;
+    flash_unprotect_begin();
+    GLOBAL_INT_RESTORE();
+
+    flash_erase_job_step();
+
+    if(flash_erase_job.sect_cnt)
+    {
+        ke_event_callback_set(KE_EVENT_FLASH_ERASE, &flash_erase_evt_handler);
+        ke_event_set(KE_EVENT_FLASH_ERASE);
+    }
+
+    return CO_ERROR_NO_ERROR;
 }
 
 
 void flash_erase_sector(uint32_t address)
 {
+    flash_erase_flush();
+    flash_wq_flush();
+
     GLOBAL_INT_DISABLE();
-    flash_set_line_mode(1);
     if(flash_enable_erase_flag1==FLASH_ERASE_ENABLE1&&flash_enable_erase_flag2==FLASH_ERASE_ENABLE2)    
     {
-        flash_wp_256k();
+        flash_unprotect_begin();
         
         while(REG_FLASH_OPERATE_SW & 0x80000000);
 
@@ -267,112 +501,185 @@ void flash_erase_sector(uint32_t address)
                                                    | (0x1             << BIT_OP_SW));
 
         while(REG_FLASH_OPERATE_SW & 0x80000000);
-        flash_set_line_mode(4);
-        flash_wp_ALL();
+        flash_unprotect_end();
     }
     GLOBAL_INT_RESTORE();
 }
 
 
 
-void flash_read_data (uint8_t *buffer, uint32_t address, uint32_t len)
+/*
+ * Read one software window (at most FLASH_SW_WINDOW_SIZE bytes) into buffer.
+ * Whole windows going to a word aligned buffer skip the bounce buffer.
+ */
+static void flash_read_window(uint8_t *buffer, uint32_t addr, uint32_t len)
 {
-	
-    uint32_t i, j,k;
-    uint32_t addr = address;
-    uint32_t buf[8];
-    k=0;    
-    if (len == 0)
-        return;
-    GLOBAL_INT_DISABLE();
+    uint32_t i;
+    uint32_t buf[FLASH_SW_WINDOW_WORDS];
+
+    REG_FLASH_OPERATE_SW = (  (addr << BIT_ADDRESS_SW)
+                            | (FLASH_OPCODE_READ << BIT_OP_TYPE_SW)
+                            | (0x1 << BIT_OP_SW));
     while(REG_FLASH_OPERATE_SW & 0x80000000);
 
-    for(j=0;j<((len-1)/32+1);j++)
+    if((len == FLASH_SW_WINDOW_SIZE) && !((uint32_t)buffer & 0x3))
+    {
+        uint32_t *dst = (uint32_t *)buffer;
+
+        for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
+            dst[i] = REG_FLASH_DATA_FLASH_SW;
+    }
+    else
+    {
+        for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
+            buf[i] = REG_FLASH_DATA_FLASH_SW;
+        memcpy(buffer, buf, len);
+    }
+}
+
+/*
+ * Program one software window (at most FLASH_SW_WINDOW_SIZE bytes) from buffer.
+ * The tail of a partial window is padded with 0xFF so it leaves flash untouched.
+ * Returns false when the write guards refused the page program.
+ */
+static bool flash_program_window(uint8_t *buffer, uint32_t addr, uint32_t len)
+{
+    bool done = false;
+
+    uint32_t i;
+    uint32_t buf[FLASH_SW_WINDOW_WORDS];
+
+    flash_enable_write_flag4=FLASH_WRITE_ENABLE4; 
+    if((len == FLASH_SW_WINDOW_SIZE) && !((uint32_t)buffer & 0x3))
+    {
+        uint32_t *src = (uint32_t *)buffer;
+
+        for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
+            REG_FLASH_DATA_SW_FLASH = src[i];
+    }
+    else
+    {
+        for(i=0;i<FLASH_SW_WINDOW_WORDS;i++)
+            buf[i]=0xffffffff;
+        memcpy(buf, buffer, len);
+        for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
+            REG_FLASH_DATA_SW_FLASH = buf[i];
+    }
+
+    if(flash_enable_write_flag1==FLASH_WRITE_ENABLE1 && flash_enable_write_flag2==FLASH_WRITE_ENABLE2 )
     {
-        REG_FLASH_OPERATE_SW = (  (addr << BIT_ADDRESS_SW)
-                                | (FLASH_OPCODE_READ << BIT_OP_TYPE_SW)
-                                | (0x1 << BIT_OP_SW));
         while(REG_FLASH_OPERATE_SW & 0x80000000);
-        addr+=32;
-        for (i=0; i<8; i++)
+
+        if(flash_enable_write_flag3==FLASH_WRITE_ENABLE3 && flash_enable_write_flag4==FLASH_WRITE_ENABLE4)
         {
-            buf[i] = REG_FLASH_DATA_FLASH_SW;
+            if(addr<0x40000)
+                return false;
+            REG_FLASH_OPERATE_SW = (  (addr << BIT_ADDRESS_SW)
+                                | (FLASH_OPCODE_PP << BIT_OP_TYPE_SW)
+                                | (0x1 << BIT_OP_SW));
+            done = true;
         }
+        while(REG_FLASH_OPERATE_SW & 0x80000000);
+    }
+
+    return done;
+}
+
+void flash_read_data_sliced(uint8_t *buffer, uint32_t address, uint32_t len, uint32_t slice_len)
+{
+    uint32_t i;
+    uint32_t win_len;
+    uint32_t slice_cnt;
+
+    if (len == 0)
+        return;
+    if (slice_len < FLASH_SW_WINDOW_SIZE)
+        slice_len = FLASH_SW_WINDOW_SIZE;
+
+    // Reads are queued behind a pending asynchronous erase
+    flash_erase_flush();
 
-        if(len>32*(j+1))
-            memcpy(&buffer[k],buf,32);
-        else
+    while(len)
+    {
+        GLOBAL_INT_DISABLE();
+        while(REG_FLASH_OPERATE_SW & 0x80000000);
+
+        for(slice_cnt = 0; len && (slice_cnt < slice_len); slice_cnt += win_len)
         {
-            memcpy(&buffer[k],buf,len-k);
+            win_len = MIN(len, FLASH_SW_WINDOW_SIZE);
+            flash_read_window(buffer, address, win_len);
+            buffer += win_len;
+            address += win_len;
+            len -= win_len;
         }
-        k += 32;        
+
+        // Leave the controller idle so that an interrupt may use it
+        REG_FLASH_OPERATE_SW=FLASH_ADDR_FIX ;
+        for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
+            REG_FLASH_DATA_SW_FLASH = 0xffffffff;
+        GLOBAL_INT_RESTORE();
     }
-    REG_FLASH_OPERATE_SW=FLASH_ADDR_FIX ;
-    for (i=0; i<8; i++)
-        REG_FLASH_DATA_SW_FLASH = 0xffffffff;
-    GLOBAL_INT_RESTORE();
 }
 
+void flash_read_data (uint8_t *buffer, uint32_t address, uint32_t len)
+{
+    flash_read_data_sliced(buffer, address, len, FLASH_INT_SLICE_SIZE);
+}
 
 
-
-void flash_write_data (uint8_t *buffer, uint32_t address, uint32_t len)
+uint8_t flash_write_data_sliced(uint8_t *buffer, uint32_t address, uint32_t len, uint32_t slice_len)
 {
-    uint32_t i, j,k;
-    uint32_t addr = address;
-    uint32_t buf[8];
-    k=0;
+    uint32_t i;
+    uint32_t win_len;
+    uint32_t slice_cnt;
+    uint8_t status = CO_ERROR_NO_ERROR;
+
     if (len == 0)
-        return;
+        return CO_ERROR_NO_ERROR;
     if (address<0x40000)
-        return;
-    GLOBAL_INT_DISABLE();
-	flash_set_line_mode(1);
+        return CO_ERROR_COMMAND_DISALLOWED;
+    if (slice_len < FLASH_SW_WINDOW_SIZE)
+        slice_len = FLASH_SW_WINDOW_SIZE;
 
-    while(REG_FLASH_OPERATE_SW & 0x80000000);
-    
-    flash_enable_write_flag3=FLASH_WRITE_ENABLE3; 
-    flash_wp_256k();
-    for(j=0;j<((len-1)/32+1);j++)
-    {
-        if(len>32*(j+1))
-            memcpy(buf,&buffer[k],32);
-        else
-        {
-         	for(i=0;i<8;i++)
-                buf[i]=0xffffffff;
-            memcpy(buf,&buffer[k],len-k);
-        }
-        k += 32;
-        flash_enable_write_flag4=FLASH_WRITE_ENABLE4; 
-        for (i=0; i<8; i++)
-            REG_FLASH_DATA_SW_FLASH = buf[i];
+    flash_erase_flush();
 
+    GLOBAL_INT_DISABLE();
+    flash_unprotect_begin();
+    flash_enable_write_flag3=FLASH_WRITE_ENABLE3; 
+    GLOBAL_INT_RESTORE();
 
-        if(flash_enable_write_flag1==FLASH_WRITE_ENABLE1 && flash_enable_write_flag2==FLASH_WRITE_ENABLE2 )
+    while(len)
+    {
+        GLOBAL_INT_DISABLE();
+        for(slice_cnt = 0; len && (slice_cnt < slice_len); slice_cnt += win_len)
         {
-            while(REG_FLASH_OPERATE_SW & 0x80000000);
-            
-            if(flash_enable_write_flag3==FLASH_WRITE_ENABLE3 && flash_enable_write_flag4==FLASH_WRITE_ENABLE4)
+            win_len = MIN(len, FLASH_SW_WINDOW_SIZE);
+            if (!flash_program_window(buffer, address, win_len))
             {
-                if(addr<0x40000)
-                    return;
-                REG_FLASH_OPERATE_SW = (  (addr << BIT_ADDRESS_SW)
-                                    | (FLASH_OPCODE_PP << BIT_OP_TYPE_SW)
-                                    | (0x1 << BIT_OP_SW));
+                status = CO_ERROR_COMMAND_DISALLOWED;
             }
-            while(REG_FLASH_OPERATE_SW & 0x80000000);
+            buffer += win_len;
+            address += win_len;
+            len -= win_len;
         }
-        addr+=32;
+        REG_FLASH_OPERATE_SW=FLASH_ADDR_FIX ;
+        GLOBAL_INT_RESTORE();
     }
-    flash_wp_ALL();
+
+    GLOBAL_INT_DISABLE();
     REG_FLASH_OPERATE_SW=FLASH_ADDR_FIX ;
-    flash_enable_write_flag3=0;
-    flash_enable_write_flag4=0;
-    for (i=0; i<8; i++)
+    for (i=0; i<FLASH_SW_WINDOW_WORDS; i++)
         REG_FLASH_DATA_SW_FLASH = 0xffffffff;
-	flash_set_line_mode(4);
+    // A write nested in the slices above keeps the flash open for this one
+    flash_unprotect_end();
 	GLOBAL_INT_RESTORE();
+
+    return status;
+}
+
+uint8_t flash_write_data (uint8_t *buffer, uint32_t address, uint32_t len)
+{
+    return flash_write_data_sliced(buffer, address, len, FLASH_INT_SLICE_SIZE);
 }
 
 
@@ -469,6 +776,128 @@ void flash_set_line_mode(uint8_t mode)
 
 }
 
+/*
+ * Program the bus read path line mode, the QE bit must already be set for quad.
+ */
+static void flash_mode_sel_set(uint8_t line_mode)
+{
+    uint32_t mode_sel;
+
+    switch(line_mode)
+    {
+        case FLASH_LINE_4: mode_sel = FLASH_MODE_SEL_QUAD;   break;
+        case FLASH_LINE_2: mode_sel = FLASH_MODE_SEL_DUAL;   break;
+        default:           mode_sel = FLASH_MODE_SEL_SINGLE; break;
+    }
+
+    clr_flash_qwfr();
+    REG_FLASH_CONF &= (~(7<<BIT_MODE_SEL));
+    REG_FLASH_CONF |= (mode_sel<<BIT_MODE_SEL);
+    while(REG_FLASH_OPERATE_SW & 0x80000000);
+}
+
+/*
+ * Compare a bus readback of the self-test area with a software read, which
+ * always uses the single line command path. This catches a wrong line mode
+ * or a missing QE bit, not a marginal clock, hence the validated column.
+ */
+static bool flash_mode_selftest(void)
+{
+    uint32_t ref[FLASH_SELFTEST_LEN / 4];
+    volatile uint32_t *bus;
+    uint32_t addr;
+    uint32_t i;
+
+    for(addr = FLASH_SELFTEST_ADDR; addr < FLASH_SELFTEST_ADDR + FLASH_SELFTEST_TPUT_LEN;
+        addr += FLASH_SELFTEST_LEN)
+    {
+        bus = (volatile uint32_t *)addr;
+        flash_read_data((uint8_t *)ref, addr, FLASH_SELFTEST_LEN);
+        for(i = 0; i < FLASH_SELFTEST_LEN / 4; i++)
+        {
+            if(bus[i] != ref[i])
+                return false;
+        }
+    }
+
+    return true;
+}
+
+const struct flash_mode_cfg *flash_mode_cfg_get(uint32_t flash_id)
+{
+    uint32_t i;
+    uint32_t nb = sizeof(flash_mode_cfg_tab) / sizeof(flash_mode_cfg_tab[0]);
+
+    for(i = 0; i < nb - 1; i++)
+    {
+        if(flash_mode_cfg_tab[i].flash_id == flash_id)
+            break;
+    }
+
+    return &flash_mode_cfg_tab[i];
+}
+
+void flash_auto_config(void)
+{
+    const struct flash_mode_cfg *cfg;
+
+    flash_mid = get_flash_ID();
+    cfg = flash_mode_cfg_get(flash_mid);
+    if(!cfg->validated)
+    {
+        cfg = flash_mode_cfg_get(FLASH_TYPE_UNKNOWN);
+    }
+
+    flash_mode_status.flash_id = flash_mid;
+    flash_mode_status.line_mode = cfg->line_mode;
+    flash_mode_status.clk_conf = cfg->clk_conf;
+    flash_mode_status.fallback = 0;
+
+    GLOBAL_INT_DISABLE();
+    if(cfg->line_mode == FLASH_LINE_4)
+    {
+        flash_set_qe();
+    }
+    flash_mode_sel_set(cfg->line_mode);
+    set_flash_clk(cfg->clk_conf);
+
+    if(!flash_mode_selftest())
+    {
+        flash_set_dual_mode();
+        set_flash_clk(FLASH_CLK_CONF_XTAL_16M);
+        flash_mode_status.line_mode = FLASH_LINE_2;
+        flash_mode_status.clk_conf = FLASH_CLK_CONF_XTAL_16M;
+        flash_mode_status.fallback = 1;
+    }
+    GLOBAL_INT_RESTORE();
+}
+
+void flash_mode_tput_measure(void)
+{
+    volatile uint32_t *bus = (volatile uint32_t *)FLASH_SELFTEST_ADDR;
+    uint32_t slot, fine;
+    uint32_t us;
+    uint32_t sum = 0;
+    uint32_t i;
+
+    GLOBAL_INT_DISABLE();
+    lld_evt_time_get_us(&slot, &fine);
+    for(i = 0; i < FLASH_SELFTEST_TPUT_LEN / 4; i++)
+    {
+        sum += bus[i];
+    }
+    us = lld_evt_time_elapsed_us(slot, fine);
+    GLOBAL_INT_RESTORE();
+    (void)sum;
+
+    flash_mode_status.tput_kbps = (us != 0) ? (FLASH_SELFTEST_TPUT_LEN * (1000000 / 1024)) / us : 0;
+
+    UART_PRINTF("flash 0x%x line %d clk 0x%x fallback %d %d KB/s\r\n",
+                flash_mode_status.flash_id, flash_mode_status.line_mode,
+                flash_mode_status.clk_conf, flash_mode_status.fallback,
+                flash_mode_status.tput_kbps);
+}
+
 
 uint8_t flash_read(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t *buffer, void (*callback)(void))
 {
@@ -507,13 +936,18 @@ uint8_t flash_write(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t
     uint32_t post_len;
     uint32_t page0;
     uint32_t page1;
+    uint8_t status;
     if(flash_mid != get_flash_ID())
     {
         uart_printf("flash = 0x%x\r\n", get_flash_ID());
         return CO_ERROR_UNDEFINED;
     }
 
+    // A write from an interrupt between the slices below keeps the guards set
+    GLOBAL_INT_DISABLE();
+    flash_write_cnt++;
     flash_enable_write_flag1=FLASH_WRITE_ENABLE1; 
+    GLOBAL_INT_RESTORE();
     
     page0 = address &(~FLASH_PAGE_MASK);
     page1 = (address + len) &(~FLASH_PAGE_MASK);
@@ -523,25 +957,131 @@ uint8_t flash_write(uint8_t flash_space, uint32_t address, uint32_t len, uint8_t
         pre_address = address;
         pre_len = page1 - address;
         flash_enable_write_flag2=FLASH_WRITE_ENABLE2;
-        flash_write_data(buffer, pre_address, pre_len);
+        status = flash_write_data(buffer, pre_address, pre_len);
         
         post_address = page1;
         post_len = address + len - page1;
-        flash_write_data((buffer + pre_len), post_address, post_len);
+        if (flash_write_data((buffer + pre_len), post_address, post_len) != CO_ERROR_NO_ERROR)
+        {
+            status = CO_ERROR_COMMAND_DISALLOWED;
+        }
 
     }
     else
     {
         flash_enable_write_flag2=FLASH_WRITE_ENABLE2;
-        flash_write_data(buffer, address, len);
+        status = flash_write_data(buffer, address, len);
+
+    }
 
+    GLOBAL_INT_DISABLE();
+    if (--flash_write_cnt == 0)
+    {
+        flash_enable_write_flag1=0; 
+        flash_enable_write_flag2=0;	
     }
-    flash_enable_write_flag1=0; 
-    flash_enable_write_flag2=0;	
+    GLOBAL_INT_RESTORE();
     
+    return status;
+}
+
+
+
+/*
+ * Program the oldest slot of the write queue.
+ */
+static void flash_wq_write_head(void)
+{
+    struct flash_wq_slot *slot = &flash_wq_env.slot[flash_wq_env.head];
+
+    flash_write(flash_env.space_type, slot->addr, slot->len, (uint8_t *)slot->data, NULL);
+    flash_wq_env.written += slot->len;
+    flash_wq_env.head = (flash_wq_env.head + 1) % FLASH_WQ_SLOT_NB;
+    flash_wq_env.cnt--;
+}
+
+/*
+ * Newest slot of the write queue when the data at address continues it and
+ * it has room left, NULL otherwise.
+ */
+static struct flash_wq_slot *flash_wq_tail_get(uint32_t address)
+{
+    struct flash_wq_slot *slot;
+
+    if(flash_wq_env.cnt == 0)
+        return NULL;
+
+    slot = &flash_wq_env.slot[(flash_wq_env.head + flash_wq_env.cnt - 1) % FLASH_WQ_SLOT_NB];
+    if((slot->addr + slot->len != address) || (slot->len == FLASH_WQ_SLOT_SIZE))
+        return NULL;
+
+    return slot;
+}
+
+uint8_t flash_wq_push(uint32_t address, uint8_t *buffer, uint32_t len)
+{
+    struct flash_wq_slot *slot;
+    uint32_t room;
+    uint32_t sub_len;
+
+    room = (FLASH_WQ_SLOT_NB - flash_wq_env.cnt) * FLASH_WQ_SLOT_SIZE;
+    slot = flash_wq_tail_get(address);
+    if(slot != NULL)
+    {
+        room += FLASH_WQ_SLOT_SIZE - slot->len;
+    }
+    // Nothing is queued when the data does not fit, the caller retries later
+    if(len > room)
+        return CO_ERROR_MEMORY_CAPA_EXCEED;
+
+    while(len)
+    {
+        slot = flash_wq_tail_get(address);
+        if(slot == NULL)
+        {
+            slot = &flash_wq_env.slot[(flash_wq_env.head + flash_wq_env.cnt) % FLASH_WQ_SLOT_NB];
+            slot->addr = address;
+            slot->len = 0;
+            flash_wq_env.cnt++;
+        }
+
+        sub_len = MIN(len, FLASH_WQ_SLOT_SIZE - slot->len);
+        memcpy((uint8_t *)slot->data + slot->len, buffer, sub_len);
+        slot->len += sub_len;
+        flash_wq_env.queued += sub_len;
+
+        buffer += sub_len;
+        address += sub_len;
+        len -= sub_len;
+    }
+
     return CO_ERROR_NO_ERROR;
 }
 
+bool flash_wq_process(void)
+{
+    if(flash_wq_env.cnt && !flash_erase_ongoing())
+    {
+        flash_wq_write_head();
+    }
+
+    return (flash_wq_env.cnt != 0);
+}
+
+void flash_wq_flush(void)
+{
+    while(flash_wq_env.cnt)
+    {
+        flash_wq_write_head();
+    }
+}
+
+void flash_wq_progress(uint32_t *queued, uint32_t *written)
+{
+    *queued = flash_wq_env.queued;
+    *written = flash_wq_env.written;
+}
+
 
 
 void udi_exchange_fdata_to_adjoining_next_sector(uint32_t data_addr, uint32_t len, uint32_t wr_point_inpage)
@@ -616,6 +1156,9 @@ uint8_t flash_erase(uint8_t flash_type, uint32_t address, uint32_t len, void (*c
     int erase_addr;
     int erase_len;
 
+    // Writes queued before the erase land first
+    flash_erase_flush();
+    flash_wq_flush();
 
     flash_enable_erase_flag1=FLASH_ERASE_ENABLE1;
     
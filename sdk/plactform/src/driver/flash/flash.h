@@ -15,7 +15,9 @@
 #define FLASH_H_
 
 #include <stdint.h>               // standard integer functions
+#include <stdbool.h>              // boolean definition
 #include "BK3435_reg.h"
+#include "flash_map.h"
 /**
  ****************************************************************************************
  * @addtogroup FLASH
@@ -57,6 +59,14 @@
 #define FLASH_ERASE_SECTOR_SIZE_MASK                      (FLASH_ERASE_SECTOR_SIZE - 1)
 #define UPDATE_CHUNK_SIZE                                 (32)
 
+/// Bytes moved by one software read/program window of the flash controller
+#define FLASH_SW_WINDOW_SIZE                              (32)
+#define FLASH_SW_WINDOW_WORDS                             (FLASH_SW_WINDOW_SIZE / 4)
+/// Bytes transferred per interrupt-off section by flash_read_data/flash_write_data
+#ifndef FLASH_INT_SLICE_SIZE
+#define FLASH_INT_SLICE_SIZE                              (4 * FLASH_SW_WINDOW_SIZE)
+#endif
+
 #define GD_FLASH_1	 0XC84013
 #define GD_MD25D40   0x514013
 #define GD_GD25WD40  0xc86413
@@ -80,6 +90,22 @@
 
 #define DEFAULT_LINE_MODE  FLASH_LINE_4
 
+/// REG_FLASH_CONF mode_sel values of the bus read path
+#define FLASH_MODE_SEL_SINGLE   0
+#define FLASH_MODE_SEL_DUAL     1
+#define FLASH_MODE_SEL_QUAD     2
+
+/// REG_FLASH_CONF clock configuration: XTAL, 16MHz
+#define FLASH_CLK_CONF_XTAL_16M 0x8
+
+/// Area read back by the line mode self-test (start of the stack image),
+/// compared FLASH_SELFTEST_LEN bytes at a time
+#define FLASH_SELFTEST_ADDR     0x3000
+#define FLASH_SELFTEST_LEN      64
+/// Bytes checked by the self-test and read through the bus to measure the
+/// throughput of the selected mode
+#define FLASH_SELFTEST_TPUT_LEN 4096
+
 #define FLASH_ADDR_FIX  0X7D000
 #define FLASH_WRITE_ENABLE1  0XA6
 #define FLASH_WRITE_ENABLE2  0XB3
@@ -117,11 +143,48 @@ typedef enum {
 } FLASH_OPCODE;
 
 
+/// Deferred write queue: number of slots and bytes per slot
+#ifndef FLASH_WQ_SLOT_NB
+#define FLASH_WQ_SLOT_NB        4
+#endif
+#ifndef FLASH_WQ_SLOT_SIZE
+#define FLASH_WQ_SLOT_SIZE      256
+#endif
+
+/// Line mode and clock selected for a flash part
+struct flash_mode_cfg
+{
+    /// Flash ID as returned by get_flash_ID()
+    uint32_t    flash_id;
+    /// Fastest supported read line mode (FLASH_LINE_x)
+    uint8_t     line_mode;
+    /// Clock configuration written through set_flash_clk()
+    uint8_t     clk_conf;
+    /// The mode was validated on this part, otherwise dual mode at 16MHz is kept
+    uint8_t     validated;
+};
+
+/// Result of flash_auto_config()
+struct flash_mode_status
+{
+    /// Flash ID found at startup
+    uint32_t    flash_id;
+    /// Line mode in use
+    uint8_t     line_mode;
+    /// Clock configuration in use
+    uint8_t     clk_conf;
+    /// The preferred mode failed its readback and the fallback is in use
+    uint8_t     fallback;
+    /// Measured bus read throughput in KB/s, 0 when it could not be measured
+    uint32_t    tput_kbps;
+};
+
 /*
  * FUNCTION DECLARATIONS
  ****************************************************************************************
  */
 extern struct flash_env_tag flash_env;
+extern struct flash_mode_status flash_mode_status;
 
 void flash_advance_init(void);
 
@@ -164,6 +227,37 @@ uint8_t flash_identify(uint8_t* id, void (*callback)(void));
  */
 uint8_t flash_erase(uint8_t flash_type, uint32_t offset, uint32_t size, void (*callback)(void));
 
+/**
+ ****************************************************************************************
+ * @brief   Erase a flash section without blocking the CPU.
+ *
+ * The first sector erase is issued immediately, the following ones are started
+ * from the KE_EVENT_FLASH_ERASE kernel event once the controller is idle again.
+ * Any flash read, write or synchronous erase waits for the pending job first.
+ *
+ * @param[in]    offset      Starting offset, rounded down to a sector boundary
+ * @param[in]    size        Size of the portion of flash to erase (whole sectors)
+ * @param[in]    callback    Called from the kernel event when the last sector is erased
+ * @return       status      0 if operation can start successfully
+ ****************************************************************************************
+ */
+uint8_t flash_erase_async(uint32_t offset, uint32_t size, void (*callback)(void));
+
+/**
+ ****************************************************************************************
+ * @brief   Complete the pending asynchronous erase, if any, by polling.
+ ****************************************************************************************
+ */
+void flash_erase_flush(void);
+
+/**
+ ****************************************************************************************
+ * @brief   Check whether an asynchronous erase is pending.
+ * @return  true while sectors remain to be erased
+ ****************************************************************************************
+ */
+bool flash_erase_ongoing(void);
+
 /**
  ****************************************************************************************
  * @brief   Write a flash section.
@@ -210,9 +304,120 @@ void flash_write_sr(unsigned char bytes,  unsigned short val);
 void flash_test(void);
 void flash_set_line_mode(uint8_t mode);
 void flash_read_data (uint8_t *buffer, uint32_t address, uint32_t len);
-void flash_write_data (uint8_t *buffer, uint32_t address, uint32_t len);
+uint8_t flash_write_data (uint8_t *buffer, uint32_t address, uint32_t len);
+
+/**
+ ****************************************************************************************
+ * @brief   Read flash with bounded interrupt-off sections.
+ *
+ * Interrupts are disabled for at most slice_len bytes (rounded up to whole
+ * FLASH_SW_WINDOW_SIZE windows) and re-enabled between slices.
+ *
+ * @param[out]   buffer      Pointer on data to read
+ * @param[in]    address     Flash address, no alignment required
+ * @param[in]    len         Number of bytes to read
+ * @param[in]    slice_len   Bytes transferred per interrupt-off section
+ ****************************************************************************************
+ */
+void flash_read_data_sliced(uint8_t *buffer, uint32_t address, uint32_t len, uint32_t slice_len);
+
+/**
+ ****************************************************************************************
+ * @brief   Program flash with bounded interrupt-off sections.
+ *
+ * Same slicing as @ref flash_read_data_sliced. The write protection stays
+ * opened for the whole operation and is restored at the end.
+ *
+ * @param[in]    buffer      Pointer on data to write
+ * @param[in]    address     Flash address, no alignment required
+ * @param[in]    len         Number of bytes to write
+ * @param[in]    slice_len   Bytes transferred per interrupt-off section
+ *
+ * @return CO_ERROR_NO_ERROR, or CO_ERROR_COMMAND_DISALLOWED when a window was
+ * refused by the write guards or the address check
+ ****************************************************************************************
+ */
+uint8_t flash_write_data_sliced(uint8_t *buffer, uint32_t address, uint32_t len, uint32_t slice_len);
 void flash_set_dual_mode(void);
 
+/**
+ ****************************************************************************************
+ * @brief   Queue data to be programmed later from the idle loop.
+ *
+ * The data is copied, so the caller buffer can be reused on return. Writes are
+ * programmed in queue order, data continuing the newest slot is appended to
+ * it. When the data does not fit nothing is queued and the caller has to keep
+ * it and push it again once flash_wq_process() has freed slots.
+ *
+ * @param[in]    address     Flash address
+ * @param[in]    buffer      Data to write
+ * @param[in]    len         Number of bytes to write
+ * @return       status      CO_ERROR_NO_ERROR, CO_ERROR_MEMORY_CAPA_EXCEED when
+ *                           the queue has no room for len bytes
+ ****************************************************************************************
+ */
+uint8_t flash_wq_push(uint32_t address, uint8_t *buffer, uint32_t len);
+
+/**
+ ****************************************************************************************
+ * @brief   Program at most one queued slot, to be called from the idle loop.
+ *
+ * Nothing is done while an asynchronous erase is pending.
+ *
+ * @return  true if queued data remains
+ ****************************************************************************************
+ */
+bool flash_wq_process(void);
+
+/**
+ ****************************************************************************************
+ * @brief   Barrier: program all queued data before returning.
+ ****************************************************************************************
+ */
+void flash_wq_flush(void);
+
+/**
+ ****************************************************************************************
+ * @brief   Get the progress of the write queue since boot.
+ *
+ * @param[out]   queued      Total number of bytes pushed
+ * @param[out]   written     Total number of bytes programmed
+ ****************************************************************************************
+ */
+void flash_wq_progress(uint32_t *queued, uint32_t *written);
+
+/**
+ ****************************************************************************************
+ * @brief   Look up the line mode and clock to use for a flash ID.
+ *
+ * @param[in]    flash_id    Flash ID as returned by get_flash_ID()
+ * @return       Entry of the decision table, the default entry for unknown parts
+ ****************************************************************************************
+ */
+const struct flash_mode_cfg *flash_mode_cfg_get(uint32_t flash_id);
+
+/**
+ ****************************************************************************************
+ * @brief   Select the fastest validated read mode of the flash part.
+ *
+ * Parts whose table entry is not validated keep dual mode at 16MHz. The mode
+ * is checked by comparing a bus readback of FLASH_SELFTEST_ADDR with a
+ * software read of the same area. On mismatch dual mode is restored. The
+ * result is recorded in flash_mode_status.
+ ****************************************************************************************
+ */
+void flash_auto_config(void);
+
+/**
+ ****************************************************************************************
+ * @brief   Measure the bus read throughput of the selected mode.
+ *
+ * The reads are timed with the BLE base time, so this must be called after
+ * rwip_init(). The result is recorded in flash_mode_status.tput_kbps.
+ ****************************************************************************************
+ */
+void flash_mode_tput_measure(void);
+
 /// @} FLASH
 
 #endif // FLASH_H_
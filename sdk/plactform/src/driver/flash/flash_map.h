@@ -0,0 +1,54 @@
+/**
+ ****************************************************************************************
+ *
+ * @file flash_map.h
+ *
+ * @brief Flash areas shared by the drivers, the OTA paths and the linker scatter file
+ *
+ * Only preprocessor definitions, the scatter file includes this header.
+ *
+ ****************************************************************************************
+ */
+
+#ifndef FLASH_MAP_H_
+#define FLASH_MAP_H_
+
+/// Log-structured NVDS backend (nvds_log.h), kept in the storage sectors. Enabled by the
+/// switch project, which already gives up these sectors for the IV/SEQ sector
+#ifndef NVDS_LOG_STRUCTURED
+#define NVDS_LOG_STRUCTURED             0
+#endif
+
+/// Mesh IV/SEQ sector (m_tb_store_nvds.c), kept in the storage sectors. Enabled by the
+/// projects whose image still fits in the smaller OTA backup area (switch); the others are
+/// too large for it and keep IV/SEQ in its NVDS tag.
+#ifndef M_TB_STORE_IV_SEQ_SLOT
+#define M_TB_STORE_IV_SEQ_SLOT          0
+#endif
+
+/// End of the storage sectors, the device data (FLASH_ALI_DATA_ADDRESS) starts here
+#define FLASH_STORAGE_END_ADDR          0x7E000
+/// Start of the storage sectors: IV/SEQ sector (0x7B000), NVDS log (0x7C000). They are
+/// only taken from the OTA backup area when a feature that uses them is enabled.
+#if (NVDS_LOG_STRUCTURED || M_TB_STORE_IV_SEQ_SLOT)
+#define FLASH_STORAGE_START_ADDR        0x7B000
+#else
+#define FLASH_STORAGE_START_ADDR        FLASH_STORAGE_END_ADDR
+#endif
+
+/// IV/SEQ sector
+#define FLASH_IV_SEQ_SLOT_ADDR          0x7B000
+#define FLASH_IV_SEQ_SLOT_SIZE          0x1000
+/// NVDS log sectors
+#define FLASH_NVDS_LOG_ADDR             0x7C000
+
+#if ((FLASH_IV_SEQ_SLOT_ADDR + FLASH_IV_SEQ_SLOT_SIZE) > FLASH_NVDS_LOG_ADDR)
+#error "IV/SEQ sector overlapping the NVDS log"
+#endif
+
+/// OTA backup area, holds the received image (header included)
+#define FLASH_BACKUP_START_ADDR         0x52000
+#define FLASH_BACKUP_END_ADDR           FLASH_STORAGE_START_ADDR
+#define FLASH_BACKUP_SIZE               (FLASH_BACKUP_END_ADDR - FLASH_BACKUP_START_ADDR)
+
+#endif // FLASH_MAP_H_
@@ -3,6 +3,7 @@
 #include <stddef.h>        // standard definition
 #include "BK3435_reg.h"
 #include "wdt.h"
+#include "arch.h"
 
 uint8_t wdt_disable_flag = 0;
 static uint8_t wdt_enable_status = 0;
@@ -33,6 +34,8 @@ void wdt_enable(uint16_t wdt_cnt)
 //ÿλ250us0xffffԼ16s
 void wdt_reset(uint16_t wdt_cnt)
 {
+    platform_reset_prepare();
+
     REG_AHB0_ICU_WDTCLKCON = 0x0 ; // Step1. WDT clock enable,
     REG_APB0_WDT_CFG  = wdt_cnt;   // Step2. Set WDT period=0xFF
     // Do two things together: 1. Set WDT period. 2. Write WDT key to feed dog.
@@ -35,6 +35,7 @@ void wdt_feed(uint16_t wdt_cnt);
 void  wdt_disable(void);
 void wdt_enable(uint16_t wdt_cnt);
 
+// Orderly reset: platform_reset_prepare() then reset when the watchdog expires
 void wdt_reset(uint16_t wdt_cnt);
 
 